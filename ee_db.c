@@ -21,15 +21,15 @@ void eedb_init_ctx(volatile struct eedb_ctx *ctx) {
 	ctx->_next_free_eeaddr = ctx->start_eeaddr + ctx->_allocated_bytes_eeaddr;
 
 	/*char tmp[64];
-	sprintf(tmp, "RECORD CAPACITY: %u\r\n", ctx->record_capacity);
+	sprintf_P(tmp, PSTR("RECORD CAPACITY: %u\r\n"), ctx->record_capacity);
 	uart_puts(tmp);
-	sprintf(tmp, "ALLOCATED: %u\r\n", ctx->_allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("ALLOCATED: %u\r\n"), ctx->_allocated_bytes_eeaddr);
 	uart_puts(tmp);
-	sprintf(tmp, "SIZEOF REC-ENTRY: %u\r\n", ctx->sizeof_record_entry);
+	sprintf_P(tmp, PSTR("SIZEOF REC-ENTRY: %u\r\n"), ctx->sizeof_record_entry);
 	uart_puts(tmp);
-	sprintf(tmp, "BLOCK SIZE: %u\r\n", ctx->_block_size);
+	sprintf_P(tmp, PSTR("BLOCK SIZE: %u\r\n"), ctx->_block_size);
 	uart_puts(tmp);
-	sprintf(tmp, "NEXT FREE EEADDR: %u\r\n", ctx->_next_free_eeaddr);
+	sprintf_P(tmp, PSTR("NEXT FREE EEADDR: %u\r\n"), ctx->_next_free_eeaddr);
 	uart_puts(tmp);*/
 	
 	if(ctx->_eedb_info.formatted_magic != EEDB_FORMATTED_MAGIC) {
@@ -223,11 +223,11 @@ uint16_t eedb_find_record_eeaddr(volatile struct eedb_ctx *ctx, uint32_t pk, uin
 	}
 
 	/*char tmp[64];
-	sprintf(tmp, "START = %u\r\n", (ctx->start_eeaddr + sizeof(struct eedb_info) + eeaddr_offset));
+	sprintf_P(tmp, PSTR("START = %u\r\n"), (ctx->start_eeaddr + sizeof(struct eedb_info) + eeaddr_offset));
 	uart_puts(tmp);
-	sprintf(tmp, "START <= %u\r\n", (ctx->start_eeaddr + ctx->_allocated_bytes_eeaddr - ctx->_block_size));
+	sprintf_P(tmp, PSTR("START <= %u\r\n"), (ctx->start_eeaddr + ctx->_allocated_bytes_eeaddr - ctx->_block_size));
 	uart_puts(tmp);
-	sprintf(tmp, "BLOCKSIZE = %u\r\n", ctx->_block_size);
+	sprintf_P(tmp, PSTR("BLOCKSIZE = %u\r\n"), ctx->_block_size);
 	uart_puts(tmp);*/
 
 	for(
@@ -235,7 +235,7 @@ uint16_t eedb_find_record_eeaddr(volatile struct eedb_ctx *ctx, uint32_t pk, uin
 		eeaddr <= ctx->start_eeaddr + ctx->_allocated_bytes_eeaddr - ctx->_block_size;
 		eeaddr += ctx->_block_size
 	) {
-		/*sprintf(tmp, "seek @ %u\r\n", eeaddr);
+		/*sprintf_P(tmp, PSTR("seek @ %u\r\n"), eeaddr);
 		uart_puts(tmp);*/
 
 		struct eedb_record_header header_entry;
@@ -323,7 +323,7 @@ void eedb_print_headers(volatile struct eedb_ctx *ctx) {
 		eedb_read_i2c(ctx, eeaddr, sizeof(struct eedb_record_header), &header_entry);
 		
 		char tmp[127];
-		sprintf(tmp, "0x%04X; PK=%lu, DEL=%u\r\n", eeaddr, header_entry.pk, header_entry.deleted);
+		sprintf_P(tmp, PSTR("0x%04X; PK=%lu, DEL=%u\r\n"), eeaddr, header_entry.pk, header_entry.deleted);
 		uart_puts(tmp);
 		
 		_delay_ms(5);
@@ -436,7 +436,7 @@ void eedb_write_i2c(volatile struct eedb_ctx *ctx, uint16_t addr, uint8_t data)
 
 void eedb_write_n_i2c(volatile struct eedb_ctx *ctx, uint16_t addr, uint16_t len, void *data) {
 	/*char tmp[128];
-	sprintf(tmp, "eedb_write_n_i2c(%u, %u, data)\r\n", addr, len);
+	sprintf_P(tmp, PSTR("eedb_write_n_i2c(%u, %u, data)\r\n"), addr, len);
 	uart_puts(tmp);*/
 	
 	// start the write
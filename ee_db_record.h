@@ -29,6 +29,7 @@ struct eedb_hcs_record {
 	uint8_t buttons;
 	uint16_t timing_element;
 	uint16_t header_length;
+	uint8_t quality; // of the frame timing_element and header_length were taken from, 0-100 (see keeloq_ctx.kl_rx_quality)
 };
 
 // this is saved in EEPROM as it stands here
@@ -38,4 +39,10 @@ struct eedb_log_record {
 	uint8_t kl_rx_buff[KL_BUFF_LEN];
 };
 
+// this is saved in EEPROM as it stands here
+// warning: do not re-arrange elements of this struct because it must match that in the EEPROM
+struct eedb_raw_record {
+	struct keeloq_tx_sched sched; // recorded frame, see rawtx.h
+};
+
 #endif /* EE_DB_RECORD_H_ */
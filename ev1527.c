@@ -0,0 +1,138 @@
+/*
+ * ev1527.c
+ *
+ * Created: 19. 10. 2026. 15:41:10
+ *  Author: agent
+ *
+ * No hardware dependencies, caller provides the timestamps of the edges and polls periodically.
+ * The receiver hardware and the timer belong to whoever else is using them (keeloq.c).
+ * Not re-entrant, an edge and a poll must never nest (rx_dispatch takes care of that).
+ *
+ */
+
+#include "ev1527.h"
+
+void ev_rx_start(volatile struct ev1527_ctx *ctx, uint16_t now) {
+	ctx->ev_rx_buff_state = EV_BUFF_EMPTY;
+	ctx->_ev_last_edge = now;
+	ctx->_ev_last_poll = now;
+	ctx->_ev_high = 0;
+	ctx->_ev_low = 0;
+	ctx->_ev_prev_valid = 0;
+	ctx->_ev_reported = 0;
+	ctx->_ev_idle_ticks = EV_BURST_END_TICKS;
+	ctx->ev_rx_state = EV_RX_SYNCING;
+}
+
+void ev_rx_stop(volatile struct ev1527_ctx *ctx) {
+	ctx->ev_rx_state = EV_RX_STOP;
+}
+
+void ev_rx_flush(volatile struct ev1527_ctx *ctx) {
+	ctx->ev_rx_buff_state = EV_BUFF_EMPTY;
+}
+
+// all bits of a frame are in
+static inline void ev_rx_frame(volatile struct ev1527_ctx *ctx) {
+	uint32_t code = ctx->_ev_code;
+
+	ctx->ev_rx_frames++;
+	ctx->_ev_idle_ticks = 0;
+
+	// second identical one in a row, and not reported in this burst yet
+	if(ctx->_ev_prev_valid && ctx->_ev_prev_code == code && !ctx->_ev_reported && ctx->ev_rx_buff_state == EV_BUFF_EMPTY) {
+		ctx->ev_rx_code = code;
+		ctx->ev_rx_unit = ctx->_ev_unit >> 1; // to microseconds, for the outside world
+		ctx->ev_rx_buff_state = EV_BUFF_FULL;
+		ctx->_ev_reported = 1;
+	}
+
+	ctx->_ev_prev_code = code;
+	ctx->_ev_prev_valid = 1;
+}
+
+// HIGH + LOW pair of a bit
+static inline void ev_rx_bit(volatile struct ev1527_ctx *ctx, uint16_t hi, uint16_t w) {
+	uint16_t u = ctx->_ev_unit;
+	uint16_t period = hi + w;
+	uint16_t lng = (hi > w) ? hi : w;
+	uint16_t sht = (hi > w) ? w : hi;
+
+	// a bit is 4 units, one pulse is 1 unit and the other one 3 units. stretch moves the split, not the period
+	if(period < (u * 3) || period > (u * 5) || sht < (u >> 1) || lng < (sht << 1)) {
+		ctx->ev_rx_rej++;
+		ctx->ev_rx_state = EV_RX_SYNCING;
+	}
+	else {
+		ctx->_ev_code = (ctx->_ev_code << 1) | (hi > w);
+		ctx->_ev_bits++;
+		if(ctx->_ev_bits == EV_BITS) {
+			ev_rx_frame(ctx);
+			ctx->ev_rx_state = EV_RX_SYNCING; // next SYNC follows right away if the button is still held
+		}
+	}
+}
+
+// call on every edge, level is the new level of the pin, now is the timer value of the edge
+void ev_rx_process(volatile struct ev1527_ctx *ctx, uint8_t level, uint16_t now) {
+	uint16_t w = now - ctx->_ev_last_edge;
+	ctx->_ev_last_edge = now;
+	ctx->_ev_low = !level;
+
+	if(ctx->ev_rx_state == EV_RX_STOP) {
+		// we are stopped
+	}
+	// HIGH just ended, we need the LOW that follows it as well
+	else if(!level) {
+		ctx->_ev_high = w;
+	}
+	// LOW just ended, so we have a HIGH + LOW pair
+	else {
+		uint16_t hi = ctx->_ev_high;
+
+		// SYNC: 1 unit HIGH, 31 units LOW
+		if(hi >= EV_UNIT_MIN_TICKS && hi <= EV_UNIT_MAX_TICKS && w >= (hi * EV_SYNC_RATIO_MIN) && w <= (hi * EV_SYNC_RATIO_MAX)) {
+			// LOW is far longer, unit from it is more accurate. w/32 + w/1024 = w/31.03
+			ctx->_ev_unit = (w >> 5) + (w >> 10);
+			ctx->_ev_code = 0;
+			ctx->_ev_bits = 0;
+			ctx->ev_rx_state = EV_RX_RXING;
+		}
+		else if(ctx->ev_rx_state == EV_RX_RXING) {
+			ev_rx_bit(ctx, hi, w);
+		}
+	}
+}
+
+// call periodically, at least every (0x10000 - EV_WIDTH_MAX_TICKS) ticks
+void ev_rx_poll(volatile struct ev1527_ctx *ctx, uint16_t now) {
+	if(ctx->ev_rx_state == EV_RX_STOP) {
+		return;
+	}
+
+	// end of burst, next frame starts a new confirmation
+	if(ctx->_ev_idle_ticks < EV_BURST_END_TICKS) {
+		ctx->_ev_idle_ticks += (uint16_t)(now - ctx->_ev_last_poll);
+		if(ctx->_ev_idle_ticks >= EV_BURST_END_TICKS) {
+			ctx->_ev_prev_valid = 0;
+			ctx->_ev_reported = 0;
+		}
+	}
+	ctx->_ev_last_poll = now;
+
+	// LOW of the last bit of the last frame in a burst runs into silence, no rising edge ends it. once it is longer
+	// than the LOW of any bit (3 units), the HIGH before it is enough, the bit is finished as if the LOW was nominal
+	if(ctx->ev_rx_state == EV_RX_RXING && ctx->_ev_low && ctx->_ev_bits == (EV_BITS - 1)) {
+		uint16_t u4 = ctx->_ev_unit << 2;
+		uint16_t hi = ctx->_ev_high;
+		if((uint16_t)(now - ctx->_ev_last_edge) > (ctx->_ev_unit * 3) && hi < u4) {
+			ev_rx_bit(ctx, hi, u4 - hi);
+		}
+	}
+
+	// don't let a long pause wrap around the 16bit timer and look like a valid pulse
+	if((uint16_t)(now - ctx->_ev_last_edge) > EV_WIDTH_MAX_TICKS) {
+		ctx->_ev_last_edge = now - EV_WIDTH_MAX_TICKS;
+		ctx->ev_rx_state = EV_RX_SYNCING;
+	}
+}
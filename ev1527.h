@@ -0,0 +1,71 @@
+/*
+ * ev1527.h
+ *
+ * Created: 19. 10. 2026. 15:40:52
+ *  Author: agent
+ */
+
+#ifndef EV1527_H_
+#define EV1527_H_
+
+#include <stdio.h>
+
+// Fixed-code receiver for EV1527 and PT2262 style encoders (cheap 433MHz remotes, PIR and door sensors).
+// Frame is a SYNC (1 unit HIGH, 31 units LOW) followed by 24 bits, MSb first. Each bit is 4 units:
+// 1 = 3 units HIGH + 1 unit LOW, 0 = 1 unit HIGH + 3 units LOW. EV1527 sends a 20 bit ID and 4 data bits.
+// PT2262 sends 12 tri-state symbols as bit pairs (00 = 0, 11 = 1, 01 = F), which come out the same way here.
+// A code is reported once per burst, after two identical frames in a row.
+//
+// Everything in here is in ticks of the free-running 16bit timer the caller timestamps the edges with
+// (Timer1, F_CPU/8, 0.5us on 16MHz).
+
+#define EV_US2TICKS(us)			((us) * 2)
+#define EV_UNIT_MIN_TICKS		EV_US2TICKS(100)	// shortest unit we accept
+#define EV_UNIT_MAX_TICKS		EV_US2TICKS(700)	// longest unit (SYNC HIGH) we accept. x EV_SYNC_RATIO_MAX must fit in 16 bits
+#define EV_SYNC_RATIO_MIN		15U		// SYNC LOW is 31 x SYNC HIGH, but receivers stretch HIGH quite a bit
+#define EV_SYNC_RATIO_MAX		45U
+#define EV_BITS					24
+#define EV_WIDTH_MAX_TICKS		0xF000	// anything longer is invalid anyway. ev_rx_poll() must be called at least every 0x10000 - this ticks
+#define EV_BURST_END_TICKS		EV_US2TICKS(150000UL)	// this long without a frame ends the burst
+
+enum EV_RX_STATE
+{
+	EV_RX_STOP = 0,
+	EV_RX_SYNCING = 1,
+	EV_RX_RXING = 2,
+};
+
+enum EV_BUFF_STATE
+{
+	EV_BUFF_EMPTY = 0,
+	EV_BUFF_FULL = 1,
+};
+
+struct ev1527_ctx {
+	enum EV_RX_STATE ev_rx_state;
+	enum EV_BUFF_STATE ev_rx_buff_state;
+	uint32_t ev_rx_code; // received code, 24 lower bits used
+	uint16_t ev_rx_unit; // of the received code, in microseconds
+	uint16_t ev_rx_frames; // statistics, frames that passed all checks (also repeats), rolls over
+	uint16_t ev_rx_rej; // statistics, frames broken after the SYNC, rolls over
+
+	uint16_t _ev_last_edge; // internal usage, timer value of the previous edge
+	uint16_t _ev_high; // internal usage, width of the previous HIGH pulse
+	uint8_t _ev_low; // internal usage, pin is LOW after the _ev_high pulse
+	uint16_t _ev_unit; // internal usage, unit of the frame being received, from its SYNC
+	uint32_t _ev_code; // internal usage, frame being received
+	uint8_t _ev_bits; // internal usage, bits received so far
+	uint32_t _ev_prev_code; // internal usage, previous frame of this burst
+	uint8_t _ev_prev_valid; // internal usage, _ev_prev_code is valid
+	uint8_t _ev_reported; // internal usage, this burst was reported already
+	uint16_t _ev_last_poll; // internal usage, timer value of the previous poll
+	uint32_t _ev_idle_ticks; // internal usage, since the last frame
+};
+
+void ev_rx_start(volatile struct ev1527_ctx *, uint16_t);
+void ev_rx_stop(volatile struct ev1527_ctx *);
+void ev_rx_flush(volatile struct ev1527_ctx *);
+void ev_rx_process(volatile struct ev1527_ctx *, uint8_t, uint16_t);
+void ev_rx_poll(volatile struct ev1527_ctx *, uint16_t);
+
+#endif /* EV1527_H_ */
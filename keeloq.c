@@ -6,10 +6,9 @@
  * 
  * Hardware dependencies:
  * - pin change interrupt
- * - 16bit Timer1 for pulse length measurement for receiver
- * - PWM mode 14 for transmitter
- * - OCR1A output for transmitter
- * - util/delay.h of AVR or whatever else can create 10us delays
+ * - 16bit Timer1 free-running as the timebase for pulse length measurement, shared by all receivers
+ * - OCR1B compare match for polling the receiver timeouts
+ * - OCR1A compare match toggling the OC1A pin for transmitter, on the same free-running Timer1
  * - avr/io.h because of Timer1 registers
  * 
  * Hardly portable to other platforms.
@@ -18,13 +17,6 @@
 
 #include "keeloq.h"
 
-// built-in delay wrapper
-void delay_10us_(uint16_t delay_us) {
-	while(delay_us--) {
-		_delay_us(10);
-	}
-}
-
 void kl_init_ctx(volatile struct keeloq_ctx *ctx) {
 	ctx->kl_tx_state = KL_TX_IDLE;
 	ctx->kl_rx_state = KL_RX_STOP;
@@ -32,124 +24,357 @@ void kl_init_ctx(volatile struct keeloq_ctx *ctx) {
 	ctx->kl_rx_process_busy = 0;
 	ctx->kl_rx_pulse_timeout_busy = 0;
 	ctx->kl_tx_process_busy = 0;
+	ctx->kl_tx_isr_ticks_max = 0;
+	ctx->_kl_tx_sched_next = 0;
+	ctx->_kl_tx_repeat_left = 0;
+	if(ctx->kl_tx_queue) {
+		ctx->kl_tx_queue->cnt = 0;
+	}
+
+	kl_rx_stats_clear(ctx);
 }
 
-// keeloq transmit preamble
-void kl_tx_preamble(volatile struct keeloq_ctx *ctx, uint16_t timing_element_us, uint8_t preamble_size) {
-	// preamble is preamble_size * (50% PWM of 2*timing_element_us)
-	
-	// it is easy to do this one here manually
-	while(preamble_size-- > 0) {
-		delay_10us_(timing_element_us/10);
-		ctx->fn_tx_pin_hw(1);
-		delay_10us_(timing_element_us/10);
-		ctx->fn_tx_pin_hw(0);
+// how many receivers and transmitters are using the shared Timer1 timebase
+static volatile uint8_t kl_timer_users = 0;
+
+// Timer1 is free-running, started by the first user and stopped by the last one
+// WARNING: this is where hardware abstraction is not possible
+static void kl_timer_acquire() {
+	uint8_t sreg = SREG;
+	cli();
+	if(!kl_timer_users) {
+		TCCR1A = 0;
+		TCCR1B = _BV(CS11); // Timer1 running in F_CPU/8. for 16MHz that is 0.5us (500ns) per each value. MODE OF OPERATION = normal, free-running
+	}
+	kl_timer_users++;
+	SREG = sreg;
+}
+
+static void kl_timer_release() {
+	uint8_t sreg = SREG;
+	cli();
+	kl_timer_users--;
+	if(!kl_timer_users) {
+		TCCR1B = 0; // stop the Timer1
 	}
+	SREG = sreg;
 }
 
-// called every time PWM output has changed from 1 -> 0 in order to advance to the next bit until we detect that we clocked out all bits required
+// turn a frame into the list of intervals between the output pin toggles, so the ISR has nothing to compute.
+// waveform is: preamble_size * (TE low, TE high), header low, bitlen * (1 = TE high + 2TE low, 0 = 2TE high + TE low), guard low.
+// LOW of the last bit and the guard time are one interval, at the end of which the pin does not toggle any more.
+// all times are in microseconds, and each interval (header, last bit + guard) must fit KL_TX_INTERVAL_MAX_US. returns 0 if it doesn't fit
+uint8_t kl_tx_sched_build(struct keeloq_tx_sched *sched, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us, uint8_t preamble_size, uint16_t header_length_us, uint16_t guard_time_us) {
+	if(!bitlen || bitlen > (KL_BUFF_LEN * 8) || preamble_size > KL_TX_PREAMBLE_MAX) {
+		return 0;
+	}
+	// 2TE + guard is the longest of the bit intervals, and the sums would wrap in 16 bits
+	if(!timing_element_us || header_length_us > KL_TX_INTERVAL_MAX_US || ((uint32_t)timing_element_us << 1) + guard_time_us > KL_TX_INTERVAL_MAX_US) {
+		return 0;
+	}
+
+	uint16_t te = KL_US2TICKS(timing_element_us);
+	sched->dur[KL_TX_DUR_TE] = te;
+	sched->dur[KL_TX_DUR_2TE] = te << 1;
+	sched->dur[KL_TX_DUR_HEADER] = KL_US2TICKS(header_length_us);
+	sched->dur[KL_TX_DUR_TE_GUARD] = te + KL_US2TICKS(guard_time_us);
+	sched->dur[KL_TX_DUR_2TE_GUARD] = (te << 1) + KL_US2TICKS(guard_time_us);
+	sched->timing_element = timing_element_us;
+	sched->bitlen = bitlen;
+
+	uint8_t *code = sched->code;
+	for(uint8_t i = 0; i < (preamble_size << 1); i++) {
+		*code++ = KL_TX_DUR_TE;
+	}
+	*code++ = KL_TX_DUR_HEADER;
+
+	// the transmission works LSb first
+	uint8_t byteval = 0;
+	for(uint8_t i = 0; i < bitlen; i++) {
+		if(!(i & 7)) {
+			byteval = buff[i >> 3];
+		}
+		// 1 = 1xTE HIGH, 0 = 2xTE HIGH
+		if(byteval & 0x01) {
+			*code++ = KL_TX_DUR_TE;
+			*code++ = KL_TX_DUR_2TE;
+		}
+		else {
+			*code++ = KL_TX_DUR_2TE;
+			*code++ = KL_TX_DUR_TE;
+		}
+		byteval >>= 1;
+	}
+	code[-1] = (code[-1] == KL_TX_DUR_TE) ? KL_TX_DUR_TE_GUARD : KL_TX_DUR_2TE_GUARD;
+
+	sched->len = code - sched->code;
+
+	return 1;
+}
+
+// length of the interval i of the schedule, in Timer1 ticks
+uint16_t kl_tx_sched_ticks(struct keeloq_tx_sched *sched, uint8_t i) {
+	uint8_t code = sched->code[i];
+	return (code < KL_TX_DUR_CNT) ? sched->dur[code] : ((uint16_t)code << KL_TX_RAW_SHIFT);
+}
+
+// pick what goes on the air after the current frame: the same schedule again while there are repeats left, else the next
+// job from the queue, built into kl_tx_sched_buff. only the jobs (frame data) are double-buffered, the schedule is not:
+// the next one is built into the same buffer in the guard time of the current frame, which does not read it any more.
+// _kl_tx_sched_next is 0 if there is nothing to send. returns 1 if it had to build the schedule, which takes a while
+static uint8_t kl_tx_next(volatile struct keeloq_ctx *ctx) {
+	if(ctx->_kl_tx_repeat_left) {
+		if(ctx->_kl_tx_repeat_left != KL_TX_COUNT_FOREVER) {
+			ctx->_kl_tx_repeat_left--;
+		}
+		ctx->_kl_tx_sched_next = ctx->kl_tx_sched;
+		return 0;
+	}
+
+	ctx->_kl_tx_sched_next = 0;
+
+	struct keeloq_tx_queue *queue = ctx->kl_tx_queue;
+	if(!queue || !ctx->kl_tx_sched_buff) {
+		return 0;
+	}
+
+	while(queue->cnt) {
+		struct keeloq_tx_job *job = &queue->jobs[queue->head];
+		queue->head = (queue->head + 1) % KL_TX_QUEUE_LEN;
+		queue->cnt--;
+
+		if(kl_tx_sched_build(ctx->kl_tx_sched_buff, job->buff, job->bitlen, job->timing_element, job->preamble_size, job->header_length, job->guard_time)) {
+			ctx->_kl_tx_repeat_left = (job->count == KL_TX_COUNT_FOREVER) ? KL_TX_COUNT_FOREVER : (job->count - 1);
+			ctx->_kl_tx_sched_next = ctx->kl_tx_sched_buff;
+			return 1;
+		}
+		// broken job, skip it
+	}
+
+	return 0;
+}
+
+// first interval of a frame starts at Timer1 value "at", the rest is up to kl_tx_process()
+// WARNING: this is where hardware abstraction is not possible
+static void kl_tx_frame_begin(volatile struct keeloq_ctx *ctx, struct keeloq_tx_sched *sched, uint16_t at) {
+	ctx->kl_tx_sched = sched;
+	ctx->_kl_tx_sched_len = sched->len;
+	ctx->_kl_tx_sched_index = 1; // first one is scheduled right here
+	ctx->kl_tx_bitlen = sched->bitlen;
+	ctx->kl_tx_timing_element = sched->timing_element;
+
+	uint8_t sreg = SREG;
+	cli();
+	// force OC1A low (clear on match + forced match), then let every compare match toggle it
+	TCCR1A = (TCCR1A & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A1);
+	TCCR1C = _BV(FOC1A);
+	TCCR1A = (TCCR1A & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A0);
+	OCR1A = at + kl_tx_sched_ticks(sched, 0);
+	SREG = sreg;
+}
+
+// called on every OCR1A compare match, which has just toggled the output pin. we schedule the next one from the precomputed
+// list, so this takes the same (short) time for every edge
 void kl_tx_process(volatile struct keeloq_ctx *ctx) {
-	//if(ctx->kl_tx_state != KL_TX_BUSY) return; // prevent working while in invalid state
+	if(ctx->kl_tx_state != KL_TX_BUSY) return; // prevent working while in invalid state
 
 	if(ctx->kl_tx_process_busy) return;
 	ctx->kl_tx_process_busy = 1;
 
-	// the transmission works LSb first
-	uint8_t arr_index = ctx->kl_tx_buff_bit_index / 8;
-	uint8_t arr_bit_index = ctx->kl_tx_buff_bit_index % 8;
+	// WARNING: this is where hardware abstraction is not possible
+	uint16_t isr_start = TCNT1;
 
-	uint8_t buff_byteval = ctx->kl_tx_buff[arr_index];
-	if(arr_bit_index > 0) {
-		buff_byteval = (buff_byteval >> arr_bit_index);
-	}
+	struct keeloq_tx_sched *sched = ctx->kl_tx_sched;
+	uint8_t i = ctx->_kl_tx_sched_index;
+	uint8_t len = ctx->_kl_tx_sched_len; // not sched->len, the next queued job is built into the same buffer during the guard time
+	uint8_t guard_started = 0;
 
-	// 1 = 1xTE
-	if(buff_byteval & 0b00000001) {
+	if(i < len) {
+		uint8_t code = sched->code[i];
 		// WARNING: this is where hardware abstraction is not possible
-		OCR1A = 1 * (ctx->kl_tx_timing_element * 2); // 1xTE but converted to 0.5us
+		OCR1A += (code < KL_TX_DUR_CNT) ? sched->dur[code] : ((uint16_t)code << KL_TX_RAW_SHIFT);
+		i++;
+		ctx->_kl_tx_sched_index = i;
+
+		// last bit + guard time has just started, pin must not toggle at the end of it
+		if(i == len) {
+			TCCR1A &= ~(_BV(COM1A1) | _BV(COM1A0)); // pin goes back to the port, which is low
+			guard_started = 1;
+		}
 	}
-	// 0 = 2xTE
+	// guard time is over, next frame follows right away if there is one
 	else {
-		// WARNING: this is where hardware abstraction is not possible
-		OCR1A = 2 * (ctx->kl_tx_timing_element * 2); // 2xTE but converted to 0.5us
-	}
+		uint16_t at = OCR1A; // back to back
+		// job was cancelled or replaced during the guard time, have a look again
+		if(!ctx->_kl_tx_sched_next && kl_tx_next(ctx)) {
+			at = TCNT1; // building took a while
+		}
 
-	/*char xxx[32];
-	sprintf(xxx, "%u ", OCR1A);
-	uart_puts(xxx);*/
+		if(ctx->_kl_tx_sched_next) {
+			kl_tx_frame_begin(ctx, ctx->_kl_tx_sched_next, at);
+			ctx->_kl_tx_sched_next = 0;
+		}
+		// so is the transmission
+		else {
+			// WARNING: this is where hardware abstraction is not possible
+			TIMSK1 &= ~_BV(OCIE1A);
+			kl_timer_release();
+			ctx->fn_tx_deinit_hw();
+			ctx->kl_tx_state = KL_TX_IDLE;
+			ctx->kl_tx_process_busy = 0;
+			if(ctx->fn_tx_done) {
+				ctx->fn_tx_done(ctx);
+			}
+			return;
+		}
+	}
 
-	// time to end the transmission process
-	if(ctx->kl_tx_buff_bit_index >= ctx->kl_tx_bitlen) {
-		// WARNING: this is where hardware abstraction is not possible
-		TCCR1A = 0; // stop!
-		TCCR1B = 0; // stop!
-		TIMSK1 &= ~_BV(OCIE1A);
-		ctx->kl_tx_state = KL_TX_IDLE;
-		//uart_puts("\r\n");
+	// how long we were in here
+	// WARNING: this is where hardware abstraction is not possible
+	uint16_t isr_ticks = TCNT1 - isr_start;
+	if(isr_ticks > ctx->kl_tx_isr_ticks_max) {
+		ctx->kl_tx_isr_ticks_max = isr_ticks;
 	}
 
-	ctx->kl_tx_buff_bit_index++;
-	
 	ctx->kl_tx_process_busy = 0;
+
+	// prepare the next frame now, the schedule is not read any more and the compare match that ends the guard time is milliseconds away
+	if(guard_started) {
+		kl_tx_next(ctx);
+	}
 }
 
-// keeloq transmit data
-void kl_tx_data(volatile struct keeloq_ctx *ctx, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us) {
-	// data is bitlen * (33% (bit1) or 66% (bit0) PWM of 3*timing_element_us)
+// first frame of a transmission, we are idle
+static void kl_tx_begin(volatile struct keeloq_ctx *ctx, struct keeloq_tx_sched *sched) {
+	ctx->_kl_tx_sched_next = 0;
 
+	ctx->fn_tx_init_hw();
 	ctx->fn_tx_pin_hw(0);
 
-	ctx->kl_tx_state = KL_TX_BUSY;
-	ctx->kl_tx_buff_bit_index = 0;
-	ctx->kl_tx_bitlen = bitlen;
-	ctx->kl_tx_buff = buff; // point to the buffer holding the data
-	ctx->kl_tx_timing_element = timing_element_us;
+	kl_timer_acquire();
 
 	// WARNING: this is where hardware abstraction is not possible
-	// PWM frequency is 3xTE
-	ICR1 = 3 * (timing_element_us * 2) ; // PWM frequency is 3xTE. *2 because timer runs in 0.5us steps so we need to double the value
-	// Using: Timer1 in Fast PWM (mode 14)
-	TCNT1 = 0;
-	TCCR1A = _BV(COM1A1) | _BV(WGM11);
-	TCCR1B = _BV(WGM13) | _BV(WGM12); // timer not running! important
-	TIMSK1 |= _BV(OCIE1A); // OCIE1A is for ISR(TIMER1_COMPA_vect) -> output bit has went from 1 to 0, wanted duty cycle reached
-	// start the process of transmission which advances to each new bit in the ISR of PWM process
-	OCR1A = 0;
-	TCNT1 = ICR1 - 1; // force ISR to trigger after timer's next tick
-	TCCR1B |= _BV(CS11); // Timer1 running in F_CPU/8. for 16MHz that is 0.5us (500ns) per each value
+	uint8_t sreg = SREG;
+	cli();
+	kl_tx_frame_begin(ctx, sched, TCNT1);
+	TIFR1 = _BV(OCF1A); // clear anything pending
+	ctx->kl_tx_state = KL_TX_BUSY;
+	TIMSK1 |= _BV(OCIE1A); // OCIE1A is for ISR(TIMER1_COMPA_vect), which should call kl_tx_process()
+	SREG = sreg;
+}
+
+// keeloq transmit, non-blocking. entire waveform comes from the OCR1A compare match of the shared Timer1, which toggles
+// the OC1A pin by itself so edges are exact no matter how late the ISR gets served. returns 0 if still busy with the previous one.
+// schedule is sent count times (KL_TX_COUNT_FOREVER until cancelled) and must stay untouched until kl_tx_state is KL_TX_IDLE again
+// (or fn_tx_done is called)
+uint8_t kl_tx_start_sched(volatile struct keeloq_ctx *ctx, struct keeloq_tx_sched *sched, uint8_t count) {
+	if(ctx->kl_tx_state != KL_TX_IDLE || !sched->len || !count) {
+		return 0;
+	}
+
+	ctx->_kl_tx_repeat_left = (count == KL_TX_COUNT_FOREVER) ? KL_TX_COUNT_FOREVER : (count - 1);
+	kl_tx_begin(ctx, sched);
+
+	return 1;
 }
 
-// keeloq transmit
+// same as above, but builds the schedule into kl_tx_sched_buff first. buff is free to reuse as soon as this returns
+uint8_t kl_tx_start(volatile struct keeloq_ctx *ctx, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us, uint8_t preamble_size, uint16_t header_length_us, uint16_t guard_time_us) {
+	if(ctx->kl_tx_state != KL_TX_IDLE || !ctx->kl_tx_sched_buff) {
+		return 0;
+	}
+
+	if(!kl_tx_sched_build(ctx->kl_tx_sched_buff, buff, bitlen, timing_element_us, preamble_size, header_length_us, guard_time_us)) {
+		return 0;
+	}
+
+	return kl_tx_start_sched(ctx, ctx->kl_tx_sched_buff, 1);
+}
+
+// queue a frame to be sent count times (KL_TX_COUNT_FOREVER until cancelled or replaced), after whatever is queued already.
+// frames go back to back, each one followed by its guard time, with no help from the main loop. buff is copied.
+// returns 0 if the queue is full
+uint8_t kl_tx_enqueue(volatile struct keeloq_ctx *ctx, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us, uint8_t preamble_size, uint16_t header_length_us, uint16_t guard_time_us, uint8_t count) {
+	struct keeloq_tx_queue *queue = ctx->kl_tx_queue;
+	if(!queue || !count || !bitlen || bitlen > (KL_BUFF_LEN * 8)) {
+		return 0;
+	}
+
+	uint8_t sreg = SREG;
+	cli();
+	if(queue->cnt >= KL_TX_QUEUE_LEN) {
+		SREG = sreg;
+		return 0;
+	}
+
+	struct keeloq_tx_job *job = &queue->jobs[(queue->head + queue->cnt) % KL_TX_QUEUE_LEN];
+	memcpy(job->buff, buff, (bitlen + 7) >> 3);
+	job->bitlen = bitlen;
+	job->preamble_size = preamble_size;
+	job->count = count;
+	job->timing_element = timing_element_us;
+	job->header_length = header_length_us;
+	job->guard_time = guard_time_us;
+	queue->cnt++;
+
+	uint8_t idle = (ctx->kl_tx_state == KL_TX_IDLE);
+	SREG = sreg;
+
+	// nothing on the air, ISR won't touch the queue until we start it
+	if(idle) {
+		kl_tx_next(ctx);
+		if(ctx->_kl_tx_sched_next) {
+			kl_tx_begin(ctx, ctx->_kl_tx_sched_next);
+		}
+	}
+
+	return 1;
+}
+
+// drop the queued jobs and the repeats of the current one. frame that is on the air finishes normally
+void kl_tx_cancel(volatile struct keeloq_ctx *ctx) {
+	uint8_t sreg = SREG;
+	cli();
+	if(ctx->kl_tx_queue) {
+		ctx->kl_tx_queue->cnt = 0;
+	}
+	ctx->_kl_tx_repeat_left = 0;
+	ctx->_kl_tx_sched_next = 0;
+	SREG = sreg;
+}
+
+// cancel everything and queue this one instead, it starts right after the frame that is on the air (e.g. when buttons change).
+// it is built in the guard time of that frame, so it follows with no gap, unless the guard time has already started
+uint8_t kl_tx_replace(volatile struct keeloq_ctx *ctx, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us, uint8_t preamble_size, uint16_t header_length_us, uint16_t guard_time_us, uint8_t count) {
+	kl_tx_cancel(ctx);
+	return kl_tx_enqueue(ctx, buff, bitlen, timing_element_us, preamble_size, header_length_us, guard_time_us, count);
+}
+
+// keeloq transmit, blocking. waits for the whole frame including the guard time
 void kl_tx(volatile struct keeloq_ctx *ctx, uint8_t *buff, uint8_t bitlen, uint16_t timing_element_us, uint8_t preamble_size, uint16_t header_length_us, uint16_t guard_time_us) {
-	ctx->fn_tx_init_hw();
-	ctx->fn_tx_pin_hw(0);
-	
-	// transmit preamble
-	kl_tx_preamble(ctx, timing_element_us, preamble_size);
-	
-	// pause for the header section
-	delay_10us_(header_length_us/10);
-	
-	// transmit data
-	kl_tx_data(ctx, buff, bitlen, timing_element_us);
+	// wait for the previous one to finish
+	while(ctx->kl_tx_state != KL_TX_IDLE) {
+	}
+
+	if(!kl_tx_start(ctx, buff, bitlen, timing_element_us, preamble_size, header_length_us, guard_time_us)) {
+		return;
+	}
 
-	// wait until the PWM has been sent out
+	// wait until the whole waveform has been sent out
 	while(ctx->kl_tx_state != KL_TX_IDLE) {
-		//delay_10us_(1);
 	}
-	
-	ctx->fn_tx_deinit_hw();
-	
-	// pause for the guard time
-	delay_10us_(guard_time_us/10);
 }
 
 void kl_rx_pulse_timeout(volatile struct keeloq_ctx *ctx) {
-	if(ctx->kl_rx_pulse_timeout_busy) return;
+	if(ctx->kl_rx_pulse_timeout_busy) {
+		ctx->kl_rx_stats.rej_nested++;
+		return;
+	}
 	ctx->kl_rx_pulse_timeout_busy = 1; // avoid nesting in here
 	
 	// pulse too long during reception of header
 	if(ctx->kl_rx_state == KL_RX_HEADERCHECK) {
+		ctx->kl_rx_stats.headers_bad++;
 		ctx->kl_rx_state = KL_RX_SYNCING;
 	}
 	// pulse too long during reception of data stream
@@ -163,32 +388,76 @@ void kl_rx_pulse_timeout(volatile struct keeloq_ctx *ctx) {
 			||
 			ctx->_kl_rx_buff_bit_index == 66
 		) {
+			if(ctx->_kl_rx_buff_bit_index == 66) ctx->kl_rx_stats.frames_66++;
+			else if(ctx->_kl_rx_buff_bit_index == 67) ctx->kl_rx_stats.frames_67++;
+			else ctx->kl_rx_stats.frames_69++;
+
 			// buffer empty? fill it in
 			if(ctx->kl_rx_buff_state == KL_BUFF_EMPTY) {
 				ctx->kl_rx_buff_state = KL_BUFF_FULL; // we are still not sure if transmitter stopped transmitting
 				ctx->kl_rx_buff_bit_index = ctx->_kl_rx_buff_bit_index;
 				memcpy((uint8_t *)ctx->kl_rx_buff, (uint8_t *)ctx->_kl_rx_buff, KL_BUFF_LEN);
+
+				ctx->kl_rx_header_length = ctx->_kl_rx_header_length;
+				ctx->kl_rx_timing_element = ctx->_kl_rx_timing_element;
+
+				// quality is the average bit deviation against half of TE (the decision point), once per frame so division is OK here
+				uint32_t limit = (uint32_t)ctx->_kl_rx_buff_bit_index * ((ctx->kl_rx_t1_max - ctx->kl_rx_t1_min) >> 1);
+				if(limit && ctx->_kl_rx_jitter_sum < limit) {
+					ctx->kl_rx_quality = 100 - (uint8_t)((ctx->_kl_rx_jitter_sum * 100) / limit);
+				}
+				else {
+					ctx->kl_rx_quality = 0;
+				}
+			}
+			else {
+				ctx->kl_rx_stats.rej_buff_busy++;
 			}
 			
 			// something is arriving
 			ctx->kl_rx_rf_act = KL_RF_ACT_BUSY;
 
+			// learn how long this transmitter pauses between the frames of a burst, from its first two frames.
+			// there is no point in waiting for the whole KL_GUARD_TIMER_CNT if we know when the next frame is due.
+			if(ctx->_kl_rx_burst_frames == 0) {
+				ctx->kl_rx_guard_reload = KL_GUARD_TIMER_CNT;
+			}
+			else if(ctx->_kl_rx_burst_frames == 1) {
+				uint8_t reload = (ctx->_kl_rx_gap_cnt * KL_GUARD_GAP_MULT) + KL_GUARD_GAP_MARGIN;
+				if(reload < KL_GUARD_TIMER_CNT) {
+					ctx->kl_rx_guard_reload = reload;
+				}
+			}
+			if(ctx->_kl_rx_burst_frames < 0xFF) {
+				ctx->_kl_rx_burst_frames++;
+			}
+			ctx->_kl_rx_gap_cnt = 0;
+
 			// state machine will restart
 			ctx->kl_rx_state = KL_RX_SYNCING;
 
 			// if we miss "this many headers", we will call it end of transmission
-			ctx->kl_rx_guard_timer = KL_GUARD_TIMER_CNT; // how many of these timeouts do we allow before pronouncing actual end of transmission
+			ctx->kl_rx_guard_timer = ctx->kl_rx_guard_reload; // how many of these timeouts do we allow before pronouncing actual end of transmission
 		}
 		else {
+			ctx->kl_rx_stats.rej_bit_count++;
 			ctx->kl_rx_state = KL_RX_SYNCING;
 		}
+
+		// guard timer counts in KL_HEADER_MAX_WIDTH_US steps, not in the data timeout steps
+		ctx->_kl_rx_timeout = KL_US2TICKS(KL_HEADER_MAX_WIDTH_US);
 	}
 	// for expecting end of transmission
 	else if(ctx->kl_rx_state == KL_RX_SYNCING) {
 		if(ctx->kl_rx_guard_timer) {
+			if(ctx->_kl_rx_gap_cnt < 0xFF) {
+				ctx->_kl_rx_gap_cnt++; // measuring the pause between frames
+			}
+
 			ctx->kl_rx_guard_timer--;
 			if(!ctx->kl_rx_guard_timer) {
 				ctx->kl_rx_rf_act = KL_RF_ACT_IDLE;
+				ctx->_kl_rx_burst_frames = 0; // next burst learns its own pause
 			}
 		}
 	}
@@ -196,66 +465,174 @@ void kl_rx_pulse_timeout(volatile struct keeloq_ctx *ctx) {
 	ctx->kl_rx_pulse_timeout_busy = 0;
 }
 
+// how many receivers are polled from OCR1B of the shared Timer1 timebase
+static volatile uint8_t kl_rx_running_cnt = 0;
+
 // keeloq initializing timer and pin-change ISR
+// Timer1 is free-running and shared by all receiver contexts and the transmitter
 void kl_rx_start(volatile struct keeloq_ctx *ctx) {
 	ctx->kl_rx_process_busy = 0;
 	ctx->kl_rx_buff_state = KL_BUFF_EMPTY;
-	ctx->kl_rx_state = KL_RX_SYNCING;
 	ctx->kl_rx_rf_act = KL_RF_ACT_IDLE;
+	ctx->_kl_rx_pre_hi_cnt = 0;
+	ctx->_kl_rx_pre_lo_cnt = 0;
+	ctx->kl_rx_guard_timer = 0;
+	ctx->_kl_rx_burst_frames = 0;
+	ctx->_kl_rx_timeout = KL_US2TICKS(KL_HEADER_MAX_WIDTH_US);
+
+	if(ctx->kl_rx_state == KL_RX_STOP) {
+		kl_timer_acquire();
+		// WARNING: this is where hardware abstraction is not possible
+		if(!kl_rx_running_cnt) {
+			// OCR1B of the free-running timebase is for polling the timeouts
+			OCR1B = TCNT1 + KL_RX_POLL_TICKS;
+			TIFR1 = _BV(OCF1B); // clear anything pending
+			TIMSK1 |= _BV(OCIE1B); // OCIE1B is for ISR(TIMER1_COMPB_vect), which should call kl_rx_poll() for every receiver
+		}
+		kl_rx_running_cnt++;
+	}
 
-	// WARNING: this is where hardware abstraction is not possible
-	// initialize Timer1 overflow ISR for pulse width measurement
-	ICR1 = 0xFFFFU;
-	TCCR1A = _BV(WGM11);
-	TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11); // Timer1 running in F_CPU/8. for 16MHz that is 0.5us (500ns) per each value. MODE OF OPERATION = CTC mode 14, counting to ICR1!
-	TIMSK1 |= _BV(ICIE1); // ICIE1 is for ISR(TIMER1_CAPT_vect) ... TOIE1 is for ISR(TIMER1_OVF_vect)
+	ctx->_kl_rx_last_edge = TCNT1;
+	ctx->kl_rx_state = KL_RX_SYNCING;
 
 	ctx->fn_rx_init_hw();
 }
 
 // keeloq stopping timer and pin-change ISR
 void kl_rx_stop(volatile struct keeloq_ctx *ctx) {
-	// WARNING: this is where hardware abstraction is not possible
-	TIMSK1 &= ~_BV(ICIE1);
-	TCCR1B = 0; // stop the Timer1
-
 	ctx->fn_rx_deinit_hw();
 
-	ctx->kl_rx_state = KL_RX_STOP;
+	if(ctx->kl_rx_state != KL_RX_STOP) {
+		ctx->kl_rx_state = KL_RX_STOP;
+
+		kl_rx_running_cnt--;
+		// WARNING: this is where hardware abstraction is not possible
+		if(!kl_rx_running_cnt) {
+			TIMSK1 &= ~_BV(OCIE1B);
+		}
+		kl_timer_release();
+	}
+
 	ctx->kl_rx_rf_act = KL_RF_ACT_IDLE;
 }
 
+// timeout has expired at "now". an edge that came after "now" was taken (the ISRs nest) is not a wrap-around,
+// it is newer by far less than KL_RX_POLL_TICKS
+static inline uint8_t kl_rx_timeout_expired(volatile struct keeloq_ctx *ctx, uint16_t now) {
+	uint16_t w = now - ctx->_kl_rx_last_edge;
+	return w >= ctx->_kl_rx_timeout && w <= (uint16_t)(0xFFFF - KL_RX_POLL_TICKS);
+}
+
+// fire kl_rx_pulse_timeout() for every timeout that expired until "now". caller holds kl_rx_process_busy
+static void kl_rx_poll_timeouts(volatile struct keeloq_ctx *ctx, uint16_t now) {
+	// timeout is periodic, just like it would be if the timer was counting up to it and wrapping around
+	while(kl_rx_timeout_expired(ctx, now)) {
+		ctx->_kl_rx_last_edge += ctx->_kl_rx_timeout;
+		kl_rx_pulse_timeout(ctx);
+	}
+}
+
+// called periodically (every KL_RX_POLL_TICKS or so) with the current Timer1 value, for every receiver.
+// each receiver has its own timeout running on the shared timebase, we fire kl_rx_pulse_timeout() when it expires
+// WARNING: this is where hardware abstraction is not possible
+void kl_rx_poll(volatile struct keeloq_ctx *ctx, uint16_t now) {
+	if(ctx->kl_rx_state == KL_RX_STOP) return;
+
+	// edges nest in here (ISR_NOBLOCK), so kl_rx_process() is locked out while timeouts are fired. that is only when one
+	// has expired, there is no edge due then. check and lock with interrupts off, an edge could come in between
+	uint8_t sreg = SREG;
+	cli();
+	if(ctx->kl_rx_process_busy || !kl_rx_timeout_expired(ctx, now)) { // edge is being processed right now, it will catch up on its own
+		SREG = sreg;
+		return;
+	}
+	ctx->kl_rx_process_busy = 1;
+	SREG = sreg;
+
+	kl_rx_poll_timeouts(ctx, now);
+
+	ctx->kl_rx_process_busy = 0;
+}
+
+// statistics are kept across kl_rx_start()/kl_rx_stop(), clear them only on request
+void kl_rx_stats_clear(volatile struct keeloq_ctx *ctx) {
+	memset((uint8_t *)&ctx->kl_rx_stats, 0, sizeof(struct keeloq_rx_stats));
+}
+
 // called after consuming the buffer
 void kl_rx_flush(volatile struct keeloq_ctx *ctx) {
 	//ctx->kl_rx_rf_act = KL_RF_ACT_IDLE;
 	ctx->kl_rx_buff_state = KL_BUFF_EMPTY;
 }
 
+// preamble is a train of 50% duty cycle pulses of exactly 1 x TE each, which is a much better TE reference than the header.
+// we keep a running average of HIGH and LOW pulses separately, because cheap RF receivers stretch HIGH and shrink LOW
+// pulses by the same amount. this way we get both the real TE, and the stretch that the data bits will also suffer from.
+// everything in here is in Timer1 ticks (0.5us)
+static inline void kl_rx_preamble_track(volatile struct keeloq_ctx *ctx, uint16_t w, uint8_t was_high) {
+	volatile uint16_t *sum = was_high ? &ctx->_kl_rx_pre_hi_sum : &ctx->_kl_rx_pre_lo_sum;
+	volatile uint8_t *cnt = was_high ? &ctx->_kl_rx_pre_hi_cnt : &ctx->_kl_rx_pre_lo_cnt;
+
+	// can't be a preamble pulse, start over
+	if(w < KL_US2TICKS(KL_TE_WIDTH_MIN_US) || w > KL_US2TICKS(KL_TE_WIDTH_MAX_US)) {
+		ctx->_kl_rx_pre_hi_cnt = 0;
+		ctx->_kl_rx_pre_lo_cnt = 0;
+		return;
+	}
+
+	uint16_t avg = *sum >> KL_PREAMBLE_AVG_SHIFT;
+
+	// first pulse, or one that is more than 50% off the average so far? start averaging from this one
+	if(!*cnt || w < avg - (avg >> 1) || w > avg + (avg >> 1)) {
+		*sum = w << KL_PREAMBLE_AVG_SHIFT;
+		*cnt = 1;
+		return;
+	}
+
+	*sum = *sum - avg + w;
+	if(*cnt < 0xFF) {
+		(*cnt)++;
+	}
+}
+
 // keeloq receiving process, one bit at a time, PWM only, Manchester not implemented.
 // this function must exit before next pin-change occurs, which is in some situations < 200us
 // WARNING: this is where hardware abstraction is not possible
-void kl_rx_process(volatile struct keeloq_ctx *ctx, uint8_t bit_val) {
-	// measuring bit length is done by manipulating TIMER1
-	// starting it, reseting it, reading it
+void kl_rx_process(volatile struct keeloq_ctx *ctx, uint8_t bit_val, uint16_t now) {
+	// measuring bit length is done by comparing "now" to the time of the previous edge. both come from the
+	// free-running TIMER1 that is shared by all receivers, so we never touch it in here.
 	// it is setup so that it runs @ F_CPU/8 which for 16MHz is 0,5us (500ns)
-	// so to get the microsecond value, shift to the left once (*2)
+	// we work with these raw ticks all the way, no conversion to microseconds in here. all thresholds are
+	// prepared in ticks once, when the header is accepted, so each data bit costs only a few compares.
 	
 	if(ctx->kl_rx_state == KL_RX_STOP) return; // in case interrupt is still enabled but kl_rx_stop() was not called
 	
-	if(ctx->kl_rx_process_busy) return; // avoid nesting in here
+	// avoid nesting in here, kl_rx_poll() can be firing the timeouts as well
+	uint8_t sreg = SREG;
+	cli();
+	if(ctx->kl_rx_process_busy) {
+		SREG = sreg;
+		ctx->kl_rx_stats.rej_nested++;
+		return;
+	}
 	ctx->kl_rx_process_busy = 1;
+	SREG = sreg;
+
+	kl_rx_poll_timeouts(ctx, now); // timeout might have expired but the poller didn't get to it yet, keep the order of events right
 	
-	uint16_t w1us = TCNT1; // read the measurement which is currently in 0.5us values
-	TCNT1 = 0; // reset timer to start the measurement again
-	w1us = w1us / 2; // /2 to convert to 1us values from 0.5us
+	uint16_t w = now - ctx->_kl_rx_last_edge; // the measurement in 0.5us ticks
+	ctx->_kl_rx_last_edge = now; // start the measurement again
+
+	ctx->kl_rx_stats.edges++;
 	
 	switch(ctx->kl_rx_state) {
 		// when last preamble bit finishes, from 1->0, we are starting measurement of the possible header length
 		case KL_RX_SYNCING:
+			kl_rx_preamble_track(ctx, w, !bit_val); // this might be a preamble pulse that just passed
+
 			if(!bit_val) {
-				ICR1 = KL_HEADER_MAX_WIDTH_US * 2; // convert to 0.5us steps
+				ctx->_kl_rx_timeout = KL_US2TICKS(KL_HEADER_MAX_WIDTH_US);
 
-				ctx->_kl_rx_buff_bit_index = 0;
 				ctx->kl_rx_state = KL_RX_HEADERCHECK;
 			}
 		break;
@@ -263,26 +640,70 @@ void kl_rx_process(volatile struct keeloq_ctx *ctx, uint8_t bit_val) {
 		// header measurement, this can only be a transition from 0->1, we set it up so in the previous KL_RX_SYNCING stage
 		case KL_RX_HEADERCHECK:
 			// possible HEADER ended, let's verify it and figure out the actual TE length from it, since TE = TH/10	
-			if(w1us >= KL_HEADER_MIN_WIDTH_US && w1us <= KL_HEADER_MAX_WIDTH_US) {
+			if(w >= KL_US2TICKS(KL_HEADER_MIN_WIDTH_US) && w <= KL_US2TICKS(KL_HEADER_MAX_WIDTH_US)) {
 				// this was a header that just passed, and we are now at the positive impulse of the first data-bit
 
 				// flush rx buffer
 				for(uint8_t i = 0; i < KL_BUFF_LEN; i++) {
 					ctx->_kl_rx_buff[i] = 0;
 				}
+				ctx->_kl_rx_buff_bit_index = 0;
+				ctx->_kl_rx_buff_byte_index = 0;
+				ctx->_kl_rx_buff_bit_mask = 0x01;
 				
-				ctx->kl_rx_header_length = w1us;
-				
-				// stupid crap, I am receiving from 7 to 14 TEs in TH field. I can't rely on TH/10 to get the TE from there.
-				ctx->kl_rx_timing_element_min = w1us / 14; // from my measurements
-				ctx->kl_rx_timing_element_max = ctx->kl_rx_timing_element_min * 2;
+				ctx->kl_rx_stats.headers_ok++;
+				ctx->_kl_rx_header_length = w >> 1; // to microseconds, for the outside world
+				ctx->_kl_rx_jitter_sum = 0;
+
+				// we have seen enough of the preamble to know the exact TE? build tight decision windows around it
+				if(ctx->_kl_rx_pre_hi_cnt >= KL_PREAMBLE_LOCK_CNT && ctx->_kl_rx_pre_lo_cnt >= KL_PREAMBLE_LOCK_CNT) {
+					uint16_t hi = ctx->_kl_rx_pre_hi_sum >> KL_PREAMBLE_AVG_SHIFT; // 1 x TE(high), including receiver's stretch
+					uint16_t te = (hi + (ctx->_kl_rx_pre_lo_sum >> KL_PREAMBLE_AVG_SHIFT)) >> 1; // stretch cancels out here
+
+					ctx->_kl_rx_timing_element = te >> 1; // to microseconds, for the outside world
+					ctx->_kl_rx_te_locked = 1;
+					ctx->_kl_rx_t1_nom = hi;
+					ctx->_kl_rx_t0_nom = hi + te;
+
+					// bit 1 is HIGH for "hi", bit 0 is HIGH for "hi + TE", so we split the decision half-way in between
+					ctx->kl_rx_t1_min = (hi > (te >> 1)) ? hi - (te >> 1) : 0;
+					ctx->kl_rx_t1_max = hi + (te >> 1);
+					ctx->kl_rx_t2_max = ctx->kl_rx_t1_max + te;
+
+					// from now on transitions happen in maximum of 2 x TE (+ stretch), anything over 3 x TE is the end of data
+					ctx->_kl_rx_timeout = te + (te << 1);
+				}
+				// no preamble seen (or it was too short), fall back to guessing the TE from the header
+				else {
+					// stupid crap, I am receiving from 7 to 14 TEs in TH field. I can't rely on TH/10 to get the TE from there.
+					// TH/14 is what I measured, (TH/16 + TH/128) = TH/14.2 is close enough and needs no division
+					uint16_t te_min = (w >> 4) + (w >> 7);
+
+					ctx->_kl_rx_te_locked = 0;
+
+					ctx->kl_rx_t1_min = te_min;
+					ctx->kl_rx_t1_max = te_min << 1;
+					ctx->kl_rx_t2_max = te_min << 2;
 
-				// from now on transitions happen in maximum of 4 x TE, else we have an error
-				ICR1 = (4 * ctx->kl_rx_timing_element_max) * 2; // convert to 0.5us steps
+					// receiver's stretch is unknown without the preamble, assume a quarter of TE
+					ctx->_kl_rx_t1_nom = te_min + (te_min >> 2);
+					ctx->_kl_rx_t0_nom = ctx->_kl_rx_t1_nom + te_min;
+
+					// from now on transitions happen in maximum of 4 x TE, else we have an error
+					ctx->_kl_rx_timeout = te_min << 3; // 4 x (2 x TE(min))
+				}
+
+				ctx->_kl_rx_pre_hi_cnt = 0;
+				ctx->_kl_rx_pre_lo_cnt = 0;
 
 				ctx->kl_rx_state = KL_RX_RXING;
 			}
 			else {
+				kl_rx_preamble_track(ctx, w, 0); // it was just a LOW preamble pulse, most probably
+				if(w > KL_US2TICKS(KL_TE_WIDTH_MAX_US)) {
+					ctx->kl_rx_stats.headers_bad++;
+				}
+
 				ctx->kl_rx_state = KL_RX_SYNCING;
 			}
 		break;
@@ -292,49 +713,60 @@ void kl_rx_process(volatile struct keeloq_ctx *ctx, uint8_t bit_val) {
 			// transition from 1->0
 			if(!bit_val) {
 				// we received more bits that we are capable of storing in memory? reject!
-				if(ctx->_kl_rx_buff_bit_index > (KL_BUFF_LEN * 8) - 1) {
+				if(ctx->_kl_rx_buff_bit_index >= (KL_BUFF_LEN * 8)) {
+					ctx->kl_rx_stats.rej_overflow++;
 					ctx->kl_rx_state = KL_RX_SYNCING;
-					ctx->kl_rx_process_busy = 0;
-					return;
+					break;
 				}
 
 				// end of a bit, decode it to 0/1
-				uint16_t t1TEmin = 1 * ctx->kl_rx_timing_element_min;
-				uint16_t t1TEmax = 1 * ctx->kl_rx_timing_element_max;
-				uint16_t t2TEmin = 2 * ctx->kl_rx_timing_element_min;
-				uint16_t t2TEmax = 2 * ctx->kl_rx_timing_element_max;
-
+				// invalid bit length - reject everything
+				if(w < ctx->kl_rx_t1_min) {
+					ctx->kl_rx_stats.rej_bit_short++;
+					ctx->kl_rx_state = KL_RX_SYNCING;
+					break;
+				}
 				// 1 (1 x TE(high))
-				if(w1us >= t1TEmin && w1us <= t1TEmax) {
-					ctx->kl_rx_timing_element = w1us; // remember, if we need it elsewhere
+				else if(w <= ctx->kl_rx_t1_max) {
+					// remember, if we need it elsewhere. TE from the preamble is far better than this one though
+					if(!ctx->_kl_rx_te_locked) {
+						ctx->_kl_rx_timing_element = w >> 1;
+					}
 
 					// add decoded bit into our kl_buff array
-					uint8_t arr_index = ctx->_kl_rx_buff_bit_index / 8;
-					uint8_t arr_bit_index = ctx->_kl_rx_buff_bit_index % 8;
-					ctx->_kl_rx_buff[arr_index] |= (0x01 << arr_bit_index);
-				}
-				// 0 (2 x TE(high))
-				else if (w1us >= t2TEmin && w1us <= t2TEmax) {
-					// we don't process zeros
-					// but we catch them here for validation purposes only
+					ctx->_kl_rx_buff[ctx->_kl_rx_buff_byte_index] |= ctx->_kl_rx_buff_bit_mask;
+
+					// jitter, for the quality of this frame
+					ctx->_kl_rx_jitter_sum += (w > ctx->_kl_rx_t1_nom) ? (w - ctx->_kl_rx_t1_nom) : (ctx->_kl_rx_t1_nom - w);
 				}
 				// invalid bit length - reject everything
-				else {
+				else if(w > ctx->kl_rx_t2_max) {
 					/*char tmp[64];
-					sprintf(tmp, "E(%u), RX=%u, TE=%u, MIN=%u, MAX=%u\r\n", ctx->_kl_rx_buff_bit_index, w1us, ctx->kl_rx_timing_element, ctx->kl_rx_timing_element_min, ctx->kl_rx_timing_element_max);
+					sprintf(tmp, "E(%u), RX=%u, TE=%u, MIN=%u, MAX=%u\r\n", ctx->_kl_rx_buff_bit_index, w, ctx->_kl_rx_timing_element, ctx->kl_rx_t1_min, ctx->kl_rx_t2_max);
 					uart_puts(tmp);*/
-					
+
+					ctx->kl_rx_stats.rej_bit_long++;
 					ctx->kl_rx_state = KL_RX_SYNCING;
-					ctx->kl_rx_process_busy = 0;
-					return;
+					break;
 				}
-
+				// 0 (2 x TE(high))
+				// we don't process zeros, buffer was cleared at the header
+				else {
+					// jitter, for the quality of this frame
+					ctx->_kl_rx_jitter_sum += (w > ctx->_kl_rx_t0_nom) ? (w - ctx->_kl_rx_t0_nom) : (ctx->_kl_rx_t0_nom - w);
+				}
+				
 				// we are handling only HCS* KeeLoq series so we can receive 66, 67 or 69 bits here, we don't know
-				// in advance so we let the timeout of Timer1 decide on this after the Guard Time has passed.
-				// actually, after the ~ > 4xTE has passed without receiving a next positive pulse should do the trick
-				// ICR1 is already set for that interval so we are good
+				// in advance so we let the timeout decide on this after the Guard Time has passed.
+				// actually, after the ~ > 3xTE has passed without receiving a next positive pulse should do the trick
+				// _kl_rx_timeout is already set for that interval so we are good
 			
 				ctx->_kl_rx_buff_bit_index++;
+				ctx->_kl_rx_buff_bit_mask <<= 1;
+				if(!ctx->_kl_rx_buff_bit_mask) {
+					ctx->_kl_rx_buff_bit_mask = 0x01;
+					ctx->_kl_rx_buff_byte_index++;
+				}
 			}
 			// transition from 0->1
 			else {
@@ -350,6 +782,13 @@ void kl_rx_process(volatile struct keeloq_ctx *ctx, uint8_t bit_val) {
 		default:
 			ctx->kl_rx_state = KL_RX_SYNCING;
 	}
+
+	// how long we were in here
+	// WARNING: this is where hardware abstraction is not possible
+	uint16_t isr_ticks = TCNT1 - now;
+	if(isr_ticks > ctx->kl_rx_stats.isr_ticks_max) {
+		ctx->kl_rx_stats.isr_ticks_max = isr_ticks;
+	}
 	
 	ctx->kl_rx_process_busy = 0;
 }
@@ -10,19 +10,36 @@
 
 #include <stdio.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include <string.h>
 
+#define KL_US2TICKS(us)						((us) * 2) // receiver measures in Timer1 ticks, F_CPU/8 which for 16MHz is 0.5us
+
 #define KL_TE_WIDTH_MIN_US					(190) // the shortest pulse we accept
 #define KL_TE_WIDTH_MAX_US					(620) // the longest pulse we accept. note: some cheap RF receivers stretch the pulse to as much as 50%
 
 #define KL_HEADER_MIN_WIDTH_US				(10 * KL_TE_WIDTH_MIN_US) // minimum TH allowed. 10 x MINIMUM(TE)
 #define KL_HEADER_MAX_WIDTH_US				(10 * KL_TE_WIDTH_MAX_US) // maximum TH allowed. 10 x MAXIMUM(TE)
 
+#define KL_PREAMBLE_AVG_SHIFT				(2) // preamble pulse widths are averaged over the last 2^2 = 4 pulses of the same level
+#define KL_PREAMBLE_LOCK_CNT				(6) // how many consistent high AND low preamble pulses we need before we trust the averaged TE
+
 #define KL_GUARD_TIMER_CNT					(20) // how many KL_HEADER_MAX_WIDTH_US do we allow to pass before we pronounce end of RF activity
+#define KL_GUARD_GAP_MULT					(2) // once we learn the pause between frames, we wait this many pauses for the next frame...
+#define KL_GUARD_GAP_MARGIN					(2) // ...plus this many KL_HEADER_MAX_WIDTH_US. KL_GUARD_TIMER_CNT is still the ceiling
+
+#define KL_RX_POLL_TICKS					(KL_US2TICKS(500)) // how often receiver timeouts are polled on the shared Timer1 timebase
 
 #define KL_BUFF_LEN							(9) // shoud remain at 9 (enough for handling 72 bits of data which is OK for entire old HCS* series of KeeLoq)
 
+#define KL_TX_PREAMBLE_MAX					(24) // longest preamble we transmit, in 50% duty cycles. HCS datasheets call for 23
+#define KL_TX_INTERVAL_MAX_US				(0xFFFF / 2) // longest interval the transmitter can time, it is a 16-bit Timer1 compare. 32.7ms
+#define KL_TX_RAW_SHIFT						(3) // raw schedule codes are in units of 8 Timer1 ticks, 4us
+#define KL_TX_QUEUE_LEN						(4) // transmit jobs waiting for their turn
+#define KL_TX_COUNT_FOREVER					(0xFF) // job's frame is repeated until cancelled or replaced
+#define KL_TX_SCHED_LEN						((KL_TX_PREAMBLE_MAX * 2) + 1 + (KL_BUFF_LEN * 8 * 2)) // preamble, header, 2 intervals per bit. must fit in uint8_t
+
 enum KL_RX_STATE
 {
 	KL_RX_STOP = 0,
@@ -49,17 +66,93 @@ enum KL_TX_STATE
 	KL_TX_BUSY = 1,
 };
 
+// intervals between the transmitter's output pin toggles, a schedule refers to them by these.
+// codes from KL_TX_DUR_CNT up are not in the table, they are raw intervals of (code << KL_TX_RAW_SHIFT) ticks (recorded frames)
+enum KL_TX_DUR
+{
+	KL_TX_DUR_TE = 0,
+	KL_TX_DUR_2TE = 1,
+	KL_TX_DUR_HEADER = 2,
+	KL_TX_DUR_TE_GUARD = 3, // LOW of the last bit, bit 1, plus the guard time
+	KL_TX_DUR_2TE_GUARD = 4, // LOW of the last bit, bit 0, plus the guard time
+	KL_TX_DUR_CNT = 5,
+};
+
+// precomputed frame for the transmitter, see kl_tx_sched_build()
+// this is also saved in EEPROM as it stands here (recorded frames), do not re-arrange it
+struct keeloq_tx_sched {
+	uint16_t dur[KL_TX_DUR_CNT]; // in Timer1 ticks
+	uint16_t timing_element; // in microseconds, for the outside world
+	uint8_t bitlen;
+	uint8_t len; // of code[]
+	uint8_t code[KL_TX_SCHED_LEN]; // enum KL_TX_DUR, one for each interval
+};
+
+// frame waiting in the transmit queue, see kl_tx_enqueue()
+struct keeloq_tx_job {
+	uint8_t buff[KL_BUFF_LEN];
+	uint8_t bitlen;
+	uint8_t preamble_size;
+	uint8_t count; // how many times the frame is sent, or KL_TX_COUNT_FOREVER
+	uint16_t timing_element; // in microseconds
+	uint16_t header_length; // in microseconds
+	uint16_t guard_time; // in microseconds
+};
+
+struct keeloq_tx_queue {
+	struct keeloq_tx_job jobs[KL_TX_QUEUE_LEN];
+	uint8_t head;
+	uint8_t cnt;
+};
+
+// receiver statistics, always on. counters simply roll over
+struct keeloq_rx_stats {
+	uint32_t edges; // pin-changes seen by kl_rx_process()
+	uint16_t headers_ok;
+	uint16_t headers_bad; // neither a preamble pulse nor a valid header
+	uint16_t frames_66;
+	uint16_t frames_67;
+	uint16_t frames_69;
+	uint16_t rej_bit_short; // data bit shorter than 1 x TE window
+	uint16_t rej_bit_long; // data bit longer than 2 x TE window
+	uint16_t rej_overflow; // more bits than fits in KL_BUFF_LEN
+	uint16_t rej_bit_count; // timed out with bit count other than 66, 67 or 69
+	uint16_t rej_buff_busy; // valid frame, but kl_rx_buff was not consumed yet
+	uint16_t rej_nested; // edge or timeout dropped because we were still busy with the previous one
+	uint16_t isr_ticks_max; // worst-case kl_rx_process() duration in Timer1 ticks (0.5us)
+};
+
 // KeeLoq TRX context
 struct keeloq_ctx {
 	// RX
+	uint8_t kl_rx_channel; // set by the application, tells which RF front-end this receiver belongs to
 	enum KL_RX_STATE kl_rx_state;
-	uint16_t kl_rx_header_length;
-	uint16_t kl_rx_timing_element;
-	uint16_t kl_rx_timing_element_min;
-	uint16_t kl_rx_timing_element_max;
+	uint16_t kl_rx_header_length; // of the frame in kl_rx_buff, in microseconds
+	uint16_t kl_rx_timing_element; // of the frame in kl_rx_buff, in microseconds
+	uint8_t kl_rx_quality; // of the frame in kl_rx_buff, 0-100. 100 means no jitter at all, 0 means bits were on average at the decision point
+	uint16_t _kl_rx_header_length; // internal usage, of the frame being received
+	uint16_t _kl_rx_timing_element; // internal usage, of the frame being received
+	uint16_t _kl_rx_t1_nom; // internal usage, where we expect 1 x TE(high) to end, in Timer1 ticks
+	uint16_t _kl_rx_t0_nom; // internal usage, where we expect 2 x TE(high) to end, in Timer1 ticks
+	uint32_t _kl_rx_jitter_sum; // internal usage, sum of bit deviations from the above, in Timer1 ticks
+	uint16_t kl_rx_t1_min; // decision window for 1 x TE(high), which is bit 1. in Timer1 ticks, prepared when header is accepted
+	uint16_t kl_rx_t1_max; // ...this is also where the window for 2 x TE(high) begins, which is bit 0
+	uint16_t kl_rx_t2_max;
+	uint16_t _kl_rx_pre_hi_sum; // internal usage, running sum of the last preamble HIGH pulses, in Timer1 ticks
+	uint16_t _kl_rx_pre_lo_sum; // internal usage, running sum of the last preamble LOW pulses, in Timer1 ticks
+	uint8_t _kl_rx_pre_hi_cnt; // internal usage, how many consistent preamble HIGH pulses we have seen so far
+	uint8_t _kl_rx_pre_lo_cnt; // internal usage, how many consistent preamble LOW pulses we have seen so far
+	uint8_t _kl_rx_te_locked; // internal usage, TE of this frame came from the preamble
 	uint8_t kl_rx_guard_timer;
+	uint8_t kl_rx_guard_reload; // learned from the pause between the first two frames of a burst
+	uint8_t _kl_rx_burst_frames; // internal usage, frames received in the current burst
+	uint8_t _kl_rx_gap_cnt; // internal usage, timeouts counted since the last frame
+	uint16_t _kl_rx_last_edge; // internal usage, Timer1 value of the previous edge (or of the previous timeout)
+	uint16_t _kl_rx_timeout; // internal usage, in Timer1 ticks, when kl_rx_pulse_timeout() will happen if no edge arrives
 	uint8_t kl_rx_buff_bit_index;
 	uint8_t _kl_rx_buff_bit_index; // internal usage
+	uint8_t _kl_rx_buff_byte_index; // internal usage, where the next bit goes...
+	uint8_t _kl_rx_buff_bit_mask; // internal usage, ...and which bit it is in that byte
 	uint8_t _kl_rx_buff[KL_BUFF_LEN]; // internal buffer for actual receiving
 
 	enum KL_RF_ACT kl_rx_rf_act; // rf activity
@@ -67,12 +160,21 @@ struct keeloq_ctx {
 	enum KL_BUFF_STATE kl_rx_buff_state;
 	uint8_t kl_rx_buff[KL_BUFF_LEN]; // external buffer for consuming from outside
 
+	struct keeloq_rx_stats kl_rx_stats;
+
 	// TX
 	enum KL_TX_STATE kl_tx_state;
-	uint8_t kl_tx_buff_bit_index;
-	uint8_t kl_tx_bitlen;
-	uint8_t *kl_tx_buff;
-	uint16_t kl_tx_timing_element;
+	uint8_t kl_tx_bitlen; // of the frame being transmitted
+	uint16_t kl_tx_timing_element; // of the frame being transmitted, in microseconds
+	struct keeloq_tx_sched *kl_tx_sched; // being transmitted
+	struct keeloq_tx_sched *kl_tx_sched_buff; // set by the application, where kl_tx_start() builds the schedule
+	uint8_t _kl_tx_sched_index; // internal usage, next interval to schedule
+	uint8_t _kl_tx_sched_len; // internal usage, intervals of the frame on the air. kl_tx_sched may be rebuilt in its guard time
+	struct keeloq_tx_sched *_kl_tx_sched_next; // internal usage, what follows the current frame, 0 if nothing
+	uint8_t _kl_tx_repeat_left; // internal usage, of the current job
+	struct keeloq_tx_queue *kl_tx_queue; // set by the application, jobs waiting for kl_tx_sched_buff
+	uint16_t kl_tx_isr_ticks_max; // worst-case kl_tx_process() duration in Timer1 ticks (0.5us)
+	void (*fn_tx_done)(volatile struct keeloq_ctx *); // optional, called from the ISR once the guard time is over
 
 	// functions called by ISRs should not nest
 	uint8_t kl_rx_process_busy;
@@ -92,15 +194,22 @@ void kl_init_ctx(volatile struct keeloq_ctx *);
 
 // receiver
 void kl_rx_start(volatile struct keeloq_ctx *);
-void kl_rx_process(volatile struct keeloq_ctx *, uint8_t); // called on each pin-change ISR of the RF receiver
+void kl_rx_process(volatile struct keeloq_ctx *, uint8_t, uint16_t); // called on each pin-change ISR of the RF receiver, with Timer1 value of the edge
+void kl_rx_poll(volatile struct keeloq_ctx *, uint16_t); // called periodically with current Timer1 value, from ISR(TIMER1_COMPB_vect)
 void kl_rx_stop(volatile struct keeloq_ctx *);
 void kl_rx_flush(volatile struct keeloq_ctx *);
 void kl_rx_pulse_timeout(volatile struct keeloq_ctx *);
+void kl_rx_stats_clear(volatile struct keeloq_ctx *);
 
 // transmitter
-void kl_tx(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t);
-void kl_tx_preamble(volatile struct keeloq_ctx *, uint16_t, uint8_t);
-void kl_tx_data(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t);
-void kl_tx_process(volatile struct keeloq_ctx *); // called by the PWM output ISR
+uint8_t kl_tx_sched_build(struct keeloq_tx_sched *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t);
+uint16_t kl_tx_sched_ticks(struct keeloq_tx_sched *, uint8_t);
+uint8_t kl_tx_start_sched(volatile struct keeloq_ctx *, struct keeloq_tx_sched *, uint8_t); // non-blocking
+uint8_t kl_tx_start(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t); // non-blocking
+uint8_t kl_tx_enqueue(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t, uint8_t); // non-blocking
+uint8_t kl_tx_replace(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t, uint8_t); // non-blocking
+void kl_tx_cancel(volatile struct keeloq_ctx *);
+void kl_tx(volatile struct keeloq_ctx *, uint8_t *, uint8_t, uint16_t, uint8_t, uint16_t, uint16_t); // blocking, until the guard time is over
+void kl_tx_process(volatile struct keeloq_ctx *); // called from ISR(TIMER1_COMPA_vect)
 
 #endif /* KEELOQ_H_ */
\ No newline at end of file
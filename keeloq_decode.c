@@ -171,6 +171,17 @@ void keeloq_encode(uint8_t encoder, struct KEELOQ_DECODE_PLAIN *decoded, uint64_
 	}
 }
 
+// how many bits the encoder sends
+uint8_t keeloq_encode_bit_size(uint8_t encoder) {
+	if(encoder == ENCODER_HCS362) {
+		return 69;
+	}
+	if(encoder == ENCODER_HCS360 || encoder == ENCODER_HCS361) {
+		return 67;
+	}
+	return 66;
+}
+
 // public
 void keeloq_decode_build_prog_stream(uint8_t *stream, struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
 	// they all start the same
@@ -187,7 +198,7 @@ void keeloq_decode_build_prog_stream(uint8_t *stream, struct KEELOQ_DECODE_PROG_
 	if(prog_profile->encoder == ENCODER_HCS360 || prog_profile->encoder == ENCODER_HCS361) {
 		// seed2 (16bit / 2 bytes) (we will not bother with sync_B independent feature, I don't even have these encoders here to test)
 		memcpy(stream, (uint16_t *)&prog_profile->seed2, 2);
-		stream += 4;
+		stream += 2;
 		
 		// reserved 2 bytes (0x0000)
 		*stream = 0;
@@ -239,6 +250,18 @@ void keeloq_decode_build_prog_stream(uint8_t *stream, struct KEELOQ_DECODE_PROG_
 	memcpy(stream, (uint16_t *)&prog_profile->config, 2);
 }
 
+// crypt key of an encoder with this serial, KeeLoq normal learning: both halves of the 28 bit serial decrypted with the
+// manufacturer key, the low half tagged 0x2, the high half 0x6
+uint64_t keeloq_decode_learn_normal(uint32_t serial, uint64_t mfr_key) {
+	uint32_t key_lo = (serial & 0x0FFFFFFF) | 0x20000000;
+	uint32_t key_hi = (serial & 0x0FFFFFFF) | 0x60000000;
+
+	keeloq_decrypt(&key_lo, &mfr_key);
+	keeloq_decrypt(&key_hi, &mfr_key);
+
+	return ((uint64_t)key_hi << 32) | key_lo;
+}
+
 // private
 
 // calculate CRC over an entire 65 bits
@@ -247,7 +270,7 @@ uint8_t keeloq_decode_calc_crc(uint8_t *kl_buff) {
 	uint8_t crc1 = 0;
 	uint8_t crc0 = 0;
 	
-	for(uint8_t kl_buff_bit_index = 0; kl_buff_bit_index < 66; kl_buff_bit_index++) {
+	for(uint8_t kl_buff_bit_index = 0; kl_buff_bit_index < 65; kl_buff_bit_index++) {
 		uint8_t arr_index = kl_buff_bit_index / 8;
 		uint8_t arr_bit_index = kl_buff_bit_index % 8;		
 		uint8_t buff_byteval = kl_buff[arr_index];
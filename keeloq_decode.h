@@ -124,7 +124,9 @@ struct KEELOQ_DECODE_PROG_PROFILE {
 // public
 uint8_t keeloq_decode(uint8_t *, uint8_t, uint64_t , struct KEELOQ_DECODE_PLAIN *);
 void keeloq_encode(uint8_t, struct KEELOQ_DECODE_PLAIN *, uint64_t, uint8_t *);
+uint8_t keeloq_encode_bit_size(uint8_t);
 void keeloq_decode_build_prog_stream(uint8_t *, struct KEELOQ_DECODE_PROG_PROFILE *);
+uint64_t keeloq_decode_learn_normal(uint32_t, uint64_t);
 
 // private
 uint8_t keeloq_decode_calc_crc(uint8_t *);
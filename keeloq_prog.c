@@ -3,114 +3,380 @@
  *
  * Created: 21. 3. 2021. 19:56:41
  *  Author: Trax
+ *
+ * Timer-driven bit banger. Every step sets the pins and tells the caller's one-shot timer when
+ * to call kl_prog_process() again, so nothing here busy-waits. Delays are minimums, a late
+ * timer only makes programming slower.
+ *
  */ 
 
 #include "keeloq_prog.h"
+#include "keeloq_decode.h"
+
+// what kl_prog_process() does next
+enum KL_PROG_STEP
+{
+	KL_PROG_STEP_ENTER = 0,
+	KL_PROG_STEP_PS,
+	KL_PROG_STEP_PH1,
+	KL_PROG_STEP_PH2,
+	KL_PROG_STEP_PBW,
+	KL_PROG_STEP_DATA,
+	KL_PROG_STEP_CLKH,
+	KL_PROG_STEP_CLKL,
+	KL_PROG_STEP_BIT_END,
+	KL_PROG_STEP_VFY_CLKH,
+	KL_PROG_STEP_VFY_READ,
+	KL_PROG_STEP_VFY_CLKL,
+	KL_PROG_STEP_END,
+};
+
+// encoder's datasheet minimums, in microseconds. 0 if we don't know how to program it.
+// a switch and not a table, that would take RAM
+static uint8_t kl_prog_timing_min(uint8_t encoder, struct keeloq_prog_timing *m) {
+	switch(encoder) {
+		// programming specs of all of these list the same minimums
+		case ENCODER_HCS200:
+		case ENCODER_HCS201:
+		case ENCODER_HCS300:
+		case ENCODER_HCS301:
+		case ENCODER_HCS320:
+		case ENCODER_HCS360:
+		case ENCODER_HCS361:
+			m->enter = 10000; // ours, just to have the pins settled
+			m->ph1 = 3500;
+			m->ph2 = 50;
+			m->pbw = 4000;
+			m->data = 10; // ours, TDS is 0
+			m->clkh = 50;
+			m->clkl = 50; // TDH is shorter
+			m->wc = 50000;
+			m->vfy = 30; // TDV
+			m->vfy_clkh = 50;
+			return 1;
+	}
+
+	return 0;
+}
+
+// the delays kl_prog() always had, for every encoder
+void kl_prog_timing_default(struct keeloq_prog_timing *timing) {
+	timing->enter = KL_PROG_T_ENTER_US;
+	timing->ph1 = KL_PROG_T_PH1_US;
+	timing->ph2 = KL_PROG_T_PH2_US;
+	timing->pbw = KL_PROG_T_PBW_US;
+	timing->data = KL_PROG_T_DATA_US;
+	timing->clkh = KL_PROG_T_CLKH_US;
+	timing->clkl = KL_PROG_T_CLKL_US;
+	timing->wc = KL_PROG_T_WC_US;
+	timing->vfy = KL_PROG_T_VFY_US;
+	timing->vfy_clkh = KL_PROG_T_VFY_CLKH_US;
+}
+
+// minimum plus level/16 of it, but never slower than the default
+static inline uint32_t kl_prog_margin(uint32_t min, uint8_t level, uint32_t dflt) {
+	uint32_t t = min + (min * level) / 16;
+	return (t < dflt) ? t : dflt;
+}
+
+// encoder's datasheet minimums plus level/16 of them. 0 if we don't know how to program the encoder, timing is then the default one
+uint8_t kl_prog_timing_profile(uint8_t encoder, uint8_t level, struct keeloq_prog_timing *timing) {
+	kl_prog_timing_default(timing);
+	if(level > KL_PROG_LEVEL_MAX) {
+		return 0;
+	}
+
+	struct keeloq_prog_timing m;
+	if(!kl_prog_timing_min(encoder, &m)) {
+		return 0;
+	}
+
+	timing->enter = kl_prog_margin(m.enter, level, timing->enter);
+	timing->ph1 = kl_prog_margin(m.ph1, level, timing->ph1);
+	timing->ph2 = kl_prog_margin(m.ph2, level, timing->ph2);
+	timing->pbw = kl_prog_margin(m.pbw, level, timing->pbw);
+	timing->data = kl_prog_margin(m.data, level, timing->data);
+	timing->clkh = kl_prog_margin(m.clkh, level, timing->clkh);
+	timing->clkl = kl_prog_margin(m.clkl, level, timing->clkl);
+	timing->wc = kl_prog_margin(m.wc, level, timing->wc);
+	timing->vfy = kl_prog_margin(m.vfy, level, timing->vfy);
+	timing->vfy_clkh = kl_prog_margin(m.vfy_clkh, level, timing->vfy_clkh);
+
+	return 1;
+}
 
 void kl_prog_init_ctx(volatile struct keeloq_prog_ctx *ctx) {
-	// nothing here yet
+	struct keeloq_prog_timing timing;
+	kl_prog_timing_default(&timing);
+	ctx->kl_prog_timing = timing;
+	ctx->kl_prog_state = KL_PROG_IDLE;
+	ctx->kl_prog_phase = KL_PROG_PHASE_ENTER;
+	ctx->kl_prog_result = 0;
+	ctx->kl_prog_retries = KL_PROG_RETRIES_DEFAULT;
+	ctx->kl_prog_attempt = 0;
+	ctx->kl_prog_failed_words = 0;
+	ctx->kl_prog_errors_len = 0;
+	ctx->_kl_prog_busy = 0;
 }
 
-// bit banger
-uint8_t kl_prog(volatile struct keeloq_prog_ctx *ctx, unsigned char *stream, unsigned char bit_len, unsigned char verify) {
-	ctx->fn_prog_init_hw(0); // init for programming (0)
-
-	// prepare to go into the programing mode
-	ctx->fn_set_clk_pin_hw(0);
-	ctx->fn_set_data_pin_hw(0);
-	_delay_ms(100);
-
-	// enter the programming mode
-	// Programming will be initiated by forcing the PWM line high, after the S2 line has been held high for the appropriate length of time
-	ctx->fn_set_clk_pin_hw(1);
-	_delay_ms(4); // TPS
-	ctx->fn_set_data_pin_hw(1);
-	_delay_ms(4); // TPH1
-	ctx->fn_set_data_pin_hw(0);
-	_delay_us(70); // TPH2
-	ctx->fn_set_clk_pin_hw(0);
-	_delay_ms(5); // TPBW
-
-	// we should now be in the programming mode, and we can start bit-banging from the *stream buffer LSb LSB
-	for(uint8_t bit_no = 0; bit_no < bit_len; bit_no++) {
-		uint8_t arr_index = (bit_no / 8);
-		uint8_t arr_bit_index = bit_no % 8;
-		uint8_t stream_byteval = stream[arr_index];
-		if(arr_bit_index > 0) {
-			stream_byteval = (stream_byteval >> arr_bit_index);
+// bit of the stream, LSb LSB first
+static inline uint8_t kl_prog_stream_bit(volatile struct keeloq_prog_ctx *ctx, uint8_t bit_no) {
+	return (ctx->_kl_prog_stream[bit_no / 8] >> (bit_no % 8)) & 0b00000001;
+}
+
+// word of the verify is in _kl_prog_word, compare it and report it
+static void kl_prog_check_word(volatile struct keeloq_prog_ctx *ctx, uint8_t word) {
+	uint8_t bits = ctx->kl_prog_bit_len - word * 16;
+	uint16_t mask = (bits >= 16) ? 0xFFFF : ((1U << bits) - 1); // last one can be shorter
+
+	// as it is written: LSb of the LSB first
+	uint16_t expected = ctx->_kl_prog_stream[word * 2];
+	if(bits > 8) {
+		expected |= (uint16_t)ctx->_kl_prog_stream[word * 2 + 1] << 8;
+	}
+	expected &= mask;
+	uint16_t actual = ctx->_kl_prog_word;
+
+	if(expected != actual) {
+		ctx->kl_prog_failed_words |= (1U << word);
+		if(ctx->kl_prog_errors_len < KL_PROG_ERRORS_LEN) {
+			volatile struct keeloq_prog_word_error *err = &ctx->kl_prog_errors[ctx->kl_prog_errors_len];
+			err->word = word;
+			err->expected = expected;
+			err->actual = actual;
 		}
+		ctx->kl_prog_errors_len++;
+	}
+	ctx->_kl_prog_word = 0;
+}
+
+static inline void kl_prog_progress(volatile struct keeloq_prog_ctx *ctx) {
+	if(ctx->fn_prog_progress) {
+		ctx->fn_prog_progress(ctx);
+	}
+}
+
+static inline void kl_prog_phase(volatile struct keeloq_prog_ctx *ctx, enum KL_PROG_PHASE phase) {
+	ctx->kl_prog_phase = phase;
+	ctx->kl_prog_bit_no = 0;
+	kl_prog_progress(ctx);
+}
+
+// pins back to idle, result is out
+static void kl_prog_finish(volatile struct keeloq_prog_ctx *ctx, uint8_t result) {
+	ctx->fn_prog_timer_hw(0);
+	ctx->fn_prog_deinit_hw();
+	ctx->kl_prog_result = result;
+	ctx->kl_prog_state = KL_PROG_DONE;
+	kl_prog_phase(ctx, KL_PROG_PHASE_END);
+}
+
+// starts programming *stream of bit_len bits, which must stay untouched until kl_prog_state is KL_PROG_DONE.
+// returns 0 if the programmer is busy already
+uint8_t kl_prog_start(volatile struct keeloq_prog_ctx *ctx, unsigned char *stream, unsigned char bit_len, unsigned char verify) {
+	if(ctx->kl_prog_state == KL_PROG_BUSY) {
+		return 0;
+	}
 
-		// set the data bit to 0/1
-		if(stream_byteval & 0b00000001) {
+	ctx->_kl_prog_stream = stream;
+	ctx->kl_prog_bit_len = bit_len;
+	ctx->_kl_prog_verify = verify;
+	ctx->kl_prog_result = 0;
+	ctx->kl_prog_attempt = 1;
+	ctx->kl_prog_failed_words = 0;
+	ctx->kl_prog_errors_len = 0;
+	ctx->_kl_prog_step = KL_PROG_STEP_ENTER;
+	ctx->_kl_prog_busy = 0;
+	ctx->kl_prog_state = KL_PROG_BUSY;
+	kl_prog_phase(ctx, KL_PROG_PHASE_ENTER);
+
+	// first step right away
+	kl_prog_process(ctx);
+
+	return 1;
+}
+
+// stops it wherever it is, result is 0. not from ISRs, kl_prog_process() can't be interrupted by this
+void kl_prog_abort(volatile struct keeloq_prog_ctx *ctx) {
+	if(ctx->kl_prog_state != KL_PROG_BUSY) {
+		return;
+	}
+	ctx->_kl_prog_busy = 1; // a timer that fires meanwhile does nothing
+	kl_prog_finish(ctx, 0);
+	ctx->_kl_prog_busy = 0;
+}
+
+// one step of programming, call it when the timer armed by fn_prog_timer_hw() expires
+void kl_prog_process(volatile struct keeloq_prog_ctx *ctx) {
+	if(ctx->kl_prog_state != KL_PROG_BUSY || ctx->_kl_prog_busy) {
+		return;
+	}
+	ctx->_kl_prog_busy = 1; // avoid nesting in here
+
+	uint32_t wait_us = 0;
+	uint8_t bit_no = ctx->kl_prog_bit_no;
+
+	switch(ctx->_kl_prog_step) {
+		// prepare to go into the programing mode
+		case KL_PROG_STEP_ENTER:
+			ctx->fn_prog_init_hw(0); // init for programming (0)
+			ctx->fn_set_clk_pin_hw(0);
+			ctx->fn_set_data_pin_hw(0);
+			wait_us = ctx->kl_prog_timing.enter;
+			ctx->_kl_prog_step = KL_PROG_STEP_PS;
+			break;
+
+		// enter the programming mode
+		// Programming will be initiated by forcing the PWM line high, after the S2 line has been held high for the appropriate length of time
+		case KL_PROG_STEP_PS:
+			ctx->fn_set_clk_pin_hw(1);
+			wait_us = KL_PROG_T_PS_US;
+			ctx->_kl_prog_step = KL_PROG_STEP_PH1;
+			break;
+
+		case KL_PROG_STEP_PH1:
 			ctx->fn_set_data_pin_hw(1);
-		}
-		else {
+			wait_us = ctx->kl_prog_timing.ph1;
+			ctx->_kl_prog_step = KL_PROG_STEP_PH2;
+			break;
+
+		case KL_PROG_STEP_PH2:
 			ctx->fn_set_data_pin_hw(0);
-		}
-		_delay_us(50);
-		
+			wait_us = ctx->kl_prog_timing.ph2;
+			ctx->_kl_prog_step = KL_PROG_STEP_PBW;
+			break;
+
+		case KL_PROG_STEP_PBW:
+			ctx->fn_set_clk_pin_hw(0);
+			wait_us = ctx->kl_prog_timing.pbw;
+			ctx->_kl_prog_step = KL_PROG_STEP_DATA;
+			kl_prog_phase(ctx, KL_PROG_PHASE_WRITE);
+			break;
+
+		// we should now be in the programming mode, and we can start bit-banging from the *stream buffer LSb LSB
+		case KL_PROG_STEP_DATA:
+			ctx->fn_set_data_pin_hw(kl_prog_stream_bit(ctx, bit_no));
+			wait_us = ctx->kl_prog_timing.data;
+			ctx->_kl_prog_step = KL_PROG_STEP_CLKH;
+			break;
+
 		// clock it out
-		ctx->fn_set_clk_pin_hw(1);
-		_delay_us(100); // TCLKH
-		ctx->fn_set_clk_pin_hw(0);
-		_delay_us(100); // TCLKL
-		
-		// switch to verification mode after last clocked-out bit, before the TWC delay! (to prevent short-circuiting if connected directly to PWM pin without a resistor)
-		if(bit_no == bit_len - 1) {
-			ctx->fn_prog_init_hw(1); // re-init for verification (1)
-		}
-		
-		// on every 16 clocked-out bits we need to make a TWC delay
-		if(!((bit_no + 1) % 16)) {
-			_delay_ms(60); // TWC
-		}
-	}
+		case KL_PROG_STEP_CLKH:
+			ctx->fn_set_clk_pin_hw(1);
+			wait_us = ctx->kl_prog_timing.clkh;
+			ctx->_kl_prog_step = KL_PROG_STEP_CLKL;
+			break;
 
-	// verification?
-	if(verify) {
-		// read back all programmed code
-		// compare to what we expect in *stream
-		// good: return 1, bad: return 0
-		
-		// make additional TWC if bit_len is not divisible by 16 bits
-		if(bit_len % 16) {
-			_delay_ms(60);
-		}
-		
-		for(uint8_t bit_no = 0; bit_no < bit_len; bit_no++) {
-			uint8_t arr_index = (bit_no / 8);
-			uint8_t arr_bit_index = bit_no % 8;
-			uint8_t stream_byteval = stream[arr_index];
-			if(arr_bit_index > 0) {
-				stream_byteval = (stream_byteval >> arr_bit_index);
+		case KL_PROG_STEP_CLKL:
+			ctx->fn_set_clk_pin_hw(0);
+			wait_us = ctx->kl_prog_timing.clkl;
+			ctx->_kl_prog_step = KL_PROG_STEP_BIT_END;
+			break;
+
+		case KL_PROG_STEP_BIT_END:
+			bit_no++;
+			ctx->kl_prog_bit_no = bit_no;
+
+			// switch to verification mode after last clocked-out bit, before the TWC delay! (to prevent short-circuiting if connected directly to PWM pin without a resistor)
+			if(bit_no == ctx->kl_prog_bit_len) {
+				ctx->fn_prog_init_hw(1); // re-init for verification (1)
 			}
 
-			// compare bit by bit, it is easier
-			_delay_us(60);
+			// on every 16 clocked-out bits we need to make a TWC delay
+			if(!(bit_no % 16)) {
+				wait_us = ctx->kl_prog_timing.wc;
+				kl_prog_progress(ctx);
+			}
+
+			if(bit_no < ctx->kl_prog_bit_len) {
+				ctx->_kl_prog_step = KL_PROG_STEP_DATA;
+			}
+			else if(!ctx->_kl_prog_verify) {
+				ctx->_kl_prog_step = KL_PROG_STEP_END;
+			}
+			else {
+				// make additional TWC if bit_len is not divisible by 16 bits
+				if(bit_no % 16) {
+					wait_us = ctx->kl_prog_timing.wc;
+				}
+				wait_us += ctx->kl_prog_timing.vfy;
+				ctx->kl_prog_failed_words = 0;
+				ctx->kl_prog_errors_len = 0;
+				ctx->_kl_prog_word = 0;
+				ctx->_kl_prog_step = KL_PROG_STEP_VFY_CLKH;
+				kl_prog_phase(ctx, KL_PROG_PHASE_VERIFY);
+			}
+			break;
 
-			// clock high			
+		// read back all programmed code, compare to what we expect in *stream word by word. all of it is read, to know which words failed
+		case KL_PROG_STEP_VFY_CLKH:
 			ctx->fn_set_clk_pin_hw(1);
-			_delay_us(60);
-			
-			// read bit from the chip
-			uint8_t bit_val = ctx->fn_get_data_pin_hw();
-			
-			// not the same as expected? abort
-			if(bit_val != (stream_byteval & 0b00000001)) {
-				verify = 0;
-				break;
+			wait_us = ctx->kl_prog_timing.vfy;
+			ctx->_kl_prog_step = KL_PROG_STEP_VFY_READ;
+			break;
+
+		case KL_PROG_STEP_VFY_READ:
+			if(ctx->fn_get_data_pin_hw()) {
+				ctx->_kl_prog_word |= (1U << (bit_no % 16));
 			}
-			
-			// clock low
-			_delay_us(100);
+			wait_us = ctx->kl_prog_timing.vfy_clkh;
+			ctx->_kl_prog_step = KL_PROG_STEP_VFY_CLKL;
+			break;
+
+		case KL_PROG_STEP_VFY_CLKL:
 			ctx->fn_set_clk_pin_hw(0);
-		}
+			bit_no++;
+			ctx->kl_prog_bit_no = bit_no;
+			if(!(bit_no % 16) || bit_no == ctx->kl_prog_bit_len) {
+				kl_prog_check_word(ctx, (bit_no - 1) / 16);
+				kl_prog_progress(ctx);
+			}
+			if(bit_no < ctx->kl_prog_bit_len) {
+				// clock low is TCLKL in verify as well, TDV alone is shorter than that
+				wait_us = ctx->kl_prog_timing.vfy;
+				if(wait_us < ctx->kl_prog_timing.clkl) {
+					wait_us = ctx->kl_prog_timing.clkl;
+				}
+				ctx->_kl_prog_step = KL_PROG_STEP_VFY_CLKH;
+			}
+			else if(!ctx->kl_prog_failed_words) {
+				kl_prog_finish(ctx, 1);
+			}
+			// words can't be written one by one, entering the programming mode erases the chip. all of it again then
+			else if(ctx->kl_prog_attempt <= ctx->kl_prog_retries) {
+				ctx->kl_prog_attempt++;
+				ctx->fn_prog_deinit_hw();
+				wait_us = 1;
+				ctx->_kl_prog_step = KL_PROG_STEP_ENTER;
+				kl_prog_phase(ctx, KL_PROG_PHASE_ENTER);
+			}
+			else {
+				kl_prog_finish(ctx, 0);
+			}
+			break;
+
+		case KL_PROG_STEP_END:
+			kl_prog_finish(ctx, 1);
+			break;
 	}
-	else {
-		verify = 1;
+
+	// all steps wait for something, only the end does not
+	if(ctx->kl_prog_state == KL_PROG_BUSY) {
+		if(!wait_us) {
+			wait_us = 1;
+		}
+		ctx->fn_prog_timer_hw(wait_us);
 	}
 
-	ctx->fn_prog_deinit_hw();
-	
-	return verify;
+	ctx->_kl_prog_busy = 0;
 }
+
+// same as before it was timer-driven: returns when done
+uint8_t kl_prog(volatile struct keeloq_prog_ctx *ctx, unsigned char *stream, unsigned char bit_len, unsigned char verify) {
+	if(!kl_prog_start(ctx, stream, bit_len, verify)) {
+		return 0;
+	}
+	while(ctx->kl_prog_state == KL_PROG_BUSY);
+
+	return ctx->kl_prog_result;
+}
\ No newline at end of file
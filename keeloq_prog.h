@@ -9,7 +9,63 @@
 #define KEELOQ_PROG_H_
 
 #include <stdio.h>
-#include <util/delay.h>
+
+// conservative programming timing, in microseconds. works for every encoder, see kl_prog_timing_default()
+#define KL_PROG_T_ENTER_US		100000UL	// pins low before entering the programming mode
+#define KL_PROG_T_PS_US			4000UL		// TPS. it has a maximum as well, so this one is the same for all of them
+#define KL_PROG_T_PH1_US		4000UL		// TPH1
+#define KL_PROG_T_PH2_US		70UL		// TPH2
+#define KL_PROG_T_PBW_US		5000UL		// TPBW
+#define KL_PROG_T_DATA_US		50UL		// data setup before the clock goes high
+#define KL_PROG_T_CLKH_US		100UL		// TCLKH
+#define KL_PROG_T_CLKL_US		100UL		// TCLKL
+#define KL_PROG_T_WC_US			60000UL		// TWC, after every 16 bits
+#define KL_PROG_T_VFY_US		60UL		// verify: before the clock goes high, and from there to reading the data pin
+#define KL_PROG_T_VFY_CLKH_US	100UL		// verify: after reading, before the clock goes low
+
+// per-encoder timing is the datasheet minimum plus level/16 of it, never slower than the conservative one. see kl_prog_timing_profile()
+#define KL_PROG_LEVEL_DEFAULT	4			// +25%, until calibrated
+#define KL_PROG_LEVEL_MAX		16			// +100%
+
+#define KL_PROG_RETRIES_DEFAULT	2			// reprogramming attempts after a failed verify
+#define KL_PROG_ERRORS_LEN		4			// failed words reported in detail
+
+enum KL_PROG_STATE
+{
+	KL_PROG_IDLE = 0,
+	KL_PROG_BUSY = 1,
+	KL_PROG_DONE = 2,
+};
+
+// what is being done, for the progress callback
+enum KL_PROG_PHASE
+{
+	KL_PROG_PHASE_ENTER = 0,
+	KL_PROG_PHASE_WRITE = 1,
+	KL_PROG_PHASE_VERIFY = 2,
+	KL_PROG_PHASE_END = 3,
+};
+
+// programming timing, in microseconds
+struct keeloq_prog_timing {
+	uint32_t enter; // pins low before entering the programming mode
+	uint16_t ph1; // TPH1
+	uint16_t ph2; // TPH2
+	uint16_t pbw; // TPBW
+	uint16_t data; // data setup before the clock goes high
+	uint16_t clkh; // TCLKH
+	uint16_t clkl; // TCLKL, data is held this long as well
+	uint32_t wc; // TWC, after every 16 bits
+	uint16_t vfy; // verify: before the clock goes high (TCLKL at least), and from there to reading the data pin
+	uint16_t vfy_clkh; // verify: after reading, before the clock goes low
+};
+
+// one 16bit word that did not read back as written
+struct keeloq_prog_word_error {
+	uint8_t word; // index in the stream, 0 is the first one written
+	uint16_t expected;
+	uint16_t actual;
+};
 
 // KeeLoq programmer context
 struct keeloq_prog_ctx {
@@ -20,11 +76,45 @@ struct keeloq_prog_ctx {
 	void (*fn_set_clk_pin_hw)(uint8_t pin_state);
 	void (*fn_set_data_pin_hw)(uint8_t pin_state);
 	uint8_t (*fn_get_data_pin_hw)(void);
+
+	// one-shot timer: call kl_prog_process() once, this many microseconds from now. 0 stops the timer
+	void (*fn_prog_timer_hw)(uint32_t us);
+
+	// optional, called on every phase change and after every 16 bits written or verified. called from the timer ISR!
+	void (*fn_prog_progress)(volatile struct keeloq_prog_ctx *);
+
+	enum KL_PROG_STATE kl_prog_state;
+	enum KL_PROG_PHASE kl_prog_phase;
+	uint8_t kl_prog_bit_no; // bits written or verified so far in this phase
+	uint8_t kl_prog_bit_len;
+	uint8_t kl_prog_result; // valid in KL_PROG_DONE, 1 if programmed (and verified), 0 if not
+	struct keeloq_prog_timing kl_prog_timing; // set it before kl_prog_start(), kl_prog_init_ctx() sets the conservative one
+	uint8_t kl_prog_retries; // reprogramming attempts allowed after a failed verify, set it before kl_prog_start()
+	uint8_t kl_prog_attempt; // 1 on the first programming of the chip, 2 on the first retry...
+
+	// report of the last verify
+	uint16_t kl_prog_failed_words; // bit n is word n
+	uint8_t kl_prog_errors_len; // how many words failed, only the first KL_PROG_ERRORS_LEN of them are in kl_prog_errors
+	struct keeloq_prog_word_error kl_prog_errors[KL_PROG_ERRORS_LEN];
+
+	unsigned char *_kl_prog_stream; // internal usage, must stay valid until KL_PROG_DONE
+	uint8_t _kl_prog_verify; // internal usage, verify after writing
+	uint8_t _kl_prog_step; // internal usage, what kl_prog_process() does next
+	uint16_t _kl_prog_word; // internal usage, word being read back
+	uint8_t _kl_prog_busy; // functions called by ISRs should not nest
 };
 
 // to init myself
 void kl_prog_init_ctx(volatile struct keeloq_prog_ctx *);
 
+void kl_prog_timing_default(struct keeloq_prog_timing *);
+uint8_t kl_prog_timing_profile(uint8_t, uint8_t, struct keeloq_prog_timing *);
+
+uint8_t kl_prog_start(volatile struct keeloq_prog_ctx *, unsigned char *, unsigned char, unsigned char);
+void kl_prog_process(volatile struct keeloq_prog_ctx *);
+void kl_prog_abort(volatile struct keeloq_prog_ctx *);
+
+// blocking, waits for the timer-driven one to finish
 uint8_t kl_prog(volatile struct keeloq_prog_ctx *, unsigned char *, unsigned char, unsigned char);
 
 #endif /* KEELOQ_PROG_H_ */
\ No newline at end of file
@@ -40,6 +40,20 @@ void uart_puts(char *s)
 	return;
 }
 
+// transmit a null-terminated string from flash (PROGMEM) over UART
+void uart_puts_p(const char *s)
+{
+	char c;
+
+	while ((c = pgm_read_byte(s)))
+	{
+		uart_putc(c);
+		s++;
+	}
+
+	return;
+}
+
 // transmit n characters of a given string over UART
 void uart_putsn(char *s, char n)
 {
@@ -53,6 +67,16 @@ void uart_putsn(char *s, char n)
 	return;
 }
 
+// receive a char from UART only if one is already waiting. returns 1 if *data is valid
+uint8_t uart_getc_nowait(char *data)
+{
+	if(!(UCSR0A & (1 << RXC0))) return 0;	// nothing received
+
+	*data = UDR0;
+
+	return 1;
+}
+
 /*
 // receive a char from UART - +waiting for it!
 // parameter: -1 - wait until received
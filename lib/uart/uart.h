@@ -9,6 +9,7 @@
 #define UART_H_
 
 #include <stdio.h>
+#include <avr/pgmspace.h>
 
 // Calculate UBRR value for baud rate "bau"
 
@@ -16,7 +17,12 @@ void uart_init(uint8_t baudrate);
 void uart_putc(char);
 void uart_puts(char *);
 void uart_putsn(char *, char);
+void uart_puts_p(const char *);
+uint8_t uart_getc_nowait(char *);
 //char uart_getc(uint16_t);
 //void uart_getsn(char *, uint8_t, uint16_t);
 
+// string literal stays in flash, it is not copied to RAM at startup
+#define uart_puts_P(s) uart_puts_p(PSTR(s))
+
 #endif /* UART_H_ */
\ No newline at end of file
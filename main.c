@@ -10,6 +10,7 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <avr/eeprom.h>
 #include <string.h>
 #include <math.h>
@@ -41,12 +42,61 @@ volatile struct eedb_ctx eedb_hcsdb;
 volatile struct eedb_ctx eedb_hcslogdevices;
 volatile struct eedb_ctx eedb_hcsloglogs;
 volatile struct eedb_ctx eedb_hcstx;
+volatile struct eedb_ctx eedb_hcsraw;
 
 // misc
 volatile uint16_t action_expecter_timer = 0;
 
-// KeeLoq context
+// KeeLoq context, receiver channel 0 and the transmitter
 volatile struct keeloq_ctx kl_ctx;
+// transmitter's precomputed frame, raw-timing recorder shares it. option 5 never transmits, raw edge capture takes it over there
+union {
+	struct keeloq_tx_sched sched;
+	struct rawcap_ctx rawcap;
+} kl_tx_mem;
+struct keeloq_tx_queue kl_tx_queue; // transmitter's jobs
+#if RX_CHANNELS > 1
+// KeeLoq context, receiver channel 1
+volatile struct keeloq_ctx kl_ctx2;
+volatile struct keeloq_ctx * const kl_rx_ctx[RX_CHANNELS] = { &kl_ctx, &kl_ctx2 };
+#else
+volatile struct keeloq_ctx * const kl_rx_ctx[RX_CHANNELS] = { &kl_ctx };
+#endif
+volatile uint8_t rx_pins_prev = 0; // for figuring out which receiver's pin has changed in the pin-change ISR
+#if RX_CHANNELS > 1
+const uint8_t rx_pin_mask[RX_CHANNELS] = { _BV(RX_PIN), _BV(RX2_PIN) }; // all on RX_PINREG
+#else
+const uint8_t rx_pin_mask[RX_CHANNELS] = { _BV(RX_PIN) };
+#endif
+
+// fixed-code decoders, one per receiver channel
+volatile struct ev1527_ctx ev_ctx[RX_CHANNELS];
+
+// protocol decoders registered on each receiver channel's edge stream
+struct rx_dispatch_ctx rx_disp[RX_CHANNELS];
+
+// raw-timing frame recorder, receiver channel 0 only, records into kl_tx_mem.sched. stored frames are played back from it as well
+volatile struct rawtx_ctx rawtx;
+
+// counter values for the MITM HCS101 profile (option 2)
+struct counter_block mitm_counter_block;
+
+// transmitter emulator profiles (option 4), all of eedb_hcstx cached in RAM
+struct tx_bank tx_bank;
+
+// last frame our transmitter has sent, receivers run meanwhile and hear it too
+uint8_t tx_own_buff[KL_BUFF_LEN];
+uint8_t tx_own_valid = 0;
+uint16_t rx_own_frames = 0; // statistics, how many of them were dropped, rolls over
+
+// HCS encoder programmer, driven by Timer2
+volatile struct keeloq_prog_ctx prog_ctx;
+uint8_t prog_stream[24]; // being programmed, must stay untouched until the programmer is done
+volatile uint32_t prog_timer_left_us = 0; // Timer2 can't wait that long at once, this is what remains
+struct serial_alloc prog_serial_alloc; // serials of programmed encoders
+struct prog_batch prog_batch; // batch programming on the production jig
+uint8_t prog_last_encoder = ENCODER_INVALID; // programmed last, UART_CMD_PROG_CALIBRATE calibrates this one
+uint8_t prog_menu = 0; // in the programming menu (S0 hold), the only place UART_CMD_PROG_CALIBRATE is taken
 
 // misc working variables
 volatile uint8_t option_state; // device options state
@@ -54,33 +104,33 @@ volatile uint16_t last_grabbed_eeaddr = EEDB_INVALID_ADDR; // convenient for re-
 volatile uint16_t runtime_grabbed_cnt = 0; // how many new remotes have been collected from previous system (re)start
 
 void foreach_hcs_loglog_record_callback(volatile struct eedb_ctx *ctx, struct eedb_record_header *header, void *record) {
-	uart_puts("    foreach_hcs_loglog_record_callback()\r\n");
+	uart_puts_P("    foreach_hcs_loglog_record_callback()\r\n");
 
 	struct eedb_log_record *log_record = record;
 
-	uart_puts("    ");
+	uart_puts_P("    ");
 	char tmp[64];
 	for(uint8_t i=0; i<KL_BUFF_LEN; i++) {
-		sprintf(tmp, "0x%02X ", log_record->kl_rx_buff[i]);
+		sprintf_P(tmp, PSTR("0x%02X "), log_record->kl_rx_buff[i]);
 		uart_puts(tmp);
 	}
-	uart_puts("\r\n");
+	uart_puts_P("\r\n");
 }
 
 void foreach_hcs_logdevice_record_callback(volatile struct eedb_ctx *ctx, struct eedb_record_header *header, void *record) {
-	uart_puts("foreach_hcs_logdevice_record_callback()\r\n");
+	uart_puts_P("foreach_hcs_logdevice_record_callback()\r\n");
 
 	struct eedb_hcs_record *hcs_record = record;
 
 	char tmp[64];
-	sprintf(tmp, "ENCODER: %u, %lu\r\n", hcs_record->encoder, hcs_record->serial);
+	sprintf_P(tmp, PSTR("ENCODER: %u, %lu\r\n"), hcs_record->encoder, hcs_record->serial);
 	uart_puts(tmp);
 
 	// pokupi child recorde ovog klinca
 	struct eedb_log_record one_log_record;
 	eedb_for_each_record(&eedb_hcsloglogs, 0, hcs_record->serial, &foreach_hcs_loglog_record_callback, 0, (void *)&one_log_record);
 
-	uart_puts("\r\n");
+	uart_puts_P("\r\n");
 }
 
 int main(void)
@@ -114,6 +164,14 @@ int main(void)
 
 	// De-init hardware for the KeeLoq programmer... until we use it.
 	keeloq_prog_deinit_hw();
+	prog_ctx.fn_get_data_pin_hw = &keeloq_prog_get_data_pin_hw;
+	prog_ctx.fn_prog_deinit_hw = &keeloq_prog_deinit_hw;
+	prog_ctx.fn_prog_init_hw = &keeloq_prog_init_hw;
+	prog_ctx.fn_set_clk_pin_hw = &keeloq_prog_set_clk_pin_hw;
+	prog_ctx.fn_set_data_pin_hw = &keeloq_prog_set_data_pin_hw;
+	prog_ctx.fn_prog_timer_hw = &keeloq_prog_timer_hw;
+	prog_ctx.fn_prog_progress = &keeloq_prog_progress;
+	kl_prog_init_ctx(&prog_ctx);
 
 	// Setup the context for KeeLoq TX&RX library.
 	keeloq_rx_deinit_hw(); // de-init hardware just in case
@@ -122,18 +180,37 @@ int main(void)
 	kl_ctx.fn_tx_init_hw = &keeloq_init_tx_hw;
 	kl_ctx.fn_tx_deinit_hw = &keeloq_deinit_tx_hw;
 	kl_ctx.fn_tx_pin_hw = &keeloq_pin_tx_hw;
+	kl_ctx.fn_tx_done = 0; // main loop polls kl_tx_state instead
+	kl_ctx.kl_tx_sched_buff = &kl_tx_mem.sched;
+	kl_ctx.kl_tx_queue = &kl_tx_queue;
+	kl_ctx.kl_rx_channel = 0;
 	// init it
 	kl_init_ctx(&kl_ctx);
+	#if RX_CHANNELS > 1
+	// second receiver channel, it never transmits
+	keeloq_rx2_deinit_hw();
+	kl_ctx2.fn_rx_init_hw = &keeloq_rx2_init_hw;
+	kl_ctx2.fn_rx_deinit_hw = &keeloq_rx2_deinit_hw;
+	kl_ctx2.kl_rx_channel = 1;
+	kl_init_ctx(&kl_ctx2);
+	#endif
+
+	// decoders listening on each receiver channel
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		rx_dispatch_register(&rx_disp[ch], &rx_kl_edge, &rx_kl_poll, kl_rx_ctx[ch]);
+		rx_dispatch_register(&rx_disp[ch], &rx_ev_edge, &rx_ev_poll, &ev_ctx[ch]);
+	}
+	rx_dispatch_register(&rx_disp[0], &rx_rawtx_edge, &rx_rawtx_poll, &rawtx); // does nothing until armed
 
 	#ifdef DEBUG
-	char tmp[128];
+	char tmp[64];
 	#endif
 
 	// read settings from internal EEPROM
 	// eeprom has some settings?
     if( eeprom_read_byte((uint8_t *)EEPROM_MAGIC) == EEPROM_MAGIC_VALUE) {
 		#ifdef DEBUG
-		uart_puts("EEPROM VALID.\r\n");
+		uart_puts_P("EEPROM VALID.\r\n");
 		#endif
 
 		option_state = eeprom_read_byte((uint8_t *)EEPROM_OPTION_STATES);
@@ -144,7 +221,7 @@ int main(void)
 	// nope, use defaults
 	else {
 		#ifdef DEBUG
-		uart_puts("EEPROM INVALID.\r\n");
+		uart_puts_P("EEPROM INVALID.\r\n");
 		#endif
 
 		#warning "PREBACI NA OP_STATE_1 NAKON DEBUGIRANJA TX-a"
@@ -171,9 +248,10 @@ int main(void)
 	eedb_hcsmitm.fn_i2c_rx_nack = &twi_rx_nack;
 	eedb_hcsmitm.fn_i2c_tx = &twi_tx_byte;
 	eedb_init_ctx(&eedb_hcsmitm);
+	counter_block_reset(&mitm_counter_block);
 	/*
 	#ifdef DEBUG
-	sprintf(tmp, "eedb_hcsmitm allocated %u bytes\r\n", eedb_hcsmitm._allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("eedb_hcsmitm allocated %u bytes\r\n"), eedb_hcsmitm._allocated_bytes_eeaddr);
 	uart_puts(tmp);
 	#endif
 	*/
@@ -191,7 +269,7 @@ int main(void)
 	eedb_init_ctx(&eedb_hcsdb);
 	/*
 	#ifdef DEBUG
-	sprintf(tmp, "eedb_hcsdb allocated %u bytes\r\n", eedb_hcsdb._allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("eedb_hcsdb allocated %u bytes\r\n"), eedb_hcsdb._allocated_bytes_eeaddr);
 	uart_puts(tmp);
 	#endif
 	*/
@@ -209,7 +287,7 @@ int main(void)
 	eedb_init_ctx(&eedb_hcslogdevices);
 	/*
 	#ifdef DEBUG
-	sprintf(tmp, "eedb_hcslogdevices allocated %u bytes\r\n", eedb_hcslogdevices._allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("eedb_hcslogdevices allocated %u bytes\r\n"), eedb_hcslogdevices._allocated_bytes_eeaddr);
 	uart_puts(tmp);
 	#endif
 	*/
@@ -228,14 +306,14 @@ int main(void)
 	eedb_init_ctx(&eedb_hcsloglogs);
 	/*
 	#ifdef DEBUG
-	sprintf(tmp, "eedb_hcsloglogs allocated %u bytes\r\n", eedb_hcsloglogs._allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("eedb_hcsloglogs allocated %u bytes\r\n"), eedb_hcsloglogs._allocated_bytes_eeaddr);
 	uart_puts(tmp);
 	#endif
 	*/
 
 	// TABLE: HCS transmitter/tx emulator device
 	eedb_hcstx.start_eeaddr = eedb_hcsloglogs._next_free_eeaddr; // start where previous table ended
-	eedb_hcstx.record_capacity = 1;
+	eedb_hcstx.record_capacity = TX_BANK_SIZE;
 	eedb_hcstx.sizeof_record_entry = sizeof(struct eedb_hcs_record);
 	eedb_hcstx.i2c_addr = 0b10100000;
 	eedb_hcstx.fn_i2c_start = &twi_start;
@@ -246,11 +324,32 @@ int main(void)
 	eedb_init_ctx(&eedb_hcstx);
 	/*
 	#ifdef DEBUG
-	sprintf(tmp, "eedb_hcstx allocated %u bytes\r\n", eedb_hcstx._allocated_bytes_eeaddr);
+	sprintf_P(tmp, PSTR("eedb_hcstx allocated %u bytes\r\n"), eedb_hcstx._allocated_bytes_eeaddr);
+	uart_puts(tmp);
+	#endif
+	*/
+
+	// TABLE: raw-timing frames for replay, PK is the serial number they carry
+	eedb_hcsraw.start_eeaddr = eedb_hcstx._next_free_eeaddr; // start where previous table ended
+	eedb_hcsraw.record_capacity = 4;
+	eedb_hcsraw.sizeof_record_entry = sizeof(struct eedb_raw_record);
+	eedb_hcsraw.i2c_addr = 0b10100000;
+	eedb_hcsraw.fn_i2c_start = &twi_start;
+	eedb_hcsraw.fn_i2c_stop = &twi_stop;
+	eedb_hcsraw.fn_i2c_rx_ack = &twi_rx_ack;
+	eedb_hcsraw.fn_i2c_rx_nack = &twi_rx_nack;
+	eedb_hcsraw.fn_i2c_tx = &twi_tx_byte;
+	eedb_init_ctx(&eedb_hcsraw);
+	/*
+	#ifdef DEBUG
+	sprintf_P(tmp, PSTR("eedb_hcsraw allocated %u bytes\r\n"), eedb_hcsraw._allocated_bytes_eeaddr);
 	uart_puts(tmp);
 	#endif
 	*/
 
+	// serials of programmed encoders are in the internal EEPROM, see serial_alloc_take()
+	prog_serial_alloc.left = 0;
+
 	ledb_off();
 
 	// changing option states on startup?
@@ -321,6 +420,8 @@ int main(void)
 			// addon:
 			// if all options are disabled: enable option 1
 			if(option_state == 0) option_state = OP_STATE_1;
+			// if option 5 is enabled: disable all other options
+			if(option_state & OP_STATE_5) option_state = OP_STATE_5;
 			// if option 4 is enabled: disable all other options
 			if(option_state & OP_STATE_4) option_state = OP_STATE_4;
 
@@ -345,37 +446,58 @@ int main(void)
 		if (option_state & OP_STATE_2) { leda_blink(2); delay_ms_(450); }
 		if (option_state & OP_STATE_3) { leda_blink(3); delay_ms_(450); }
 		if (option_state & OP_STATE_4) { leda_blink(4); delay_ms_(450); }
+		if (option_state & OP_STATE_5) { leda_blink(5); delay_ms_(450); }
 	}
 	ledc_blink(1);
 
 	#ifdef DEBUG
-	uart_puts("Option 1: ");
-	if (option_state & OP_STATE_1) uart_puts("ON.\r\n");
-	else uart_puts("OFF.\r\n");
-	uart_puts("Option 2: ");
-	if (option_state & OP_STATE_2) uart_puts("ON.\r\n");
-	else uart_puts("OFF.\r\n");
-	uart_puts("Option 3: ");
-	if (option_state & OP_STATE_3) uart_puts("ON.\r\n");
-	else uart_puts("OFF.\r\n");
-	uart_puts("Option 4: ");
-	if (option_state & OP_STATE_4) uart_puts("ON.\r\n");
-	else uart_puts("OFF.\r\n");
-	sprintf(tmp, "CRYPT KEY: 0x%04X%04X%04X%04X\r\n", (uint16_t)(master_crypt_key >> 48), (uint16_t)(master_crypt_key >> 32), (uint16_t)(master_crypt_key >> 16), (uint16_t)master_crypt_key);
+	uart_puts_P("Option 1: ");
+	if (option_state & OP_STATE_1) uart_puts_P("ON.\r\n");
+	else uart_puts_P("OFF.\r\n");
+	uart_puts_P("Option 2: ");
+	if (option_state & OP_STATE_2) uart_puts_P("ON.\r\n");
+	else uart_puts_P("OFF.\r\n");
+	uart_puts_P("Option 3: ");
+	if (option_state & OP_STATE_3) uart_puts_P("ON.\r\n");
+	else uart_puts_P("OFF.\r\n");
+	uart_puts_P("Option 4: ");
+	if (option_state & OP_STATE_4) uart_puts_P("ON.\r\n");
+	else uart_puts_P("OFF.\r\n");
+	uart_puts_P("Option 5: ");
+	if (option_state & OP_STATE_5) uart_puts_P("ON.\r\n");
+	else uart_puts_P("OFF.\r\n");
+	sprintf_P(tmp, PSTR("CRYPT KEY: 0x%04X%04X%04X%04X\r\n"), (uint16_t)(master_crypt_key >> 48), (uint16_t)(master_crypt_key >> 32), (uint16_t)(master_crypt_key >> 16), (uint16_t)master_crypt_key);
 	uart_puts(tmp);
 	#endif
 
-	uart_puts("RESUME>\r\nEND>\r\n");
+	uart_puts_P("RESUME>\r\nEND>\r\n");
 
 	/*
 	1.	Option 1: Receiver module with memory of up to 1000 remote transmitters
 	2.	Option 2: MITM upgrader for upgrading third-party systems (insecure garage door openers)
 	3.	Option 3: Data collector with memory of up to 200 remote transmitters and 500 transmissions
+	5.	Option 5: Raw edge capture, no decoding, every edge goes out over the UART (see rawcap.h for the format)
 	*/
-	if(!(option_state & OP_STATE_4)) {
+	if(option_state & OP_STATE_5) {
+		// receiver hardware and Timer1 are started as usual, but rawcap is the only one listening to the edges
+		for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+			rx_disp[ch].rd_decoders_len = 0;
+		}
+		rx_dispatch_register(&rx_disp[0], &rx_rawcap_edge, &rx_rawcap_poll, &kl_tx_mem.rawcap);
+		rx_stop_all();
+		rx_start_all();
+		cli();
+		rawcap_init(&kl_tx_mem.rawcap, TCNT1);
+		sei();
+
+		while(1) {
+			send_rawcap_block();
+		}
+	}
+	else if(!(option_state & OP_STATE_4)) {
 		// start KeeLoq decoder as clearly we are not in remote transmitter emulator
-		kl_rx_stop(&kl_ctx);
-		kl_rx_start(&kl_ctx); // start the keeloq rx
+		rx_stop_all();
+		rx_start_all(); // start the keeloq rx
 
 		// for looping and processing
 		uint8_t processed = 0;
@@ -385,33 +507,51 @@ int main(void)
 		// for options 1 & 2
 		struct eedb_record_header header;
 		struct eedb_hcs_record record;
+		// receiver channel whose transmission we are processing, we stick with it until its transmission ends
+		volatile struct keeloq_ctx *rx = 0;
+		// repeats of the processed frame keep arriving while the button is held, we keep the timing of the best one
+		uint8_t burst_buff[KL_BUFF_LEN];
+		struct rx_frame_timing burst_best;
 		clear_pending_buttons(); // clear any pending button press or hold
 		while(1)
 		{
 			// check buttons for various commands
 			// but only if we are not currently receiving anything
-			if (kl_ctx.kl_rx_rf_act == KL_RF_ACT_IDLE) {
+			if (!rx_rf_busy()) {
+				handle_uart_commands();
+				handle_ev_frames();
+				handle_raw_frames();
+
 				uint8_t need_to_reinit_kl_rx = handle_ui_buttons();
 				// re-start KeeLoq decoder because there was some programming done and hardware *might need* to be re-initialized
 				if(need_to_reinit_kl_rx) {
-					kl_rx_stop(&kl_ctx);
-					kl_rx_start(&kl_ctx); // start the keeloq rx
+					rx_stop_all();
+					rx_start_all(); // start the keeloq rx
 				}
 			}
 
 			// turn LED A on while button is being pressed on a remote
-			if(kl_ctx.kl_rx_rf_act == KL_RF_ACT_BUSY) {
+			if(rx_rf_busy()) {
 				leda_on();
 			}
 
-			// KeeLoq library received something
-			if (kl_ctx.kl_rx_buff_state == KL_BUFF_FULL) {
+			// KeeLoq library received something, on any of the channels
+			if(!rx) {
+				rx = rx_full_ctx();
+			}
+			if (rx && rx->kl_rx_buff_state == KL_BUFF_FULL) {
+				// our own transmitter, heard by our own receiver
+				if (rx_own_frame(rx)) {
+					rx_own_frames++;
+					kl_rx_flush(rx);
+				}
 				// perform processing, just once
-				if (!processed) {
+				else if (!processed) {
 					processed = 1;
 
 					#ifdef DEBUG
-					uart_puts("RX!\r\n");
+					sprintf_P(tmp, PSTR("RX! CH%u\r\n"), rx->kl_rx_channel);
+					uart_puts(tmp);
 					#endif
 
 					memset(&decoded, 0, sizeof(struct KEELOQ_DECODE_PLAIN));
@@ -419,48 +559,71 @@ int main(void)
 					memset(&record, 0, sizeof(struct eedb_hcs_record));
 					record_found = 0;
 
-					decode_ok = keeloq_decode((uint8_t *)kl_ctx.kl_rx_buff, kl_ctx.kl_rx_buff_bit_index, 0, &decoded);
+					decode_ok = keeloq_decode((uint8_t *)rx->kl_rx_buff, rx->kl_rx_buff_bit_index, 0, &decoded);
 					// decoding is OK?
 					if (decode_ok) {
 						#ifdef DEBUG
-						sprintf(tmp, "SERIAL: %lu\r\n", decoded.serial);
+						sprintf_P(tmp, PSTR("SERIAL: %lu\r\n"), decoded.serial);
 						uart_puts(tmp);
 						#endif
 
-						record_found = event_keydown(&decoded, &header, &record, (uint8_t *)kl_ctx.kl_rx_buff);
+						record_found = event_keydown(&decoded, &header, &record, rx);
 					}
+
+					// remember this frame, and make room for its repeats
+					memcpy(burst_buff, (uint8_t *)rx->kl_rx_buff, KL_BUFF_LEN);
+					burst_best.timing_element = rx->kl_rx_timing_element;
+					burst_best.header_length = rx->kl_rx_header_length;
+					burst_best.quality = rx->kl_rx_quality;
+					kl_rx_flush(rx);
+				}
+				// a repeat of the same frame, is it any cleaner?
+				else {
+					if(memcmp(burst_buff, (uint8_t *)rx->kl_rx_buff, KL_BUFF_LEN) == 0 && rx->kl_rx_quality > burst_best.quality) {
+						burst_best.timing_element = rx->kl_rx_timing_element;
+						burst_best.header_length = rx->kl_rx_header_length;
+						burst_best.quality = rx->kl_rx_quality;
+					}
+					kl_rx_flush(rx);
 				}
 				/*
 				// each other time if it is still pressed, call it again but with a flag
 				else if (processed) {
 					// decoding & verified was OK? just PROCESS it immediatelly
 					if (decode_ok && verify_ok) {
-						event_keydown(&decoded, &header, &record, (uint8_t *)kl_ctx.kl_rx_buff, 1);
+						event_keydown(&decoded, &header, &record, rx, 1);
 					}
 				}
 				*/
 			}
 
-			// transmission processed, and finally has ended (i.e. button released on the remote)
-			if (kl_ctx.kl_rx_rf_act == KL_RF_ACT_IDLE) {
+			if (!rx_rf_busy()) {
 				leda_off();
+			}
 
+			// transmission processed, and finally has ended (i.e. button released on the remote)
+			if (rx && rx->kl_rx_rf_act == KL_RF_ACT_IDLE) {
 				// if it was processed, it is safe to call keyup event
 				if(processed) {
-					kl_rx_flush(&kl_ctx); // "flush" buffer, make room for next code to be pushed into the RX buffer
+					kl_rx_flush(rx); // "flush" buffer, make room for next code to be pushed into the RX buffer
 
 					#ifdef DEBUG
-					uart_puts("RX STOP.\r\n\r\n");
+					uart_puts_P("RX STOP.\r\n\r\n");
 					#endif
 
 					// decoding was OK?
 					if (decode_ok && record_found) {
 						event_keyup(&decoded, &header, &record);
 					}
+					if (decode_ok) {
+						event_burst_end(&decoded, &burst_best);
+					}
 
 					record_found = 0;
 					processed = 0;
 				}
+
+				rx = 0; // next channel please
 			}
 		} // end while
 	} // end if
@@ -485,92 +648,113 @@ int main(void)
 		tx_emulator_record.discrimination = 0;
 		tx_emulator_record.header_length = 2800;
 		tx_emulator_record.timing_element = 390;
+		tx_emulator_record.quality = 0;
 		tx_emulator_record.serial = 92071127;
 		tx_emulator_record.serial3 = 0;
 		//eedb_format_memory(&eedb_hcstx);
-		eedb_insert_record(&eedb_hcstx, tx_emulator_record.serial, 0, &tx_emulator_record);
+		if(eedb_find_record_eeaddr(&eedb_hcstx, tx_emulator_record.serial, 0, 0) == EEDB_INVALID_ADDR) {
+			eedb_insert_record(&eedb_hcstx, tx_emulator_record.serial, 0, &tx_emulator_record);
+		}
 		// - DEBUG
 
+		// all profiles go to RAM now, neither pressing a button nor switching profile touches EEPROM before the RF
+		tx_bank_load();
+
 		char tx_emulator_kl_buff[KL_BUFF_LEN];
-		uint16_t tx_emulator_eeaddr = EEDB_INVALID_ADDR;
 		while (1) {
-			uint8_t buttons = 0;
-			if( !(BTNS0_PINREG & _BV(BTNS0_PIN)) ) {
-				buttons |= 0b00000010;
-			}
-			if( !(BTNS1_PINREG & _BV(BTNS1_PIN)) ) {
-				buttons |= 0b00000100;
-			}
-			if( !(BTNS2_PINREG & _BV(BTNS2_PIN)) ) {
-				buttons |= 0b00001000;
-			}
-			if( !(BTNS3_PINREG & _BV(BTNS3_PIN)) ) {
-				buttons |= 0b00000001;
-			}
+			uint8_t buttons = tx_emulator_buttons();
 
-			// something to transmit?
-			if(buttons) {
-				// re-start transmission (also initial transmission is here)
-				// additional button pressed/released DURING current transmission?
+			handle_uart_commands();
+
+			// all four buttons held for a while select the next profile
+			if(buttons == TX_BANK_CHORD) {
 				if(prev_buttons != buttons) {
 					prev_buttons = buttons;
+					kl_tx_cancel(&kl_ctx);
 
-					// prepare the transmission word
-					tx_emulator_eeaddr = eedb_find_record_eeaddr(&eedb_hcstx, EEDB_PKFK_ANY, 0, 0);
-					if (tx_emulator_eeaddr != EEDB_INVALID_ADDR) {
-						ledb_on();
+					delay_ms_(TX_BANK_CHORD_MS);
+					if(tx_emulator_buttons() == TX_BANK_CHORD && tx_bank.len) {
+						tx_bank_select(tx_bank.active + 1);
+						show_number_on_leds(tx_bank.active + 1);
+					}
 
-						eedb_read_record_by_eeaddr(&eedb_hcstx, tx_emulator_eeaddr, 0, &tx_emulator_record);
+					// releasing them one by one must not transmit anything
+					while(tx_emulator_buttons()) {
+					}
+					prev_buttons = 0xFF;
+				}
+			}
+			// something to transmit?
+			else if(buttons) {
+				// re-start transmission (also initial transmission is here)
+				// additional button pressed/released DURING current transmission? new frame replaces it at the next frame boundary,
+				// the old one keeps repeating until then
+				if(prev_buttons != buttons && tx_bank.len) {
+					prev_buttons = buttons;
+					struct tx_bank_profile *profile = &tx_bank.profiles[tx_bank.active];
 
-						struct KEELOQ_DECODE_PLAIN tx_emulator_decoded;
-						tx_emulator_decoded.buttons = buttons;
-						tx_emulator_decoded.counter = ++tx_emulator_record.counter; // increment counter value in the record
-						tx_emulator_decoded.serial = tx_emulator_record.serial; // yo!
-						tx_emulator_decoded.serial3 = tx_emulator_record.serial3;
-						tx_emulator_decoded.discrimination = tx_emulator_record.discrimination;
-						tx_emulator_decoded.repeat = 0; // make me sometimes in the future...
-						tx_emulator_decoded.vlow = 0;
+					ledb_on();
 
-						// update tx profile, the counter value has changed above (++tx_emulator_record.counter)
-						eedb_update_record(&eedb_hcstx, EEDB_PKFK_ANY, 0, 0, 0, &tx_emulator_record);
+					// prepare the transmission word
+					struct KEELOQ_DECODE_PLAIN tx_emulator_decoded;
+					tx_emulator_decoded.buttons = buttons;
+					tx_emulator_decoded.counter = counter_block_take(&profile->counter);
+					tx_emulator_decoded.serial = profile->counter.serial; // yo!
+					tx_emulator_decoded.serial3 = profile->discrimination;
+					tx_emulator_decoded.discrimination = profile->discrimination;
+					tx_emulator_decoded.repeat = 0; // make me sometimes in the future...
+					tx_emulator_decoded.vlow = 0;
+					tx_emulator_decoded.que = 0;
+
+					// encode
+					keeloq_encode(profile->encoder, &tx_emulator_decoded, profile->crypt_key, (uint8_t *)&tx_emulator_kl_buff);
 
-						// encode
-						keeloq_encode(tx_emulator_record.encoder, &tx_emulator_decoded, tx_emulator_record.crypt_key, (uint8_t *)&tx_emulator_kl_buff);
+					#ifdef DEBUG
+					uart_puts_P("TX: ");
+					for(uint8_t i=0; i<KL_BUFF_LEN; i++) {
+						sprintf_P(tmp, PSTR("0x%02X "), tx_emulator_kl_buff[i]);
+						uart_puts(tmp);
+					}
+					uart_puts_P("\r\n");
+					#endif
 
-						#ifdef DEBUG
-						uart_puts("TX: ");
-						for(uint8_t i=0; i<KL_BUFF_LEN; i++) {
-							sprintf(tmp, "0x%02X ", tx_emulator_kl_buff[i]);
-							uart_puts(tmp);
-						}
-						uart_puts("\r\n");
-						#endif
+					// repeated back to back by the Timer1 for as long as the buttons are held, this loop keeps running meanwhile
+					kl_tx_replace(&kl_ctx, (uint8_t *)&tx_emulator_kl_buff, keeloq_encode_bit_size(profile->encoder), profile->timing_element, 12, profile->header_length, 13500, KL_TX_COUNT_FOREVER);
 
-						ledb_off();
-					}
-				}
+					// frame is on the air, its counter block (and the selected profile) can be saved now
+					counter_block_reserve(&profile->counter, &eedb_hcstx);
+					tx_bank_remember();
 
-				// transmit if there is TX profile in memory
-				if(tx_emulator_eeaddr != EEDB_INVALID_ADDR) {
-					ledc_on();
-					kl_tx(&kl_ctx, (uint8_t *)&tx_emulator_kl_buff, 66, tx_emulator_record.timing_element, 12, tx_emulator_record.header_length, 13500);
-					ledc_off();
+					ledb_off();
 				}
-				// report error
-				else {
+
+				// report error, there is no TX profile in memory
+				if(!tx_bank.len) {
 					leda_blink(3);
 					delay_builtin_ms_(500);
 				}
 			}
 			else {
+				// buttons released, frame that is on the air is the last one
+				if(prev_buttons != 0xFF) {
+					kl_tx_cancel(&kl_ctx);
+				}
 				prev_buttons = 0xFF;
 			}
+
+			if(kl_ctx.kl_tx_state == KL_TX_IDLE) {
+				ledc_off();
+			}
+			else {
+				ledc_on();
+			}
 		} // end while
 	} // end if
 }
 
 // key pressed on a remote
-uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_header *header, struct eedb_hcs_record *record, uint8_t *kl_rx_buff) {
+// rx is the receiver channel the transmission came from
+uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_header *header, struct eedb_hcs_record *record, volatile struct keeloq_ctx *rx) {
 	// OPTION 1: KeeLoq standard receiver
 	// OPTION 2: MITM Upgrader
 	uint8_t record_found = 0;
@@ -592,7 +776,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 				do_process = 1;
 
 				#ifdef DEBUG
-				uart_puts("event_keydown HCS101\r\n");
+				uart_puts_P("event_keydown HCS101\r\n");
 				#endif
 			}
 			// rolling-code
@@ -600,7 +784,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 				// TODO: CREATE ANTI-BRUTE FORCE PROCETCION IN A FORM OF A DELAY OR larger window-RE-SYNC REQUIREMENT
 
 				// re-decode but now with a proper key
-				uint8_t decode_ok = keeloq_decode((uint8_t *)kl_ctx.kl_rx_buff, kl_ctx.kl_rx_buff_bit_index, record->crypt_key, decoded);
+				uint8_t decode_ok = keeloq_decode((uint8_t *)rx->kl_rx_buff, rx->kl_rx_buff_bit_index, record->crypt_key, decoded);
 				if (decode_ok) {
 
 					// fix received and decoded discrimination value for HCS300, 301 and 320 as it is actualy 10 bits!
@@ -609,13 +793,13 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 					}
 
 					char tmp[64];
-					sprintf(tmp, "Record.disc = %u\r\n", record->discrimination);
+					sprintf_P(tmp, PSTR("Record.disc = %u\r\n"), record->discrimination);
 					uart_puts(tmp);
-					sprintf(tmp, "Record.cnt = %u\r\n", record->counter);
+					sprintf_P(tmp, PSTR("Record.cnt = %u\r\n"), record->counter);
 					uart_puts(tmp);
-					sprintf(tmp, "RX.disc = %u\r\n", decoded->discrimination);
+					sprintf_P(tmp, PSTR("RX.disc = %u\r\n"), decoded->discrimination);
 					uart_puts(tmp);
-					sprintf(tmp, "RX.cnt = %u\r\n", decoded->counter);
+					sprintf_P(tmp, PSTR("RX.cnt = %u\r\n"), decoded->counter);
 					uart_puts(tmp);
 
 					// discrimination must match with database value
@@ -629,7 +813,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 						do_process = 1;
 
 						#ifdef DEBUG
-						uart_puts("event_keydown HCS ROLLING OK\r\n");
+						uart_puts_P("event_keydown HCS ROLLING OK\r\n");
 						#endif
 
 						// update database with new COUNTER value received
@@ -639,13 +823,13 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 					}
 					else {
 						#ifdef DEBUG
-						uart_puts("event_keydown HCS ROLLING VALIDATION FAIL\r\n");
+						uart_puts_P("event_keydown HCS ROLLING VALIDATION FAIL\r\n");
 						#endif
 
 						// try re-syncing within a DOUBLE OPERATION larger window of 32K
 						if (next_within_window(decoded->counter, record->counter, 32767)) {
 							#ifdef DEBUG
-							uart_puts("event_keydown HCS ROLLING CHECK FAIL, RE-SYNC ATTEMPT\r\n");
+							uart_puts_P("event_keydown HCS ROLLING CHECK FAIL, RE-SYNC ATTEMPT\r\n");
 							#endif
 
 							// but this must be a successive transmission (window of 1)
@@ -663,7 +847,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 				}
 				else {
 					#ifdef DEBUG
-					uart_puts("event_keydown HCS ROLLING DECODE FAILED\r\n");
+					uart_puts_P("event_keydown HCS ROLLING DECODE FAILED\r\n");
 					#endif
 				}
 			}
@@ -673,9 +857,9 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 
 				if(option_state & OP_STATE_1) {
 					#ifdef DEBUG
-					uart_puts("Process OPTION 1\r\n");
+					uart_puts_P("Process OPTION 1\r\n");
 					char tmp[64];
-					sprintf(tmp, "BUTTONS: 0x%02X\r\n", decoded->buttons);
+					sprintf_P(tmp, PSTR("BUTTONS: 0x%02X\r\n"), decoded->buttons);
 					uart_puts(tmp);
 					#endif
 
@@ -695,7 +879,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 
 				if(option_state & OP_STATE_2) {
 					#ifdef DEBUG
-					uart_puts("Process OPTION 2\r\n");
+					uart_puts_P("Process OPTION 2\r\n");
 					#endif
 
 					// ucitaj iz eeproma MITM HCS101 profil
@@ -704,8 +888,6 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 					uint16_t eeaddr = eedb_find_record_eeaddr(&eedb_hcsmitm, EEDB_PKFK_ANY, 0, 0);
 					ledb_off();
 					if (eeaddr != EEDB_INVALID_ADDR) {
-						kl_rx_stop(&kl_ctx);
-
 						ledb_on();
 						eedb_read_record_by_eeaddr(&eedb_hcsmitm, eeaddr, 0, &hcs101record);
 						ledb_off();
@@ -713,7 +895,8 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 						// transfer from edb_hcs_record to KEELOQ_DECODE_PLAIN so we can encode it and transmit
 						struct KEELOQ_DECODE_PLAIN hcs101decoded;
 						hcs101decoded.buttons = hcs101record.buttons;
-						hcs101decoded.counter = ++hcs101record.counter; // increment counter value in the record
+						counter_block_bind(&mitm_counter_block, eeaddr, hcs101record.serial, hcs101record.counter);
+						hcs101decoded.counter = counter_block_take(&mitm_counter_block);
 						hcs101decoded.serial = hcs101record.serial;
 						hcs101decoded.serial3 = hcs101record.serial3;
 						hcs101decoded.vlow = 0; // our voltage is never low
@@ -722,27 +905,28 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 						char hcs101buff[KL_BUFF_LEN];
 						keeloq_encode(ENCODER_HCS101, &hcs101decoded, 0, (uint8_t *)&hcs101buff);
 
-						// send a burst few times, just in case receiver is lazy
-						for(uint8_t i = 0; i < 10; i++) {
-							kl_tx(&kl_ctx, (uint8_t *)&hcs101buff, 66, hcs101record.timing_element, 23, hcs101record.header_length, 15000);
+						// send a burst few times, just in case receiver is lazy. receivers keep running, the original remote's
+						// repeats are still decoded meanwhile, and so is our own burst which the main loop drops (see rx_own_frame())
+						tx_own_frame((uint8_t *)&hcs101buff);
+						if(!kl_tx_enqueue(&kl_ctx, (uint8_t *)&hcs101buff, 66, hcs101record.timing_element, 23, hcs101record.header_length, 15000, 10)) {
+							// queue is full, this counter value is skipped, which receivers accept
+							#ifdef DEBUG
+							uart_puts_P("MITM TX QUEUE FULL, FRAME DROPPED.\r\n");
+							#endif
+							leda_blink(2);
 						}
 
-						// update HCS101 MITM profile, the counter value has changed above (++hcs101record.counter)
+						// burst is on the air, its counter block can be saved now
 						ledb_on();
-						eedb_update_record(&eedb_hcsmitm, EEDB_PKFK_ANY, 0, 0, 0, &hcs101record);
+						counter_block_reserve(&mitm_counter_block, &eedb_hcsmitm);
 						ledb_off();
-
-						delay_ms_(50);
-
-						kl_rx_flush(&kl_ctx);
-						kl_rx_start(&kl_ctx);
 					}
 				}
 			}
 		}
 		else {
 			#ifdef DEBUG
-			uart_puts("Unknown device.\r\n");
+			uart_puts_P("Unknown device.\r\n");
 			#endif
 		}
 	}
@@ -751,7 +935,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 	if(option_state & OP_STATE_3) {
 		#ifdef DEBUG
 		char tmp[64];
-		sprintf(tmp, "LOGGING SERIAL: %lu\r\n", decoded->serial);
+		sprintf_P(tmp, PSTR("LOGGING SERIAL: %lu\r\n"), decoded->serial);
 		uart_puts(tmp);
 		#endif
 
@@ -762,7 +946,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 		struct eedb_hcs_record dbrecord;
 		if (last_grabbed_eeaddr == EEDB_INVALID_ADDR) {
 			#ifdef DEBUG
-			uart_puts("NOT FOUND\r\n");
+			uart_puts_P("NOT FOUND\r\n");
 			#endif
 
 			dbrecord.encoder = ENCODER_UNKNOWN;
@@ -773,8 +957,9 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 			dbrecord.serial3 = decoded->serial3; // this is only in case this was HCS101 we just received, but we don't know up front
 			// information needed for possible re-transmission later
 			dbrecord.buttons = decoded->buttons; // we always know this
-			dbrecord.timing_element = kl_ctx.kl_rx_timing_element;
-			dbrecord.header_length = kl_ctx.kl_rx_header_length;
+			dbrecord.timing_element = rx->kl_rx_timing_element;
+			dbrecord.header_length = rx->kl_rx_header_length;
+			dbrecord.quality = rx->kl_rx_quality;
 
 			// save to database
 			ledb_on();
@@ -790,34 +975,34 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 			ledb_off();
 
 			#ifdef DEBUG
-			sprintf(tmp, "FOUND AS: %u, SERIAL: %lu\r\n", dbrecord.encoder, dbrecord.serial);
+			sprintf_P(tmp, PSTR("FOUND AS: %u, SERIAL: %lu\r\n"), dbrecord.encoder, dbrecord.serial);
 			uart_puts(tmp);
 			#endif
 
 			// lets try to classify it if not already classified
 			if(dbrecord.encoder == ENCODER_UNKNOWN) {
 				// our best guess that this is HCS101 fixed encoder
-				if(kl_ctx.kl_rx_buff_bit_index == 66
+				if(rx->kl_rx_buff_bit_index == 66
 				&& decoded->discrimination == dbrecord.discrimination
 				&& decoded->serial3 == dbrecord.serial3
 				&& decoded->buttons == decoded->buttons_enc)
 				{
 					dbrecord.encoder = ENCODER_HCS101;
 				}
-				else if(kl_ctx.kl_rx_buff_bit_index == 66) {
+				else if(rx->kl_rx_buff_bit_index == 66) {
 					dbrecord.encoder = ENCODER_HCS200; // it could be this one
 				}
-				else if(kl_ctx.kl_rx_buff_bit_index == 67) {
+				else if(rx->kl_rx_buff_bit_index == 67) {
 					dbrecord.encoder = ENCODER_HCS360; // it could be this one
 				}
-				else if(kl_ctx.kl_rx_buff_bit_index == 69) {
+				else if(rx->kl_rx_buff_bit_index == 69) {
 					dbrecord.encoder = ENCODER_HCS362; // it could be this one
 				}
 
 				// update record in database, if we figured out which one it could be
 				if(dbrecord.encoder != ENCODER_UNKNOWN) {
 					#ifdef DEBUG
-					sprintf(tmp, "CLASSIFIED AS: %u\r\n", dbrecord.encoder);
+					sprintf_P(tmp, PSTR("CLASSIFIED AS: %u\r\n"), dbrecord.encoder);
 					uart_puts(tmp);
 					#endif
 					ledb_on();
@@ -837,7 +1022,7 @@ uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_he
 		// snimi i log entry ako nije HCS101, jer njega nemamo sta snimati, samo se buttonsi mijenjaju. counter vec gore updejtamo
 		if(dbrecord.encoder != ENCODER_HCS101) {
 			struct eedb_log_record log_record;
-			memcpy(log_record.kl_rx_buff, kl_rx_buff, KL_BUFF_LEN);
+			memcpy(log_record.kl_rx_buff, (uint8_t *)rx->kl_rx_buff, KL_BUFF_LEN);
 
 			// save to database
 			// note to myself: i should make PK auto increment functionality for this reason...
@@ -864,6 +1049,35 @@ void event_keyup(struct KEELOQ_DECODE_PLAIN *decoded, struct eedb_record_header
 	// other options for handling maybe?
 }
 
+// transmission has ended, best is the timing of the cleanest repeat of the frame that was processed in event_keydown()
+void event_burst_end(struct KEELOQ_DECODE_PLAIN *decoded, struct rx_frame_timing *best) {
+
+	// OPTION: Grabber/Logger
+	if(option_state & OP_STATE_3) {
+		// keep the timing of the cleanest frame we ever received from this transmitter, it is used for re-transmission
+		uint16_t eeaddr = eedb_find_record_eeaddr(&eedb_hcslogdevices, decoded->serial, 0, 0);
+		if(eeaddr != EEDB_INVALID_ADDR) {
+			struct eedb_hcs_record dbrecord;
+			eedb_read_record_by_eeaddr(&eedb_hcslogdevices, eeaddr, 0, &dbrecord);
+
+			if(best->quality > dbrecord.quality) {
+				#ifdef DEBUG
+				char tmp[64];
+				sprintf_P(tmp, PSTR("BETTER TIMING: Q=%u, TE=%u, TH=%u\r\n"), best->quality, best->timing_element, best->header_length);
+				uart_puts(tmp);
+				#endif
+
+				dbrecord.timing_element = best->timing_element;
+				dbrecord.header_length = best->header_length;
+				dbrecord.quality = best->quality;
+				ledb_on();
+				eedb_update_record(&eedb_hcslogdevices, decoded->serial, 0, 0, 0, &dbrecord);
+				ledb_off();
+			}
+		}
+	}
+}
+
 void clear_pending_buttons() {
 	btn_hold = 0;
 	btn_press = 0;
@@ -878,76 +1092,87 @@ uint8_t handle_ui_buttons() {
 
 		ledb_on();
 
-		uint8_t prog_result;
 		struct KEELOQ_DECODE_PROG_PROFILE prog_profile;
 
 		// within next 15 seconds, expect buttons to be pressed in order to program&enrol HCS encoder IC
 		btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER;
-		while(btn_expect_timer) {
+		prog_menu = 1;
+		while(btn_expect_timer || prog_ctx.kl_prog_state == KL_PROG_BUSY) {
 			uint8_t was_prog = 0;
 
-			// S0
-			if(btn_press & BTNS0_MASK) {
-				was_prog = 1;
-				prog_result = prog_n_enroll_66bit_hcs200(&prog_profile);
+			// encoder is programmed from Timer2, the rest of the device keeps going meanwhile
+			handle_uart_commands();
+			handle_ev_frames();
+
+			if(prog_ctx.kl_prog_state == KL_PROG_BUSY) {
+				continue;
+			}
+
+			// programmer is done
+			if(prog_ctx.kl_prog_state == KL_PROG_DONE) {
+				prog_ctx.kl_prog_state = KL_PROG_IDLE;
+				was_prog_at_all = 1;
+				prog_print_report();
+				if(prog_ctx.kl_prog_result) {
+					prog_enroll(&prog_profile);
+					ledc_blink(3);
+				}
+				else {
+					leda_blink(5);
+				}
 				btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER; // reload
+				clear_pending_buttons(); // buttons pressed while programming don't count
+				continue;
+			}
+
+			// button held: batch programming of that encoder on the production jig, until any button is pressed
+			if(btn_hold) {
+				uint8_t held = btn_hold;
 				clear_pending_buttons(); // clear any pending button press or hold
+				if(held & BTNS0_MASK) {
+					prog_batch_run(&prog_n_enroll_66bit_hcs200);
+				}
+				else if(held & BTNS1_MASK) {
+					prog_batch_run(&prog_n_enroll_66bit_hcs201);
+				}
+				else if(held & BTNS2_MASK) {
+					prog_batch_run(&prog_n_enroll_66bit_hcs300_301_320);
+				}
+				else if(held & BTNS3_MASK) {
+					prog_batch_run(&prog_n_enroll_67bit_hcs360_361);
+				}
+				was_prog_at_all = 1;
+				btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER; // reload
+				continue;
+			}
+
+			// S0
+			if(btn_press & BTNS0_MASK) {
+				was_prog = prog_n_enroll_66bit_hcs200(&prog_profile);
 			}
 			// S1
 			else if(btn_press & BTNS1_MASK) {
-				was_prog = 1;
-				prog_result = prog_n_enroll_66bit_hcs201(&prog_profile);
-				btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER; // reload
-				clear_pending_buttons(); // clear any pending button press or hold
+				was_prog = prog_n_enroll_66bit_hcs201(&prog_profile);
 			}
 			// S2
 			else if(btn_press & BTNS2_MASK) {
-				was_prog = 1;
-				prog_result = prog_n_enroll_66bit_hcs300_301_320(&prog_profile);
-				btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER; // reload
-				clear_pending_buttons(); // clear any pending button press or hold
+				was_prog = prog_n_enroll_66bit_hcs300_301_320(&prog_profile);
 			}
 			// S3
 			else if(btn_press & BTNS3_MASK) {
-				was_prog = 1;
-				prog_result = prog_n_enroll_67bit_hcs360_361(&prog_profile);
-				btn_expect_timer = BTN_PROG_N_ENROLL_EXPECTER; // reload
-				clear_pending_buttons(); // clear any pending button press or hold
+				was_prog = prog_n_enroll_67bit_hcs360_361(&prog_profile);
 			}
 
-			if(was_prog) {
-				was_prog_at_all = 1;
-				if(prog_result) {
-					// create database entry to save it
-					struct eedb_hcs_record record;
-					record.counter = prog_profile.counter;
-					record.crypt_key = prog_profile.crypt_key;
-					record.discrimination = prog_profile.discrimination;
-					record.encoder = prog_profile.encoder;
-					record.serial = prog_profile.serial;
-
-					#ifdef DEBUG
-					char tmp[64];
-					sprintf(tmp, "SERIAL: %lu\r\n", record.serial);
-					uart_puts(tmp);
-					sprintf(tmp, "DISC: %u\r\n", record.discrimination);
-					uart_puts(tmp);
-					sprintf(tmp, "CNT: %u\r\n", record.counter);
-					uart_puts(tmp);
-					#endif
-
-					// save to database
-					eedb_upsert_record(&eedb_hcsdb, prog_profile.serial, 0, 0, &record);
-
-					ledc_blink(3);
-				}
-				else {
+			if(btn_press) {
+				// could not even start, serials are used up
+				if(!was_prog) {
 					leda_blink(5);
 				}
-				was_prog = 0;
+				clear_pending_buttons(); // clear any pending button press or hold
 			}
 		}
 
+		prog_menu = 0;
 		ledb_off();
 		clear_pending_buttons(); // clear any pending button press or hold
 	}
@@ -1034,6 +1259,162 @@ uint8_t handle_ui_buttons() {
 	return was_prog_at_all;
 }
 
+void handle_uart_commands() {
+	char cmd;
+	if(!uart_getc_nowait(&cmd)) {
+		return;
+	}
+
+	// receiver statistics, for tuning on site
+	if(cmd == UART_CMD_RX_STATS) {
+		for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+			print_rx_stats(kl_rx_ctx[ch]);
+		}
+	}
+	else if(cmd == UART_CMD_RX_STATS_CLEAR) {
+		for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+			kl_rx_stats_clear(kl_rx_ctx[ch]);
+		}
+		uart_puts_P("RX STATS CLEARED.\r\n");
+	}
+	else if(cmd == UART_CMD_TX_PROFILE_NEXT && (option_state & OP_STATE_4)) {
+		if(tx_bank.len) {
+			tx_bank_select(tx_bank.active + 1);
+		}
+		tx_bank_print();
+	}
+	else if(cmd == UART_CMD_TX_PROFILE_LIST && (option_state & OP_STATE_4)) {
+		tx_bank_print();
+	}
+	else if(cmd == UART_CMD_BATCH_STATS && prog_batch.active) {
+		prog_batch_print();
+	}
+	// socket must be ours, and not in the middle of programming
+	else if(cmd == UART_CMD_PROG_CALIBRATE && prog_menu && !prog_batch.active && prog_ctx.kl_prog_state != KL_PROG_BUSY) {
+		prog_calibrate(prog_last_encoder);
+	}
+	// raw-timing frames share kl_tx_mem.sched with the transmitter, not in the modes that transmit on their own (MITM, emulator)
+	else if(cmd == UART_CMD_RAW_RECORD && !(option_state & (OP_STATE_2 | OP_STATE_4)) && kl_ctx.kl_tx_state == KL_TX_IDLE) {
+		rawtx_arm(&rawtx, &kl_tx_mem.sched);
+		uart_puts_P("RAW RECORDING ARMED.\r\n");
+	}
+	// transmitter's pin is the programmer's S3 as well
+	else if(cmd == UART_CMD_RAW_PLAY && !(option_state & (OP_STATE_2 | OP_STATE_4)) && prog_ctx.kl_prog_state != KL_PROG_BUSY) {
+		play_raw_frame();
+	}
+}
+
+// store the recorded raw-timing frame, under the serial number it carries
+void handle_raw_frames() {
+	if(rawtx.rt_state != RAWTX_DONE) {
+		return;
+	}
+
+	uint8_t buff[KL_BUFF_LEN];
+	uint8_t bits = rawtx_bits(&kl_tx_mem.sched, buff);
+
+	// serial is in the fixed part, no key needed for it
+	struct KEELOQ_DECODE_PLAIN decoded;
+	memset(&decoded, 0, sizeof(struct KEELOQ_DECODE_PLAIN));
+	keeloq_decode(buff, bits, 0, &decoded);
+
+	ledb_on();
+	eedb_upsert_record(&eedb_hcsraw, decoded.serial, 0, 0, &kl_tx_mem.sched);
+	ledb_off();
+
+	char tmp[48];
+	sprintf_P(tmp, PSTR("RAW FRAME STORED: %07lX, %u PULSES\r\n"), decoded.serial, kl_tx_mem.sched.len);
+	uart_puts(tmp);
+
+	rawtx_stop(&rawtx);
+}
+
+// send the stored raw-timing frame out, exactly as it was recorded
+void play_raw_frame() {
+	uint16_t eeaddr = eedb_find_record_eeaddr(&eedb_hcsraw, EEDB_PKFK_ANY, 0, 0);
+	if(eeaddr == EEDB_INVALID_ADDR) {
+		uart_puts_P("NO RAW FRAME.\r\n");
+		return;
+	}
+
+	// recorder's schedule is about to be overwritten, so is the one on the air
+	rawtx_stop(&rawtx);
+	while(kl_ctx.kl_tx_state != KL_TX_IDLE) {
+	}
+
+	ledb_on();
+	eedb_read_record_by_eeaddr(&eedb_hcsraw, eeaddr, 0, &kl_tx_mem.sched);
+	ledb_off();
+
+	// receivers keep running, they must not take the frame we are replaying for the remote's
+	uint8_t buff[KL_BUFF_LEN];
+	if(rawtx_bits(&kl_tx_mem.sched, buff)) {
+		tx_own_frame(buff);
+	}
+
+	ledc_on();
+	kl_tx_start_sched(&kl_ctx, &kl_tx_mem.sched, RAWTX_PLAY_COUNT);
+	while(kl_ctx.kl_tx_state != KL_TX_IDLE) {
+	}
+	ledc_off();
+
+	uart_puts_P("RAW FRAME SENT.\r\n");
+}
+
+void print_rx_stats(volatile struct keeloq_ctx *ctx) {
+	// take a snapshot first, ISRs keep counting while we print
+	struct keeloq_rx_stats stats;
+	cli();
+	memcpy(&stats, (struct keeloq_rx_stats *)&ctx->kl_rx_stats, sizeof(struct keeloq_rx_stats));
+	sei();
+
+	char tmp[64];
+	sprintf_P(tmp, PSTR("CH%u EDGES: %lu\r\n"), ctx->kl_rx_channel, stats.edges);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("HEADERS OK: %u, BAD: %u\r\n"), stats.headers_ok, stats.headers_bad);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("FRAMES 66: %u, 67: %u, 69: %u\r\n"), stats.frames_66, stats.frames_67, stats.frames_69);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("REJ SHORT: %u, LONG: %u, OVERFLOW: %u\r\n"), stats.rej_bit_short, stats.rej_bit_long, stats.rej_overflow);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("REJ BITCNT: %u, BUFFBUSY: %u, NESTED: %u\r\n"), stats.rej_bit_count, stats.rej_buff_busy, stats.rej_nested);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("ISR MAX: %u ticks\r\n"), stats.isr_ticks_max);
+	uart_puts(tmp);
+	if(ctx == &kl_ctx) {
+		sprintf_P(tmp, PSTR("TX ISR MAX: %u ticks, OWN FRAMES: %u\r\n"), ctx->kl_tx_isr_ticks_max, rx_own_frames);
+		uart_puts(tmp);
+	}
+	sprintf_P(tmp, PSTR("EV1527 FRAMES: %u, REJ: %u\r\n"), ev_ctx[ctx->kl_rx_channel].ev_rx_frames, ev_ctx[ctx->kl_rx_channel].ev_rx_rej);
+	uart_puts(tmp);
+}
+
+// send one captured block over the UART, if there is one. ISR keeps filling the other buffer meanwhile
+void send_rawcap_block() {
+	cli();
+	uint8_t len = rawcap_take(&kl_tx_mem.rawcap);
+	sei();
+	if(!len) {
+		return;
+	}
+
+	leda_on();
+
+	uint8_t b = kl_tx_mem.rawcap._rc_taken;
+	uart_putc(RAWCAP_BLOCK_SYNC);
+	uart_putc(len);
+	uart_putc(kl_tx_mem.rawcap.rc_lost[b]);
+	for(uint8_t i = 0; i < len; i++) {
+		uart_putc(kl_tx_mem.rawcap.rc_buff[b][i]);
+	}
+
+	cli();
+	rawcap_release(&kl_tx_mem.rawcap);
+	sei();
+
+	leda_off();
+}
+
 void show_number_on_leds(uint16_t count) {
 	// e.g. 1234
 
@@ -1072,8 +1453,8 @@ void show_number_on_leds(uint16_t count) {
 }
 
 void enroll_transmitter_rf() {
-	kl_rx_stop(&kl_ctx);
-	kl_rx_start(&kl_ctx); // start the keeloq rx
+	rx_stop_all();
+	rx_start_all(); // start the keeloq rx
 
 	// for remembering what we received in the first go
 	uint8_t first_rx_done = 0;
@@ -1083,8 +1464,8 @@ void enroll_transmitter_rf() {
 
 	// debug
 	#ifdef DEBUG
-	char tmp[128];
-	uart_puts("Waiting first TX...\r\n");
+	char tmp[64];
+	uart_puts_P("Waiting first TX...\r\n");
 	#endif
 
 	struct KEELOQ_DECODE_PLAIN *decoded;
@@ -1096,15 +1477,16 @@ void enroll_transmitter_rf() {
 	while(action_expecter_timer) {
 
 		// turn LED A on while button is pressed on a remote
-		if(kl_ctx.kl_rx_rf_act == KL_RF_ACT_BUSY) {
+		if(rx_rf_busy()) {
 			leda_on();
 		}
 
-		// receive a remote via RF, transmission has ended
-		if(kl_ctx.kl_rx_rf_act == KL_RF_ACT_IDLE && kl_ctx.kl_rx_buff_state == KL_BUFF_FULL) {
+		// receive a remote via RF on any of the channels, transmission has ended
+		volatile struct keeloq_ctx *rx = rx_full_ctx();
+		if(rx && rx->kl_rx_rf_act == KL_RF_ACT_IDLE) {
 			leda_off();
 
-			kl_rx_stop(&kl_ctx); // stop keeloq rx
+			rx_stop_all(); // stop keeloq rx
 
 			// second reception?
 			if(first_rx_done) {
@@ -1119,15 +1501,15 @@ void enroll_transmitter_rf() {
 				//		yes: enroll into memory
 				//		no: decode both without master key and see if it is HCS101
 
-				keeloq_decode(first_rx_kl_buff, kl_ctx.kl_rx_buff_bit_index, master_crypt_key, &decoded_rolling1);
+				keeloq_decode(first_rx_kl_buff, rx->kl_rx_buff_bit_index, master_crypt_key, &decoded_rolling1);
 				struct KEELOQ_DECODE_PLAIN decoded_rolling2;
-				keeloq_decode((uint8_t *)kl_ctx.kl_rx_buff, kl_ctx.kl_rx_buff_bit_index, master_crypt_key, &decoded_rolling2);
+				keeloq_decode((uint8_t *)rx->kl_rx_buff, rx->kl_rx_buff_bit_index, master_crypt_key, &decoded_rolling2);
 
 				uint8_t encoder = ENCODER_INVALID;
 
 				// debug na uart
 				#ifdef DEBUG
-				sprintf(tmp, "SER 1: %lu, SER 2: %lu\r\n", decoded_rolling1.serial, decoded_rolling2.serial);
+				sprintf_P(tmp, PSTR("SER 1: %lu, SER 2: %lu\r\n"), decoded_rolling1.serial, decoded_rolling2.serial);
 				uart_puts(tmp);
 				#endif
 
@@ -1148,7 +1530,7 @@ void enroll_transmitter_rf() {
 						// it is one of the encrypted ones, lets figure out which one
 
 						#ifdef DEBUG
-						uart_puts("ENCRYTPTED TYPE\r\n");
+						uart_puts_P("ENCRYTPTED TYPE\r\n");
 						#endif
 
 						// if 66 bit:
@@ -1160,15 +1542,15 @@ void enroll_transmitter_rf() {
 						// else: unsupported device
 
 						// HCS362
-						if (kl_ctx.kl_rx_buff_bit_index == 69) {
+						if (rx->kl_rx_buff_bit_index == 69) {
 							encoder = ENCODER_HCS362;
 						}
 						// HCS360/361
-						else if (kl_ctx.kl_rx_buff_bit_index == 67) {
+						else if (rx->kl_rx_buff_bit_index == 67) {
 							encoder = ENCODER_HCS360; // assume it is HCS360
 						}
 						// HCS101, HCS200, HCS201, HCS300, HCS301, HCS320
-						else if (kl_ctx.kl_rx_buff_bit_index == 66) {
+						else if (rx->kl_rx_buff_bit_index == 66) {
 							// we can only assume it is HCS200
 							encoder = ENCODER_HCS200;
 						}
@@ -1176,19 +1558,19 @@ void enroll_transmitter_rf() {
 					}
 					// the decryption with masterkey failed
 					// maybe it is fixed-code encoder HCS101?
-					else if (kl_ctx.kl_rx_buff_bit_index == 66) {
+					else if (rx->kl_rx_buff_bit_index == 66) {
 						// decode both transmissions without the key this time and compare them to see if this was HCS101
-						keeloq_decode(first_rx_kl_buff, kl_ctx.kl_rx_buff_bit_index, 0, &decoded_fixed1);
+						keeloq_decode(first_rx_kl_buff, rx->kl_rx_buff_bit_index, 0, &decoded_fixed1);
 						struct KEELOQ_DECODE_PLAIN decoded_fixed2;
-						keeloq_decode((uint8_t*)kl_ctx.kl_rx_buff, kl_ctx.kl_rx_buff_bit_index, 0, &decoded_fixed2);
+						keeloq_decode((uint8_t*)rx->kl_rx_buff, rx->kl_rx_buff_bit_index, 0, &decoded_fixed2);
 
 						#ifdef DEBUG
-						uart_puts("Decrypt failed, fixed code?\r\n");
-						sprintf(tmp, "TX1.BTN=0x%02X, TX1.BTNENC=0x%02X\r\n", decoded_fixed1.buttons ,decoded_fixed1.buttons_enc);
+						uart_puts_P("Decrypt failed, fixed code?\r\n");
+						sprintf_P(tmp, PSTR("TX1.BTN=0x%02X, TX1.BTNENC=0x%02X\r\n"), decoded_fixed1.buttons ,decoded_fixed1.buttons_enc);
 						uart_puts(tmp);
-						sprintf(tmp, "TX2.BTN=0x%02X, TX2.BTNENC=0x%02X\r\n", decoded_fixed2.buttons ,decoded_fixed2.buttons_enc);
+						sprintf_P(tmp, PSTR("TX2.BTN=0x%02X, TX2.BTNENC=0x%02X\r\n"), decoded_fixed2.buttons ,decoded_fixed2.buttons_enc);
 						uart_puts(tmp);
-						sprintf(tmp, "TX1.CNT=%u, TX2.CNT=%u\r\n", decoded_fixed1.counter, decoded_fixed2.counter);
+						sprintf_P(tmp, PSTR("TX1.CNT=%u, TX2.CNT=%u\r\n"), decoded_fixed1.counter, decoded_fixed2.counter);
 						uart_puts(tmp);
 						#endif
 
@@ -1202,25 +1584,25 @@ void enroll_transmitter_rf() {
 							decoded = &decoded_fixed1;
 
 							#ifdef DEBUG
-							uart_puts("HCS101\r\n");
+							uart_puts_P("HCS101\r\n");
 							#endif
 						}
 						else {
 							#ifdef DEBUG
-							uart_puts("UNCLASSIFIED\r\n");
+							uart_puts_P("UNCLASSIFIED\r\n");
 							#endif
 						}
 					}
 					else {
 						#ifdef DEBUG
-						sprintf(tmp, "WTF: %d\r\n", kl_ctx.kl_rx_buff_bit_index);
+						sprintf_P(tmp, PSTR("WTF: %d\r\n"), rx->kl_rx_buff_bit_index);
 						uart_puts(tmp);
 						#endif
 					}
 				}
 				else {
 					#ifdef DEBUG
-					uart_puts("SERIALS DONT MATCH\r\n");
+					uart_puts_P("SERIALS DONT MATCH\r\n");
 					#endif
 				}
 
@@ -1236,8 +1618,9 @@ void enroll_transmitter_rf() {
 					record.serial3 = decoded->serial3;
 					// information needed for possible re-transmission later
 					record.buttons = decoded->buttons;
-					record.timing_element = kl_ctx.kl_rx_timing_element;
-					record.header_length = kl_ctx.kl_rx_header_length;
+					record.timing_element = rx->kl_rx_timing_element;
+					record.header_length = rx->kl_rx_header_length;
+					record.quality = rx->kl_rx_quality;
 
 					// MODE: MITM Upgrader & HCS101 received? - store it in special section
 					if ((option_state & OP_STATE_2) && (encoder == ENCODER_HCS101)) {
@@ -1248,6 +1631,7 @@ void enroll_transmitter_rf() {
 							leda_blink(3); // report ERROR - there is already HCS101 memorised at the location. user needs to perform CLEAR MEMORY first
 						}
 						else {
+							counter_block_reset(&mitm_counter_block); // new profile starts from its own counter
 							ledc_blink(4); // report OK
 						}
 					}
@@ -1259,7 +1643,7 @@ void enroll_transmitter_rf() {
 
 						// it is found in database, cancel programming
 						if (eeaddr != EEDB_INVALID_ADDR) {
-							uart_puts("EXISTING DEVICE, IGNORING.\r\n");
+							uart_puts_P("EXISTING DEVICE, IGNORING.\r\n");
 
 							delay_ms_(500); // for making sense of blinking LEDs
 							leda_blink(2); // report error
@@ -1267,7 +1651,7 @@ void enroll_transmitter_rf() {
 						// store to eeprom
 						else {
 							#ifdef DEBUG
-							sprintf(tmp, "PROCESSED AS DEVICE: %u!\r\n", encoder);
+							sprintf_P(tmp, PSTR("PROCESSED AS DEVICE: %u!\r\n"), encoder);
 							uart_puts(tmp);
 							#endif
 
@@ -1284,7 +1668,7 @@ void enroll_transmitter_rf() {
 							}
 
 							#ifdef DEBUG
-							sprintf(tmp, "[%lu] (%u) {%u}\r\n", decoded->serial, decoded->counter, decoded->discrimination);
+							sprintf_P(tmp, PSTR("[%lu] (%u) {%u}\r\n"), decoded->serial, decoded->counter, decoded->discrimination);
 							uart_puts(tmp);
 							#endif
 						}
@@ -1301,31 +1685,125 @@ void enroll_transmitter_rf() {
 			}
 			// nope, this was first reception
 			else {
-				memcpy(first_rx_kl_buff, (uint8_t *)kl_ctx.kl_rx_buff, KL_BUFF_LEN); // remember the received buffer
+				memcpy(first_rx_kl_buff, (uint8_t *)rx->kl_rx_buff, KL_BUFF_LEN); // remember the received buffer
 				first_rx_done = 1;
 				led_isrblink(ISR_LED_B_MASK, ISR_LED_BLINK_XFAST_MS); // indicate first reception by blinking it
 				action_expecter_timer = BTN_ENROLL_SECOND_REMOTE_EXPECTER; // reload to expect next transmission
 
 				#ifdef DEBUG
-				uart_puts("RX 1 OK, waiting 2...\r\n");
+				uart_puts_P("RX 1 OK, waiting 2...\r\n");
 				#endif
 			}
 
-			kl_rx_start(&kl_ctx); // re-start the keeloq rx
+			rx_start_all(); // re-start the keeloq rx
 		}
 	}
 
 	led_isrblink(ISR_LED_B_MASK, 0); // stop blinking if reception of second remote has expired
 	ledb_off();
 
-	kl_rx_stop(&kl_ctx);
-	kl_rx_start(&kl_ctx); // start the keeloq rx
+	rx_stop_all();
+	rx_start_all(); // start the keeloq rx
 
 	#ifdef DEBUG
-	uart_puts("Exit prog.\r\n");
+	uart_puts_P("Exit prog.\r\n");
 	#endif
 }
 
+// start all receiver channels
+void rx_start_all() {
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		kl_rx_start(kl_rx_ctx[ch]); // this one owns the receiver hardware and Timer1
+		ev_rx_start(&ev_ctx[ch], TCNT1);
+	}
+}
+
+// stop all receiver channels
+void rx_stop_all() {
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		ev_rx_stop(&ev_ctx[ch]);
+		kl_rx_stop(kl_rx_ctx[ch]);
+	}
+}
+
+// decoders as seen by the rx dispatcher
+void rx_kl_edge(volatile void *ctx, uint8_t level, uint16_t now) {
+	kl_rx_process(ctx, level, now);
+}
+
+void rx_kl_poll(volatile void *ctx, uint16_t now) {
+	kl_rx_poll(ctx, now);
+}
+
+void rx_ev_edge(volatile void *ctx, uint8_t level, uint16_t now) {
+	ev_rx_process(ctx, level, now);
+}
+
+void rx_ev_poll(volatile void *ctx, uint16_t now) {
+	ev_rx_poll(ctx, now);
+}
+
+void rx_rawcap_edge(volatile void *ctx, uint8_t level, uint16_t now) {
+	rawcap_edge(ctx, level, now);
+}
+
+void rx_rawcap_poll(volatile void *ctx, uint16_t now) {
+	rawcap_poll(ctx, now);
+}
+
+void rx_rawtx_edge(volatile void *ctx, uint8_t level, uint16_t now) {
+	rawtx_edge(ctx, level, now);
+}
+
+void rx_rawtx_poll(volatile void *ctx, uint16_t now) {
+	rawtx_poll(ctx, now);
+}
+
+// report fixed-code frames, there is nothing else to do with them for now
+void handle_ev_frames() {
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		if(ev_ctx[ch].ev_rx_buff_state == EV_BUFF_FULL) {
+			char tmp[48];
+			sprintf_P(tmp, PSTR("EV1527 CH%u: %06lX, %u us\r\n"), ch, ev_ctx[ch].ev_rx_code, ev_ctx[ch].ev_rx_unit);
+			uart_puts(tmp);
+
+			ev_rx_flush(&ev_ctx[ch]);
+		}
+	}
+}
+
+// is anything being received on any of the channels?
+uint8_t rx_rf_busy() {
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		if(kl_rx_ctx[ch]->kl_rx_rf_act == KL_RF_ACT_BUSY) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// remember the frame that is about to go on the air, see rx_own_frame()
+void tx_own_frame(uint8_t *buff) {
+	memcpy(tx_own_buff, buff, KL_BUFF_LEN);
+	tx_own_valid = 1;
+}
+
+// frame in the receiver's buffer is the one our own transmitter has sent. counters move on with every transmission,
+// so a remote can't send the very same frame again and we don't need to know when exactly our burst has ended
+uint8_t rx_own_frame(volatile struct keeloq_ctx *rx) {
+	return tx_own_valid && memcmp(tx_own_buff, (uint8_t *)rx->kl_rx_buff, KL_BUFF_LEN) == 0;
+}
+
+// first receiver channel that has something in its buffer, or 0 if none
+volatile struct keeloq_ctx *rx_full_ctx() {
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		if(kl_rx_ctx[ch]->kl_rx_buff_state == KL_BUFF_FULL) {
+			return kl_rx_ctx[ch];
+		}
+	}
+	return 0;
+}
+
 // this looks stupid
 uint8_t next_within_window(uint16_t next, uint16_t baseline, uint16_t window) {
 	// no overflow of window
@@ -1351,9 +1829,161 @@ uint8_t next_within_window(uint16_t next, uint16_t baseline, uint16_t window) {
 	return 0;
 }
 
+void counter_block_reset(struct counter_block *blk) {
+	blk->eeaddr = EEDB_INVALID_ADDR;
+	blk->left = 0;
+	blk->unsaved = 0;
+}
+
+// block belongs to the profile at eeaddr, with the serial and the counter it has in EEPROM. nothing changes if it already does
+void counter_block_bind(struct counter_block *blk, uint16_t eeaddr, uint32_t serial, uint16_t counter) {
+	if(blk->eeaddr != eeaddr || blk->serial != serial) {
+		blk->eeaddr = eeaddr;
+		blk->serial = serial;
+		blk->next = counter + 1;
+		blk->left = 0;
+		blk->unsaved = 0;
+	}
+}
+
+// next counter value to transmit for the profile the block is bound to (counter_block_bind()).
+// counter in EEPROM is not written on every transmission, it is a high-water mark moved ahead once per block. if power is lost
+// in the middle of a block, counter just skips ahead on the next boot, which rolling-code receivers accept.
+// EEPROM is never written in here. the first value of a block goes out before the block is saved, counter_block_reserve()
+// saves it once the transmission has started. that is done long before the frame carrying the value is complete, so a
+// power cut before it cannot let a receiver see the same counter twice
+uint16_t counter_block_take(struct counter_block *blk) {
+	if(!blk->left) {
+		blk->left = COUNTER_BLOCK_SIZE;
+		blk->unsaved = 1;
+	}
+
+	blk->left--;
+	return blk->next++;
+}
+
+// saves the high-water mark of the block counter_block_take() is handing out from, if it is not saved yet: the highest
+// value we may send until the next block. call it after the transmission has started, so the EEPROM write is not between
+// the keypress and the RF. only the counter is written, not the whole record
+void counter_block_reserve(struct counter_block *blk, volatile struct eedb_ctx *db) {
+	if(blk->eeaddr == EEDB_INVALID_ADDR || !blk->unsaved) {
+		return;
+	}
+	uint16_t high_water = blk->next + blk->left - 1;
+	eedb_write_n_i2c(db, blk->eeaddr + sizeof(struct eedb_record_header) + offsetof(struct eedb_hcs_record, counter), sizeof(uint16_t), &high_water);
+	blk->unsaved = 0;
+}
+
+// next encoder serial, never the same one twice, not even across power cycles. 0 if they are used up.
+// a block of them is reserved in EEPROM before the first one is handed out, a power cut skips the rest of the block.
+// the high-water mark is in the internal EEPROM at a fixed address (struct serial_alloc_slot), so neither clearing the
+// memory nor formatting the external EEPROM (EEDB_FORMATTED_MAGIC) can make serials repeat
+uint32_t serial_alloc_take(struct serial_alloc *alloc) {
+	if(!alloc->left) {
+		struct serial_alloc_slot slot;
+		eeprom_read_block(&slot, (uint8_t *)EEPROM_SERIAL_ALLOC, sizeof(slot));
+
+		// very first serial on this device
+		if(slot.magic != SERIAL_ALLOC_MAGIC) {
+			slot.serial_next = SERIAL_ALLOC_FIRST;
+		}
+
+		if(slot.serial_next < SERIAL_ALLOC_FIRST || slot.serial_next > SERIAL_ALLOC_LAST - SERIAL_ALLOC_BLOCK_SIZE + 1) {
+			return 0;
+		}
+
+		// most significant byte first, so a power cut in the middle never leaves a value below the old one
+		uint32_t high_water = slot.serial_next + SERIAL_ALLOC_BLOCK_SIZE;
+		for(int8_t i = sizeof(high_water) - 1; i >= 0; i--) {
+			eeprom_update_byte((uint8_t *)EEPROM_SERIAL_ALLOC + offsetof(struct serial_alloc_slot, serial_next) + i, high_water >> (i * 8));
+		}
+		eeprom_update_byte((uint8_t *)EEPROM_SERIAL_ALLOC + offsetof(struct serial_alloc_slot, magic), SERIAL_ALLOC_MAGIC);
+
+		alloc->next = slot.serial_next;
+		alloc->left = SERIAL_ALLOC_BLOCK_SIZE;
+	}
+
+	alloc->left--;
+	return alloc->next++;
+}
+
+// buttons of the transmitter emulator, raw (no debouncer), in the order the encoder has them: 0000 S2 S1 S0 S3
+uint8_t tx_emulator_buttons() {
+	uint8_t buttons = 0;
+	if( !(BTNS0_PINREG & _BV(BTNS0_PIN)) ) {
+		buttons |= 0b00000010;
+	}
+	if( !(BTNS1_PINREG & _BV(BTNS1_PIN)) ) {
+		buttons |= 0b00000100;
+	}
+	if( !(BTNS2_PINREG & _BV(BTNS2_PIN)) ) {
+		buttons |= 0b00001000;
+	}
+	if( !(BTNS3_PINREG & _BV(BTNS3_PIN)) ) {
+		buttons |= 0b00000001;
+	}
+	return buttons;
+}
+
+// read all transmitter emulator profiles from eedb_hcstx into RAM, and the one that was selected last time
+void tx_bank_load() {
+	struct eedb_hcs_record record;
+	uint16_t eeaddr = 0;
+
+	tx_bank.len = 0;
+	while(tx_bank.len < TX_BANK_SIZE) {
+		eeaddr = eedb_find_record_eeaddr(&eedb_hcstx, EEDB_PKFK_ANY, 0, eeaddr);
+		if(eeaddr == EEDB_INVALID_ADDR) {
+			break;
+		}
+		eedb_read_record_by_eeaddr(&eedb_hcstx, eeaddr, 0, &record);
+
+		struct tx_bank_profile *profile = &tx_bank.profiles[tx_bank.len++];
+		profile->encoder = record.encoder;
+		profile->crypt_key = record.crypt_key;
+		profile->discrimination = (record.encoder == ENCODER_HCS101) ? record.serial3 : record.discrimination;
+		profile->timing_element = record.timing_element;
+		profile->header_length = record.header_length;
+		counter_block_reset(&profile->counter);
+		counter_block_bind(&profile->counter, eeaddr, record.serial, record.counter);
+	}
+
+	tx_bank.active = eeprom_read_byte((uint8_t *)EEPROM_TX_PROFILE);
+	if(tx_bank.active >= tx_bank.len) {
+		tx_bank.active = 0;
+	}
+}
+
+// select a profile (wraps around), RAM only. each profile keeps its own counter block, switching back and forth skips nothing
+void tx_bank_select(uint8_t index) {
+	if(!tx_bank.len) {
+		return;
+	}
+	tx_bank.active = index % tx_bank.len;
+}
+
+// selected profile is remembered in the internal EEPROM, called once its frame is on the air. nothing is written if it did not change
+void tx_bank_remember() {
+	eeprom_update_byte((uint8_t *)EEPROM_TX_PROFILE, tx_bank.active);
+}
+
+void tx_bank_print() {
+	char tmp[64];
+	if(!tx_bank.len) {
+		uart_puts_P("NO TX PROFILES.\r\n");
+		return;
+	}
+	for(uint8_t i = 0; i < tx_bank.len; i++) {
+		struct tx_bank_profile *profile = &tx_bank.profiles[i];
+		uint8_t mark = (i == tx_bank.active) ? '*' : ' ';
+		sprintf_P(tmp, PSTR("%c%u: ENC %u, SERIAL %07lX, CNT %u\r\n"), mark, i + 1, profile->encoder, profile->counter.serial, profile->counter.next);
+		uart_puts(tmp);
+	}
+}
+
 void remove_transmitter_rf() {
-	kl_rx_stop(&kl_ctx);
-	kl_rx_start(&kl_ctx); // start the keeloq rx
+	rx_stop_all();
+	rx_start_all(); // start the keeloq rx
 
 	// blink LED B during entire process
 	led_isrblink(ISR_LED_B_MASK, ISR_LED_BLINK_FAST_MS);
@@ -1363,20 +1993,21 @@ void remove_transmitter_rf() {
 	while(action_expecter_timer) {
 
 		// turn LED A on while button is pressed on a remote
-		if(kl_ctx.kl_rx_rf_act == KL_RF_ACT_BUSY) {
+		if(rx_rf_busy()) {
 			leda_on();
 		}
 
-		// receive a remote via RF
-		if(kl_ctx.kl_rx_rf_act == KL_RF_ACT_IDLE && kl_ctx.kl_rx_buff_state == KL_BUFF_FULL) {
+		// receive a remote via RF, on any of the channels
+		volatile struct keeloq_ctx *rx = rx_full_ctx();
+		if(rx && rx->kl_rx_rf_act == KL_RF_ACT_IDLE) {
 			leda_off();
 
-			kl_rx_stop(&kl_ctx); // stop keeloq rx
+			rx_stop_all(); // stop keeloq rx
 
 			// we only need to extract the serial number from this reception
 
 			struct KEELOQ_DECODE_PLAIN decoded;
-			keeloq_decode((uint8_t *)kl_ctx.kl_rx_buff, kl_ctx.kl_rx_buff_bit_index, 0, &decoded);
+			keeloq_decode((uint8_t *)rx->kl_rx_buff, rx->kl_rx_buff_bit_index, 0, &decoded);
 
 			// delete record from eeprom memory via PK: decoded.serial
 			uint8_t deleted = eedb_delete_record(&eedb_hcsdb, decoded.serial, 0, 0);
@@ -1392,7 +2023,7 @@ void remove_transmitter_rf() {
 
 			action_expecter_timer = BTN_REMOVE_REMOTE_EXPECTER; // reload
 
-			kl_rx_start(&kl_ctx); // re-start the keeloq rx
+			rx_start_all(); // re-start the keeloq rx
 		}
 	}
 
@@ -1400,8 +2031,8 @@ void remove_transmitter_rf() {
 	led_isrblink(ISR_LED_B_MASK, 0);
 	ledb_off();
 
-	kl_rx_stop(&kl_ctx);
-	kl_rx_start(&kl_ctx); // start the keeloq rx
+	rx_stop_all();
+	rx_start_all(); // start the keeloq rx
 }
 
 // clear corresponding memory depending on current operating mode
@@ -1416,6 +2047,7 @@ void clear_all_memory() {
 	if(option_state & OP_STATE_2) {
 		// delete only MITM emulation device
 		eedb_format_memory(&eedb_hcsmitm);
+		counter_block_reset(&mitm_counter_block);
 	}
 
 	// Grabber/logger
@@ -1430,18 +2062,38 @@ void clear_all_memory() {
 	}*/
 }
 
+// fresh profile for the encoder. serial comes from the allocator and was never handed out before, the key is derived from
+// the master crypt key and the serial the way a KeeLoq normal-learning decoder does it (keeloq_decode_learn_normal())
+uint8_t prog_profile_new(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile, uint8_t encoder) {
+	uint32_t serial = serial_alloc_take(&prog_serial_alloc);
+	if(!serial) {
+		return 0;
+	}
+
+	uint64_t key = keeloq_decode_learn_normal(serial, master_crypt_key);
+	prog_profile->encoder = encoder;
+	prog_profile->serial = serial;
+	prog_profile->crypt_key = key;
+
+	// seeds go out in the clear (secure learning), so they are ciphertexts under the chip's own key, nothing else
+	uint32_t seed = serial;
+	keeloq_encrypt(&seed, &key);
+	prog_profile->seed = seed;
+	keeloq_encrypt(&seed, &key);
+	prog_profile->seed2 = seed;
+	prog_profile->discrimination = serial; // its low bits, callers mask it
+	prog_profile->counter = 0;
+	prog_profile->config = 0x0000;
+
+	return 1;
+}
+
 uint8_t prog_n_enroll_66bit_hcs200(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
 	// create HCS chip programming profile
-	prog_profile->encoder = ENCODER_HCS200;
-	srandom(milliseconds);
-	prog_profile->crypt_key = ((uint64_t)random() << 32) | random();
-	delay_ms_(random() % 100); // randomize serial number with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->serial = random() & 0xFFFFFF; // 24bits
-	prog_profile->counter = 0;
-	delay_ms_(random() % 100); // randomize with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->discrimination = (uint16_t)random() & 0x0FFF; // 12 bits
+	if(!prog_profile_new(prog_profile, ENCODER_HCS200)) {
+		return 0;
+	}
+	prog_profile->discrimination &= 0x0FFF; // 12 bits
 	prog_profile->config = _BV(HCS200_CONFIG_VLOW) | (prog_profile->discrimination);
 
 	// program!
@@ -1450,17 +2102,10 @@ uint8_t prog_n_enroll_66bit_hcs200(struct KEELOQ_DECODE_PROG_PROFILE *prog_profi
 
 uint8_t prog_n_enroll_66bit_hcs201(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
 	// create HCS chip programming profile
-	prog_profile->encoder = ENCODER_HCS201;
-	srandom(milliseconds);
-	prog_profile->crypt_key = ((uint64_t)random() << 32) | random();
-	delay_ms_(random() % 100); // randomize serial number with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->serial = random() & 0xFFFFFF; // 24bits
-	prog_profile->counter = 0;
-	delay_ms_(random() % 100); // randomize with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->discrimination = (uint16_t)random() & 0x0FFF; // 12 bits
-	prog_profile->config = 0x0000;
+	if(!prog_profile_new(prog_profile, ENCODER_HCS201)) {
+		return 0;
+	}
+	prog_profile->discrimination &= 0x0FFF; // 12 bits
 
 	// program!
 	return prog_hcs_encoder(prog_profile);
@@ -1468,16 +2113,10 @@ uint8_t prog_n_enroll_66bit_hcs201(struct KEELOQ_DECODE_PROG_PROFILE *prog_profi
 
 uint8_t prog_n_enroll_66bit_hcs300_301_320(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
 	// create HCS chip programming profile
-	prog_profile->encoder = ENCODER_HCS300; // we assume it is HCS300
-	srandom(milliseconds);
-	prog_profile->crypt_key = ((uint64_t)random() << 32) | random();
-	delay_ms_(random() % 100); // randomize serial number with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->serial = random() & 0xFFFFFF; // 24bits
-	delay_ms_(random() % 100); // randomize with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->counter = 0;
-	prog_profile->discrimination = (uint16_t)random() & 0x03FF; // 10 bits
+	if(!prog_profile_new(prog_profile, ENCODER_HCS300)) { // we assume it is HCS300
+		return 0;
+	}
+	prog_profile->discrimination &= 0x03FF; // 10 bits
 	prog_profile->config = (_BV(HCS300_301_320_CONFIG_VLOW) | _BV(HCS300_301_320_CONFIG_OVR_0) | _BV(HCS300_301_320_CONFIG_OVR_1)) | (prog_profile->discrimination);
 
 	// program!
@@ -1486,35 +2125,332 @@ uint8_t prog_n_enroll_66bit_hcs300_301_320(struct KEELOQ_DECODE_PROG_PROFILE *pr
 
 uint8_t prog_n_enroll_67bit_hcs360_361(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
 	// create HCS chip programming profile
-	prog_profile->encoder = ENCODER_HCS360; // we assume it is HCS360
-	srandom(milliseconds);
-	prog_profile->crypt_key = ((uint64_t)random() << 32) | random();
-	delay_ms_(random() % 100); // randomize serial number with "unknown" seed
-	srandom(milliseconds);
-	prog_profile->serial = random() & 0xFFFFFF; // 24bits
+	if(!prog_profile_new(prog_profile, ENCODER_HCS360)) { // we assume it is HCS360
+		return 0;
+	}
 	prog_profile->discrimination = (uint8_t)prog_profile->serial & 0xFF;
-	prog_profile->counter = 0;
-	prog_profile->config = 0x0000;
 
 	// program!
 	return prog_hcs_encoder(prog_profile);
 }
 
+// starts programming, prog_ctx.kl_prog_state says when it is done and kl_prog_result how it went
 uint8_t prog_hcs_encoder(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
-	struct keeloq_prog_ctx prog_ctx;
-	prog_ctx.fn_get_data_pin_hw = &keeloq_prog_get_data_pin_hw;
-	prog_ctx.fn_prog_deinit_hw = &keeloq_prog_deinit_hw;
-	prog_ctx.fn_prog_init_hw = &keeloq_prog_init_hw;
-	prog_ctx.fn_set_clk_pin_hw = &keeloq_prog_set_clk_pin_hw;
-	prog_ctx.fn_set_data_pin_hw = &keeloq_prog_set_data_pin_hw;
-	kl_prog_init_ctx(&prog_ctx);
+	if(prog_ctx.kl_prog_state == KL_PROG_BUSY) {
+		return 0;
+	}
 
 	// build the stream
-	uint8_t prog_stream[24];
 	keeloq_decode_build_prog_stream(prog_stream, prog_profile);
 
-	// program and verify the hcs200 chip
-	return kl_prog(&prog_ctx, prog_stream, 192, 1);
+	struct keeloq_prog_timing timing;
+	prog_timing_load(prog_profile->encoder, &timing);
+	prog_ctx.kl_prog_timing = timing;
+	prog_last_encoder = prog_profile->encoder;
+
+	// program and verify the hcs chip, Timer2 does the rest
+	return kl_prog_start(&prog_ctx, prog_stream, 192, 1);
+}
+
+// encoder's calibrated programming timing, or its datasheet minimums with the default margin if it was never calibrated
+void prog_timing_load(uint8_t encoder, struct keeloq_prog_timing *timing) {
+	if(encoder >= PROG_TIMING_FIRST && encoder <= PROG_TIMING_LAST) {
+		struct prog_timing_slot slot;
+		eeprom_read_block(&slot, (uint8_t *)EEPROM_PROG_TIMING + (encoder - PROG_TIMING_FIRST) * sizeof(slot), sizeof(slot));
+		if(slot.magic == PROG_TIMING_MAGIC) {
+			*timing = slot.timing;
+			return;
+		}
+	}
+
+	kl_prog_timing_profile(encoder, KL_PROG_LEVEL_DEFAULT, timing);
+}
+
+void prog_timing_save(uint8_t encoder, uint8_t level, struct keeloq_prog_timing *timing) {
+	if(encoder < PROG_TIMING_FIRST || encoder > PROG_TIMING_LAST) {
+		return;
+	}
+
+	struct prog_timing_slot slot;
+	slot.magic = PROG_TIMING_MAGIC;
+	slot.level = level;
+	slot.timing = *timing;
+	eeprom_update_block(&slot, (uint8_t *)EEPROM_PROG_TIMING + (encoder - PROG_TIMING_FIRST) * sizeof(slot), sizeof(slot));
+}
+
+// finds the fastest programming timing the chip in the socket still takes, and stores it for the encoder.
+// steps the margin over the datasheet minimums down from the default, every step must program and verify
+// PROG_CALIB_PASSES times in a row. the level stored is PROG_CALIB_BACKOFF above the last one that passed, which
+// worked on this one sample only. the chip is left with a test pattern, it is a sample and not a product
+uint8_t prog_calibrate(uint8_t encoder) {
+	struct keeloq_prog_timing timing;
+	if(!kl_prog_timing_profile(encoder, KL_PROG_LEVEL_DEFAULT, &timing)) {
+		uart_puts_P("CALIBRATE: PROGRAM AN ENCODER FIRST.\r\n");
+		return 0;
+	}
+
+	// bits alternate as much as the layout lets them
+	struct KEELOQ_DECODE_PROG_PROFILE prog_profile;
+	prog_profile.encoder = encoder;
+	prog_profile.crypt_key = 0x55AA55AA55AA55AA;
+	prog_profile.serial = 0x0A55AA;
+	prog_profile.seed = 0x55AA55AA;
+	prog_profile.seed2 = 0xAA55;
+	prog_profile.counter = 0x5555;
+	prog_profile.discrimination = 0x02AA;
+	prog_profile.config = 0x0000;
+	keeloq_decode_build_prog_stream(prog_stream, &prog_profile);
+
+	char tmp[64];
+	uint8_t best = KL_PROG_LEVEL_MAX + 1;
+	uint8_t retries = prog_ctx.kl_prog_retries;
+	prog_ctx.kl_prog_retries = 0; // a retry would hide the failure
+
+	for(int8_t level = KL_PROG_LEVEL_DEFAULT; level >= 0; level--) {
+		kl_prog_timing_profile(encoder, level, &timing);
+		prog_ctx.kl_prog_timing = timing;
+
+		uint8_t passes = 0;
+		uint64_t started = milliseconds;
+		while(passes < PROG_CALIB_PASSES) {
+			kl_prog_start(&prog_ctx, prog_stream, 192, 1);
+			while(prog_ctx.kl_prog_state == KL_PROG_BUSY);
+			prog_ctx.kl_prog_state = KL_PROG_IDLE;
+			if(!prog_ctx.kl_prog_result) {
+				break;
+			}
+			passes++;
+		}
+
+		sprintf_P(tmp, PSTR("CALIBRATE LEVEL %u: %S, %lu ms EACH\r\n"), level, (passes == PROG_CALIB_PASSES) ? PSTR("OK") : PSTR("FAILED"), (uint32_t)((milliseconds - started) * 1024 / 1000 / (passes + (passes < PROG_CALIB_PASSES))));
+		uart_puts(tmp);
+		if(passes < PROG_CALIB_PASSES) {
+			prog_print_report();
+			break;
+		}
+		best = level;
+	}
+
+	prog_ctx.kl_prog_retries = retries;
+
+	if(best > KL_PROG_LEVEL_MAX) {
+		uart_puts_P("CALIBRATE: FAILED, NOTHING STORED.\r\n");
+		return 0;
+	}
+
+	uint8_t level = best + PROG_CALIB_BACKOFF;
+	if(level > KL_PROG_LEVEL_MAX) {
+		level = KL_PROG_LEVEL_MAX;
+	}
+	kl_prog_timing_profile(encoder, level, &timing);
+	prog_timing_save(encoder, level, &timing);
+	sprintf_P(tmp, PSTR("CALIBRATE: ENCODER %u STORED AT LEVEL %u (%u PASSED)\r\n"), encoder, level, best);
+	uart_puts(tmp);
+
+	return 1;
+}
+
+// programmed chip goes to the receiver's memory
+void prog_enroll(struct KEELOQ_DECODE_PROG_PROFILE *prog_profile) {
+	// create database entry to save it
+	struct eedb_hcs_record record;
+	record.counter = prog_profile->counter;
+	record.crypt_key = prog_profile->crypt_key;
+	record.discrimination = prog_profile->discrimination;
+	record.encoder = prog_profile->encoder;
+	record.serial = prog_profile->serial;
+
+	#ifdef DEBUG
+	char tmp[64];
+	sprintf_P(tmp, PSTR("SERIAL: %lu\r\n"), record.serial);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("DISC: %u\r\n"), record.discrimination);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("CNT: %u\r\n"), record.counter);
+	uart_puts(tmp);
+	#endif
+
+	// save to database
+	eedb_upsert_record(&eedb_hcsdb, prog_profile->serial, 0, 0, &record);
+}
+
+// single conversion of an ADC channel, AVcc reference
+static uint16_t jig_adc(uint8_t channel) {
+	// WARNING: this is where hardware abstraction is not possible
+	ADMUX = _BV(REFS0) | channel;
+	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // 1:128 prescaled, single conversion started
+	while(ADCSRA & _BV(ADSC)); // about 100us
+
+	return ADC;
+}
+
+// is there a chip in the production jig's socket: JIG_CHIP, JIG_EMPTY, or JIG_FLOATING if nothing drives ADC7.
+// a floating input reads whatever the sample and hold capacitor had, so it is left at mid-scale first
+uint8_t jig_read() {
+	jig_adc(JIG_PRECHARGE_ADC_CH);
+	uint16_t adc = jig_adc(JIG_DETECT_ADC_CH);
+
+	if(adc < JIG_RAIL_MARGIN) {
+		return JIG_CHIP;
+	}
+	if(adc > 1023 - JIG_RAIL_MARGIN) {
+		return JIG_EMPTY;
+	}
+	return JIG_FLOATING;
+}
+
+// jig_read(), but only if it reads the same rail every time for a while. JIG_FLOATING if there is no jig
+uint8_t jig_confirm() {
+	uint8_t state = jig_read();
+
+	for(uint8_t i = 1; i < JIG_CONFIRM_SAMPLES && state != JIG_FLOATING; i++) {
+		delay_ms_(JIG_CONFIRM_MS);
+		if(jig_read() != state) {
+			state = JIG_FLOATING;
+		}
+	}
+
+	return state;
+}
+
+// how the last chip went, if it did not go smoothly. word by word, for yield data
+void prog_print_report() {
+	if(prog_ctx.kl_prog_result && prog_ctx.kl_prog_attempt == 1) {
+		return;
+	}
+
+	char tmp[64];
+	sprintf_P(tmp, PSTR("PROG %S, ATTEMPTS: %u, FAILED WORDS: %u\r\n"), prog_ctx.kl_prog_result ? PSTR("OK") : PSTR("FAILED"), prog_ctx.kl_prog_attempt, prog_ctx.kl_prog_errors_len);
+	uart_puts(tmp);
+
+	// of the last verify
+	for(uint8_t i = 0; i < prog_ctx.kl_prog_errors_len && i < KL_PROG_ERRORS_LEN; i++) {
+		volatile struct keeloq_prog_word_error *err = &prog_ctx.kl_prog_errors[i];
+		sprintf_P(tmp, PSTR("    WORD %u: EXPECTED 0x%04X, READ 0x%04X, BITS 0x%04X\r\n"), err->word, err->expected, err->actual, err->expected ^ err->actual);
+		uart_puts(tmp);
+	}
+}
+
+void prog_batch_print() {
+	// ms ticker runs at 1.024ms
+	uint32_t elapsed_ms = (uint32_t)(((milliseconds - prog_batch.start_ms) * 1024) / 1000);
+	uint32_t per_hour = elapsed_ms ? (uint32_t)(((uint64_t)prog_batch.passed * 3600000UL) / elapsed_ms) : 0;
+
+	char tmp[80];
+	sprintf_P(tmp, PSTR("BATCH PASSED: %u (RETRIED %u), VERIFY FAILED: %u, NOT STARTED: %u\r\n"), prog_batch.passed, prog_batch.retried, prog_batch.failed_verify, prog_batch.failed_start);
+	uart_puts(tmp);
+	sprintf_P(tmp, PSTR("BATCH %lu CHIPS/H, %lu s, LAST SERIAL: %lu, ROOM: %u\r\n"), per_hour, elapsed_ms / 1000, prog_batch.last_serial, prog_batch.db_room);
+	uart_puts(tmp);
+}
+
+// program-verify-enroll every chip that gets into the production jig, until any button is pressed.
+// LED B blinks while waiting for a chip, LED C stays on after a good one and LED A after a bad one, until it is removed
+void prog_batch_run(uint8_t (*fn_prog)(struct KEELOQ_DECODE_PROG_PROFILE *)) {
+	struct KEELOQ_DECODE_PROG_PROFILE prog_profile;
+
+	// without a jig ADC7 floats, and noise on it would arm the programmer
+	uint8_t chip = jig_confirm();
+	if(chip == JIG_FLOATING) {
+		uart_puts_P("BATCH: NO JIG, ADC7 IS NOT PULLED TO EITHER RAIL.\r\n");
+		leda_blink(3);
+		clear_pending_buttons();
+		return;
+	}
+
+	memset(&prog_batch, 0, sizeof(prog_batch));
+	prog_batch.db_room = eedb_hcsdb.record_capacity - eedb_count_records(&eedb_hcsdb, EEDB_PKFK_ANY, EEDB_PKFK_ANY);
+	prog_batch.start_ms = milliseconds;
+	prog_batch.state = PROG_BATCH_WAIT_CHIP;
+	prog_batch.active = 1;
+	uart_puts_P("BATCH STARTED.\r\n");
+
+	action_expecter_timer = JIG_DEBOUNCE_MS;
+	ledb_off();
+	led_isrblink(ISR_LED_B_MASK, ISR_LED_BLINK_SLOW_MS);
+
+	while(1) {
+		// rest of the device keeps going
+		handle_uart_commands();
+		handle_ev_frames();
+
+		if(prog_ctx.kl_prog_state == KL_PROG_BUSY) {
+			continue;
+		}
+
+		// chip is done
+		if(prog_ctx.kl_prog_state == KL_PROG_DONE) {
+			prog_ctx.kl_prog_state = KL_PROG_IDLE;
+			prog_print_report();
+			if(prog_ctx.kl_prog_result) {
+				prog_enroll(&prog_profile);
+				prog_batch.passed++;
+				if(prog_ctx.kl_prog_attempt > 1) {
+					prog_batch.retried++;
+				}
+				prog_batch.db_room--;
+				prog_batch.last_serial = prog_profile.serial;
+				ledc_on();
+			}
+			else {
+				prog_batch.failed_verify++;
+				leda_on();
+			}
+			prog_batch_print();
+			prog_batch.state = PROG_BATCH_WAIT_REMOVE;
+		}
+
+		// any button ends it
+		if(btn_press || btn_hold) {
+			break;
+		}
+
+		// jig switch must settle first, a floating reading (jig unplugged) never arms or removes a chip
+		uint8_t present = jig_read();
+		if(present == JIG_FLOATING) {
+			action_expecter_timer = JIG_DEBOUNCE_MS;
+			continue;
+		}
+		if(present != chip) {
+			chip = present;
+			action_expecter_timer = JIG_DEBOUNCE_MS;
+			continue;
+		}
+		if(action_expecter_timer) {
+			continue;
+		}
+
+		// new chip
+		if(prog_batch.state == PROG_BATCH_WAIT_CHIP && chip == JIG_CHIP) {
+			led_isrblink(ISR_LED_B_MASK, 0);
+			ledb_off();
+			if(prog_batch.db_room && fn_prog(&prog_profile)) {
+				prog_batch.state = PROG_BATCH_PROGRAMMING;
+			}
+			else {
+				prog_batch.failed_start++;
+				uart_puts_P("BATCH: NO SERIAL OR NO ROOM LEFT.\r\n");
+				leda_on();
+				prog_batch.state = PROG_BATCH_WAIT_REMOVE;
+			}
+		}
+		// chip removed, ready for the next one
+		else if(prog_batch.state == PROG_BATCH_WAIT_REMOVE && chip == JIG_EMPTY) {
+			leda_off();
+			ledc_off();
+			led_isrblink(ISR_LED_B_MASK, ISR_LED_BLINK_SLOW_MS);
+			prog_batch.state = PROG_BATCH_WAIT_CHIP;
+		}
+	}
+
+	led_isrblink(ISR_LED_B_MASK, 0);
+	leda_off();
+	ledb_on(); // back in the programming menu
+	ledc_off();
+	clear_pending_buttons(); // clear any pending button press or hold
+
+	uart_puts_P("BATCH ENDED.\r\n");
+	prog_batch_print();
+	prog_batch.active = 0;
 }
 
 void update_settings_to_eeprom() {
@@ -1639,6 +2575,11 @@ void led_isrblink(uint8_t isr_led_mask, uint16_t rate) {
 
 // when programming has started
 void keeloq_prog_init_hw(uint8_t prog0_verify1) {
+	#if RX_CHANNELS > 1
+	// S0&S1 pin is the second receiver's pin as well, it is ours until keeloq_prog_deinit_hw()
+	RX2_PCMSKREG &= ~_BV(RX2_PCINTBIT);
+	#endif
+
 	HCS_PROG_S2CLK_DDR |= _BV(HCS_PROG_S2CLK_PIN); // clock pin is always output
 	HCS_PROG_S2CLK_PORT &= ~_BV(HCS_PROG_S2CLK_PIN); // =0
 
@@ -1684,6 +2625,53 @@ uint8_t keeloq_prog_get_data_pin_hw() {
 	return !!(HCS_PROG_DATA_PINREG & _BV(HCS_PROG_DATA_PIN));
 }
 
+// next chunk of the programmer's delay. at most 1ms at once, in 4us steps
+static void keeloq_prog_timer_arm() {
+	uint32_t us = prog_timer_left_us;
+	if(us > 1000) {
+		us = 1000;
+	}
+	prog_timer_left_us -= us;
+	uint8_t ticks = (us + 3) / 4; // never shorter than asked for
+	if(!ticks) {
+		ticks = 1;
+	}
+
+	// WARNING: this is where hardware abstraction is not possible
+	TCCR2B = 0; // stopped
+	TCNT2 = 0;
+	OCR2A = ticks - 1;
+	TIFR2 = _BV(OCF2A); // clear pending one
+	TCCR2A = _BV(WGM21); // CTC
+	TIMSK2 |= _BV(OCIE2A); // for ISR(TIMER2_COMPA_vect)
+	TCCR2B = _BV(CS22); // 1:64 prescaled, 4us ticks at 16MHz. timer started!
+}
+
+// programmer wants kl_prog_process() called after this many microseconds, 0 stops it
+void keeloq_prog_timer_hw(uint32_t us) {
+	// WARNING: this is where hardware abstraction is not possible
+	TCCR2B = 0; // stopped
+	TIMSK2 &= ~_BV(OCIE2A);
+
+	prog_timer_left_us = us;
+	if(us) {
+		keeloq_prog_timer_arm();
+	}
+}
+
+// programmer's progress, LED C toggles on every programmed and verified word. from the ISR!
+void keeloq_prog_progress(volatile struct keeloq_prog_ctx *ctx) {
+	if(ctx->kl_prog_phase == KL_PROG_PHASE_ENTER) {
+		setHigh(LEDC_PORT, LEDC_PIN);
+	}
+	else if(ctx->kl_prog_phase == KL_PROG_PHASE_END) {
+		setLow(LEDC_PORT, LEDC_PIN);
+	}
+	else if(ctx->kl_prog_bit_no) {
+		togglePin(LEDC_PORT, LEDC_PIN);
+	}
+}
+
 // when programming has ended
 void keeloq_prog_deinit_hw() {
 	// set back all pins to high impedance state - inputs
@@ -1698,6 +2686,16 @@ void keeloq_prog_deinit_hw() {
 	HCS_PROG_S0S1_PORT &= ~_BV(HCS_PROG_S0S1_PIN); // pullup off
 	HCS_PROG_S3_DDR &= ~_BV(HCS_PROG_S3_PIN); // S3 pin - input
 	HCS_PROG_S3_PORT &= ~_BV(HCS_PROG_S3_PIN); // pullup off
+
+	#if RX_CHANNELS > 1
+	// second receiver gets its pin back, if it is running
+	if(kl_ctx2.kl_rx_state != KL_RX_STOP) {
+		uint8_t sreg = SREG;
+		cli();
+		keeloq_rx2_init_hw();
+		SREG = sreg;
+	}
+	#endif
 }
 
 //////////////////////////////////// END: KEELOQ_PROG_LIB_CALLBACKS
@@ -1709,13 +2707,36 @@ void keeloq_rx_init_hw() {
 	// init RF RX pin to interrupt on-change
 	RX_DDR &= ~_BV(RX_PIN); 						// pin is input
 	RX_PORT |= _BV(RX_PIN); 						// turn ON internal pullup
+	rx_pins_prev = RX_PINREG;						// so the ISR knows which pin has changed
 	RX_PCMSKREG |= _BV(RX_PCINTBIT); 				// set (un-mask) PCINTn pin for interrupt on change
 	PCICR |= _BV(RX_PCICRBIT); 						// enable wanted PCICR
 }
 
 // when receiving is stopped
 void keeloq_rx_deinit_hw() {
-	PCICR &= ~_BV(RX_PCICRBIT); // disable interrupts for pin-change, but leave pin as input
+	RX_PCMSKREG &= ~_BV(RX_PCINTBIT); // disable interrupts for pin-change, but leave pin as input
+	// other receiver channel might still be using this PCICR
+	if(!RX_PCMSKREG) {
+		PCICR &= ~_BV(RX_PCICRBIT);
+	}
+}
+
+// when receiving is started on the second channel
+void keeloq_rx2_init_hw() {
+	RX2_DDR &= ~_BV(RX2_PIN); 						// pin is input
+	RX2_PORT |= _BV(RX2_PIN); 						// turn ON internal pullup
+	rx_pins_prev = RX2_PINREG;						// so the ISR knows which pin has changed
+	RX2_PCMSKREG |= _BV(RX2_PCINTBIT); 				// set (un-mask) PCINTn pin for interrupt on change
+	PCICR |= _BV(RX2_PCICRBIT); 					// enable wanted PCICR
+}
+
+// when receiving is stopped on the second channel
+void keeloq_rx2_deinit_hw() {
+	RX2_PCMSKREG &= ~_BV(RX2_PCINTBIT); // disable interrupts for pin-change, but leave pin as input
+	// other receiver channel might still be using this PCICR
+	if(!RX2_PCMSKREG) {
+		PCICR &= ~_BV(RX2_PCICRBIT);
+	}
 }
 
 // when transmission is started
@@ -1790,7 +2811,7 @@ ISR(TIMER0_OVF_vect, ISR_NOBLOCK)
 	}
 }
 
-// Interrupt: PWM process, output bit transitioned from 1 -> 0
+// Interrupt: OCR1A compare match, transmitter output pin has just toggled (or the guard time ended)
 // FOR TRANSMITTER
 ISR(TIMER1_COMPA_vect, ISR_NOBLOCK)
 {
@@ -1798,23 +2819,72 @@ ISR(TIMER1_COMPA_vect, ISR_NOBLOCK)
 	kl_tx_process(&kl_ctx);
 }
 
-// Interrupt: TIMER1 CTC EVENT
+// Interrupt: TIMER1 COMPARE B, periodic on the free-running timebase
 // FOR RECEIVER
-ISR(TIMER1_CAPT_vect, ISR_NOBLOCK)
+ISR(TIMER1_COMPB_vect, ISR_NOBLOCK)
 {
-	// tell library that pulse measurement has timed out
-	kl_rx_pulse_timeout(&kl_ctx);
+	OCR1B += KL_RX_POLL_TICKS; // schedule the next one
+
+	// no edge pass in the middle of the poll pass, see rx_dispatch.h. this can also come in the middle of an edge pass,
+	// which has the edges masked already
+	uint8_t pcicr = PCICR;
+	PCICR = pcicr & ~_BV(RX_PCICRBIT);
+
+	// let all decoders check if pulse measurement has timed out, on all channels
+	uint16_t now = TCNT1;
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		rx_dispatch_poll(&rx_disp[ch], now);
+	}
+
+	// unless the receivers were stopped in the meantime
+	if((pcicr & _BV(RX_PCICRBIT)) && RX_PCMSKREG) {
+		PCICR |= _BV(RX_PCICRBIT);
+	}
+}
+
+// Interrupt: TIMER2 COMPARE A, programmer's delay has expired
+// FOR PROGRAMMER
+ISR(TIMER2_COMPA_vect, ISR_NOBLOCK)
+{
+	TIMSK2 &= ~_BV(OCIE2A); // don't nest, it is re-armed below if needed
+
+	// long delays are made of more chunks
+	if(prog_timer_left_us) {
+		keeloq_prog_timer_arm();
+		return;
+	}
+	TCCR2B = 0; // stopped
+
+	// next step of programming, it re-arms the timer
+	kl_prog_process(&prog_ctx);
 }
 
 // Interrupt: pin change interrupt
 // FOR RECEIVER
 ISR(PCINT0_vect, ISR_NOBLOCK)
 {
-	// this is the only pin-change interrupt on PCINT2_vector, so we don't need
-	// to check if it is receiver or something else, because it IS the receiver
+	// edge pass must not nest, see rx_dispatch.h. an edge in the meantime sets PCIF0 and we are back right after
+	PCICR &= ~_BV(RX_PCICRBIT);
+
+	// one timestamp for all receivers, taken as soon as possible
+	uint16_t now = TCNT1;
 
-	// receiving a bit of transmission stream
-	kl_rx_process(&kl_ctx, !!(RX_PINREG & _BV(RX_PIN)));
+	// only receivers are on this pin-change vector, but there can be more than one of them
+	uint8_t pins = RX_PINREG;
+	uint8_t changed = pins ^ rx_pins_prev;
+	rx_pins_prev = pins;
+
+	// receiving a bit of transmission stream, every decoder of the channel gets it
+	for(uint8_t ch = 0; ch < RX_CHANNELS; ch++) {
+		if(changed & rx_pin_mask[ch]) {
+			rx_dispatch_edge(&rx_disp[ch], !!(pins & rx_pin_mask[ch]), now);
+		}
+	}
+
+	// unless the receivers were stopped in the meantime
+	if(RX_PCMSKREG) {
+		PCICR |= _BV(RX_PCICRBIT);
+	}
 }
 
 // Interrupt: pin change interrupt
@@ -16,6 +16,10 @@
 #include "keeloq_prog.h"
 #include "ee_db.h"
 #include "ee_db_record.h"
+#include "rawcap.h"
+#include "rx_dispatch.h"
+#include "ev1527.h"
+#include "rawtx.h"
 
 #define DEBUG 1
 
@@ -39,6 +43,9 @@
 #define EEPROM_MAGIC				(EEPROM_START + 0)				// eeprom OK - magic value
 #define EEPROM_OPTION_STATES		(EEPROM_MAGIC + 1)				// state of operating options
 #define EEPROM_MASTER_CRYPT_KEY		(EEPROM_OPTION_STATES + 1)		// master crypt key for learning encrypted HCS devices via RF
+#define EEPROM_TX_PROFILE			(EEPROM_MASTER_CRYPT_KEY + 8)	// selected transmitter emulator profile
+#define EEPROM_SERIAL_ALLOC			(EEPROM_TX_PROFILE + 1)			// next serial of programmed encoders, struct serial_alloc_slot
+#define EEPROM_PROG_TIMING			(EEPROM_SERIAL_ALLOC + sizeof(struct serial_alloc_slot))	// calibrated programming timing, struct prog_timing_slot for each of ENCODER_HCS200..ENCODER_HCS361
 
 #define EEPROM_MAGIC_VALUE			0xAA
 
@@ -47,7 +54,8 @@
 #define OP_STATE_2		0b00000010	// MITM upgrader
 #define OP_STATE_3		0b00000100	// Grab, collect
 #define OP_STATE_4		0b00001000	// Remote emulator from memory
-#define OP_STATE_LEN	4			// 4 options currently implemented
+#define OP_STATE_5		0b00010000	// Raw edge capture streamed over UART, for offline analysis
+#define OP_STATE_LEN	5			// 5 options currently implemented
 
 // RF IN data pin
 #define	RX_PIN			2
@@ -58,6 +66,21 @@
 #define	RX_PCMSKREG		PCMSK0
 #define	RX_PCICRBIT		PCIE0
 
+// Receiver channels, each one is an independent RF front-end with its own keeloq_ctx (e.g. 433MHz and 315/868MHz module).
+// all of them share the Timer1 timebase and must be on the same pin-change vector (PCINT0)
+#define RX_CHANNELS		1	// set to 2 when the second RF receiver module is wired to RX2 pin
+
+// second RF IN data pin PORTB.4
+// NOTE: on rev0 boards this pin is on the HCS programmer header (S0&S1), it is not populated with a receiver.
+// every PORTB pin on the PCINT0 vector is taken, so it stays shared: the second channel ignores it while programming
+#define	RX2_PIN			4
+#define	RX2_DDR			DDRB
+#define	RX2_PINREG		PINB
+#define	RX2_PORT		PORTB
+#define	RX2_PCINTBIT	PCINT4
+#define	RX2_PCMSKREG	PCMSK0
+#define	RX2_PCICRBIT	PCIE0
+
 // RF OUT data pin PORTB.1 (OC1A pin is data output)
 #define	TX_PIN			1
 #define	TX_DDR			DDRB
@@ -119,6 +142,35 @@
 #define BTNS2_MASK			0b00000100
 #define BTNS3_MASK			0b00001000
 
+// UART commands, single character each
+#define UART_CMD_RX_STATS			's'		// print receiver statistics
+#define UART_CMD_RX_STATS_CLEAR		'c'		// clear receiver statistics
+#define UART_CMD_RAW_RECORD			'r'		// record the next received frame with its exact timing, and store it
+#define UART_CMD_RAW_PLAY			'p'		// send the stored raw-timing frame
+#define UART_CMD_TX_PROFILE_NEXT	'n'		// transmitter emulator: select the next profile
+#define UART_CMD_TX_PROFILE_LIST	'l'		// transmitter emulator: list the profiles
+#define UART_CMD_BATCH_STATS		'b'		// batch programming: print the statistics
+#define UART_CMD_PROG_CALIBRATE		'k'		// programming menu only: calibrate programming timing on the chip in the socket, for the encoder programmed last
+
+#define RAWTX_PLAY_COUNT			4		// how many times the raw-timing frame goes out
+
+#define COUNTER_BLOCK_SIZE			32		// transmitter counter values reserved in EEPROM at once, see counter_block_take()
+
+#define TX_BANK_SIZE				16		// transmitter emulator profiles, all of them are cached in RAM (25 bytes each)
+#define TX_BANK_CHORD				0b00001111	// all four buttons held...
+#define TX_BANK_CHORD_MS			2000		// ...this long select the next transmitter emulator profile
+
+#define PROG_TIMING_MAGIC			0xA5		// prog_timing_slot is valid
+#define PROG_TIMING_FIRST			ENCODER_HCS200	// encoders with a prog_timing_slot in EEPROM
+#define PROG_TIMING_LAST			ENCODER_HCS361
+#define PROG_CALIB_PASSES			2			// calibration: every timing level must program and verify this many times in a row
+#define PROG_CALIB_BACKOFF			1			// calibration: levels above the fastest one that passed, that is what gets stored
+
+#define SERIAL_ALLOC_MAGIC			0x5A		// serial_alloc_slot is valid
+#define SERIAL_ALLOC_BLOCK_SIZE		16			// encoder serials reserved in EEPROM at once, see serial_alloc_take()
+#define SERIAL_ALLOC_FIRST			0x000001
+#define SERIAL_ALLOC_LAST			0xFFFFFF	// 24bits
+
 // Button related timers
 #define	BTN_HOLD_TMR						950		// miliseconds to pronounce button as held rather than pressed
 #define BTN_MODE_CHANGE_EXPECTER			15000	// ms to exit the mode-change.. mode
@@ -164,6 +216,21 @@
 #define	HCS_PROG_S3_PINREG		PINB
 #define	HCS_PROG_S3_PORT		PORTB
 
+// Production jig's chip-detect switch, closes to GND while a chip sits in the socket. needs an external pull-up.
+// every digital pin is taken, so it is on ADC7, an analog-only pin of the TQFP/MLF package. rev0 boards leave ADC7
+// unconnected, see README for the mod
+#define JIG_DETECT_ADC_CH		7
+#define JIG_PRECHARGE_ADC_CH	0b1110	// 1.1V bandgap, mid-scale. converted first, so a floating ADC7 does not read a rail
+#define JIG_RAIL_MARGIN			64		// ADC reading this close to GND: switch closed, to VCC: open. anything else: no jig
+#define JIG_CONFIRM_SAMPLES		4		// same rail reading this many times in a row before batch programming starts
+#define JIG_CONFIRM_MS			20		// between them
+#define JIG_DEBOUNCE_MS			150		// switch must be stable this long
+
+// jig_read()
+#define JIG_FLOATING			0		// ADC7 is not near either rail, no jig (or no pull-up)
+#define JIG_CHIP				1
+#define JIG_EMPTY				2
+
 // Code macros
 #define setInput(ddr, pin)		( (ddr) &= (uint8_t)~_BV(pin) )
 #define setOutput(ddr, pin)		( (ddr) |= (uint8_t)_BV(pin) )
@@ -198,8 +265,93 @@
 #define ISR_LED_BLINK_NORMAL_MS	400
 #define ISR_LED_BLINK_SLOW_MS	850
 
+// timing of one received frame, for picking the cleanest one of a burst
+struct rx_frame_timing {
+	uint16_t timing_element;
+	uint16_t header_length;
+	uint8_t quality; // see keeloq_ctx.kl_rx_quality
+};
+
+// counter values of one transmitter profile, handed out from RAM
+struct counter_block {
+	uint16_t eeaddr; // of the profile the block belongs to, EEDB_INVALID_ADDR if none
+	uint32_t serial; // of that profile, in case another one gets stored at the same address
+	uint16_t next; // next counter value to hand out
+	uint8_t left; // how many are still left in the block
+	uint8_t unsaved; // high-water mark of the block is not in EEPROM yet, see counter_block_reserve()
+};
+
+// transmitter emulator profile, everything encoding a frame needs, so that no EEPROM access is needed
+struct tx_bank_profile {
+	uint8_t encoder;
+	uint64_t crypt_key;
+	uint16_t discrimination; // serial3 for HCS101
+	uint16_t timing_element;
+	uint16_t header_length;
+	struct counter_block counter; // also has the serial, and where the profile is in eedb_hcstx
+};
+
+struct tx_bank {
+	struct tx_bank_profile profiles[TX_BANK_SIZE];
+	uint8_t len;
+	uint8_t active; // selected profile
+};
+
+// this is saved in internal EEPROM as it stands here
+// warning: do not re-arrange elements of this struct because it must match that in the EEPROM
+struct prog_timing_slot {
+	uint8_t magic; // PROG_TIMING_MAGIC if calibrated
+	uint8_t level; // see kl_prog_timing_profile()
+	struct keeloq_prog_timing timing;
+};
+
+// this is saved in internal EEPROM as it stands here
+// warning: do not re-arrange elements of this struct because it must match that in the EEPROM
+struct serial_alloc_slot {
+	uint8_t magic; // SERIAL_ALLOC_MAGIC once the first block is reserved
+	uint32_t serial_next; // first encoder serial not handed out yet, all below it were (or might have been)
+};
+
+// encoder serial numbers, handed out from RAM
+struct serial_alloc {
+	uint32_t next; // next serial to hand out
+	uint8_t left; // how many of the reserved ones are still left
+};
+
+// batch programming on the production jig
+enum PROG_BATCH_STATE
+{
+	PROG_BATCH_WAIT_CHIP = 0,
+	PROG_BATCH_PROGRAMMING = 1,
+	PROG_BATCH_WAIT_REMOVE = 2,
+};
+
+struct prog_batch {
+	uint8_t active;
+	enum PROG_BATCH_STATE state;
+	uint64_t start_ms; // when the batch started
+	uint32_t last_serial; // of the last chip that passed
+	uint16_t passed; // programmed, verified and enrolled
+	uint16_t retried; // passed, but not on the first attempt
+	uint16_t failed_verify;
+	uint16_t failed_start; // no serial or no room left to enroll it, chip was not touched
+	uint16_t db_room; // how many more chips can be enrolled
+};
+
 // misc stuff
 uint8_t next_within_window(uint16_t, uint16_t, uint16_t);
+void counter_block_reset(struct counter_block *);
+void counter_block_bind(struct counter_block *, uint16_t, uint32_t, uint16_t);
+uint16_t counter_block_take(struct counter_block *);
+void counter_block_reserve(struct counter_block *, volatile struct eedb_ctx *);
+uint32_t serial_alloc_take(struct serial_alloc *);
+uint8_t jig_read();
+uint8_t jig_confirm();
+uint8_t tx_emulator_buttons();
+void tx_bank_load();
+void tx_bank_select(uint8_t);
+void tx_bank_remember();
+void tx_bank_print();
 void clear_pending_buttons();
 uint8_t handle_ui_buttons();
 void misc_hw_init();
@@ -209,9 +361,15 @@ void delay_ms_(uint64_t);
 void show_number_on_leds(uint16_t);
 void handle_tx_emulator_buttons();
 void delay_builtin_ms_(uint16_t);
+void handle_uart_commands();
+void print_rx_stats(volatile struct keeloq_ctx *);
+void handle_raw_frames();
+void play_raw_frame();
+void send_rawcap_block();
 
-uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *, struct eedb_record_header *, struct eedb_hcs_record *, uint8_t *);
+uint8_t event_keydown(struct KEELOQ_DECODE_PLAIN *, struct eedb_record_header *, struct eedb_hcs_record *, volatile struct keeloq_ctx *);
 void event_keyup(struct KEELOQ_DECODE_PLAIN *, struct eedb_record_header *, struct eedb_hcs_record *);
+void event_burst_end(struct KEELOQ_DECODE_PLAIN *, struct rx_frame_timing *);
 
 // LED helpers
 void leda_on();
@@ -231,13 +389,40 @@ uint8_t prog_n_enroll_66bit_hcs201(struct KEELOQ_DECODE_PROG_PROFILE *);
 uint8_t prog_n_enroll_66bit_hcs300_301_320(struct KEELOQ_DECODE_PROG_PROFILE *);
 uint8_t prog_n_enroll_67bit_hcs360_361(struct KEELOQ_DECODE_PROG_PROFILE *);
 uint8_t prog_hcs_encoder(struct KEELOQ_DECODE_PROG_PROFILE *);
+uint8_t prog_profile_new(struct KEELOQ_DECODE_PROG_PROFILE *, uint8_t);
+void prog_enroll(struct KEELOQ_DECODE_PROG_PROFILE *);
+void prog_batch_run(uint8_t (*)(struct KEELOQ_DECODE_PROG_PROFILE *));
+void prog_batch_print();
+void prog_print_report();
+void prog_timing_load(uint8_t, struct keeloq_prog_timing *);
+void prog_timing_save(uint8_t, uint8_t, struct keeloq_prog_timing *);
+uint8_t prog_calibrate(uint8_t);
 void enroll_transmitter_rf();
 void remove_transmitter_rf();
 void clear_all_memory();
 
+// receiver channels helpers
+void rx_start_all();
+void rx_stop_all();
+uint8_t rx_rf_busy();
+volatile struct keeloq_ctx *rx_full_ctx();
+void tx_own_frame(uint8_t *);
+uint8_t rx_own_frame(volatile struct keeloq_ctx *);
+void handle_ev_frames();
+void rx_kl_edge(volatile void *, uint8_t, uint16_t);
+void rx_kl_poll(volatile void *, uint16_t);
+void rx_ev_edge(volatile void *, uint8_t, uint16_t);
+void rx_ev_poll(volatile void *, uint16_t);
+void rx_rawcap_edge(volatile void *, uint8_t, uint16_t);
+void rx_rawcap_poll(volatile void *, uint16_t);
+void rx_rawtx_edge(volatile void *, uint8_t, uint16_t);
+void rx_rawtx_poll(volatile void *, uint16_t);
+
 // hardware callbacks for keeloq library
 void keeloq_rx_init_hw();
 void keeloq_rx_deinit_hw();
+void keeloq_rx2_init_hw();
+void keeloq_rx2_deinit_hw();
 void keeloq_init_tx_hw();
 void keeloq_deinit_tx_hw();
 void keeloq_pin_tx_hw(uint8_t);
@@ -248,5 +433,7 @@ void keeloq_prog_set_clk_pin_hw(uint8_t);
 void keeloq_prog_set_data_pin_hw(uint8_t);
 uint8_t keeloq_prog_get_data_pin_hw();
 void keeloq_prog_deinit_hw();
+void keeloq_prog_timer_hw(uint32_t);
+void keeloq_prog_progress(volatile struct keeloq_prog_ctx *);
 
 #endif /* MAIN_H_ */
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ * rawcap.c
+ *
+ * Created: 19. 10. 2026. 10:02:27
+ *  Author: agent
+ *
+ * No hardware dependencies, caller provides the timestamps (free-running 16bit timer)
+ * and calls rawcap_poll() often enough for the timer not to wrap between two calls.
+ *
+ */
+
+#include "rawcap.h"
+
+void rawcap_init(volatile struct rawcap_ctx *ctx, uint16_t now) {
+	ctx->rc_len[0] = 0;
+	ctx->rc_len[1] = 0;
+	ctx->rc_lost[0] = 0;
+	ctx->rc_lost[1] = 0;
+	ctx->_rc_active = 0;
+	ctx->_rc_taken = RAWCAP_NONE;
+	ctx->_rc_lost = 0;
+	ctx->_rc_last = now;
+	ctx->_rc_pending = 0;
+	ctx->rc_edges = 0;
+	ctx->rc_lost_total = 0;
+}
+
+// call from the pin-change ISR. level is the new level of the pin, now is the timer value of the edge
+void rawcap_edge(volatile struct rawcap_ctx *ctx, uint8_t level, uint16_t now) {
+	uint32_t ticks = ctx->_rc_pending + (uint16_t)(now - ctx->_rc_last);
+	ctx->_rc_pending = 0;
+	ctx->_rc_last = now;
+	ctx->rc_edges++;
+
+	uint8_t b = ctx->_rc_active;
+
+	// active buffer full? hand it over to the main loop, if it is done with the other one
+	if(ctx->rc_len[b] > (RAWCAP_BUFF_LEN - RAWCAP_VARINT_MAX)) {
+		if(ctx->_rc_taken != RAWCAP_NONE) {
+			ctx->rc_lost_total++;
+			if(ctx->_rc_lost < 0xFF) {
+				ctx->_rc_lost++;
+			}
+			return;
+		}
+
+		ctx->_rc_taken = b;
+		b ^= 1;
+		ctx->_rc_active = b;
+		ctx->rc_len[b] = 0;
+		ctx->rc_lost[b] = ctx->_rc_lost;
+		ctx->_rc_lost = 0;
+	}
+
+	volatile uint8_t *p = &ctx->rc_buff[b][ctx->rc_len[b]];
+	uint8_t n = 0;
+
+	// pulse that just ended was of the opposite level
+	level = !level;
+
+	// typical pulses fit in 16 bits, don't bother the AVR with 32bit shifts for them
+	if(ticks < 0x8000) {
+		uint16_t v = ((uint16_t)ticks << 1) | level;
+		while(v > 0x7F) {
+			p[n++] = (uint8_t)v | 0x80;
+			v >>= 7;
+		}
+		p[n++] = (uint8_t)v;
+	}
+	else {
+		if(ticks > RAWCAP_TICKS_MAX) {
+			ticks = RAWCAP_TICKS_MAX;
+		}
+		uint32_t v = (ticks << 1) | level;
+		while(v > 0x7F) {
+			p[n++] = (uint8_t)v | 0x80;
+			v >>= 7;
+		}
+		p[n++] = (uint8_t)v;
+	}
+
+	ctx->rc_len[b] += n;
+}
+
+// call periodically (from a timer ISR), so that pauses longer than the 16bit timer period are measured correctly
+void rawcap_poll(volatile struct rawcap_ctx *ctx, uint16_t now) {
+	uint32_t pending = ctx->_rc_pending + (uint16_t)(now - ctx->_rc_last);
+	if(pending > RAWCAP_TICKS_MAX) {
+		pending = RAWCAP_TICKS_MAX;
+	}
+	ctx->_rc_pending = pending;
+	ctx->_rc_last = now;
+}
+
+// call from the main loop with interrupts disabled. returns the length of the buffer to send, 0 if nothing to send.
+// buffer to send is rc_buff[_rc_taken], with rc_lost[_rc_taken]. once sent, call rawcap_release()
+uint8_t rawcap_take(volatile struct rawcap_ctx *ctx) {
+	// nothing is waiting, take whatever is collected so far
+	if(ctx->_rc_taken == RAWCAP_NONE) {
+		uint8_t b = ctx->_rc_active;
+		if(!ctx->rc_len[b]) {
+			return 0; // lost edges, if any, will go out with the next block
+		}
+
+		ctx->_rc_taken = b;
+		b ^= 1;
+		ctx->_rc_active = b;
+		ctx->rc_len[b] = 0;
+		ctx->rc_lost[b] = ctx->_rc_lost;
+		ctx->_rc_lost = 0;
+	}
+
+	return ctx->rc_len[ctx->_rc_taken];
+}
+
+// main loop is done sending the buffer it took
+void rawcap_release(volatile struct rawcap_ctx *ctx) {
+	ctx->rc_len[ctx->_rc_taken] = 0;
+	ctx->rc_lost[ctx->_rc_taken] = 0;
+	ctx->_rc_taken = RAWCAP_NONE;
+}
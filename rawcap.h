@@ -0,0 +1,48 @@
+/*
+ * rawcap.h
+ *
+ * Created: 19. 10. 2026. 10:02:11
+ *  Author: agent
+ */
+
+#ifndef RAWCAP_H_
+#define RAWCAP_H_
+
+#include <stdio.h>
+#include <string.h>
+
+// Raw edge capture. Every edge of the RF receiver is turned into the length of the pulse that just ended
+// and packed into one of two buffers, so the main loop can send one while the ISR is filling the other.
+//
+// Stream format, as sent over the UART, is a sequence of blocks:
+//	[RAWCAP_BLOCK_SYNC] [payload length] [edges lost before this block, saturates at 255] [payload...]
+// payload is a sequence of unsigned LEB128 varints (7 bits per byte, LSB first, bit 7 set on all but the last byte)
+// and each varint is (pulse length in Timer1 ticks << 1) | pulse level. ticks are 0.5us on 16MHz.
+
+#define RAWCAP_BUFF_LEN			96		// two of these
+#define RAWCAP_VARINT_MAX		5		// (uint32_t << 1) is 33 bits, which fits in 5 varint bytes
+#define RAWCAP_BLOCK_SYNC		0xA5
+#define RAWCAP_TICKS_MAX		0x7FFFFFFF	// longer pulses are reported as this long
+#define RAWCAP_NONE				0xFF
+
+struct rawcap_ctx {
+	uint8_t rc_buff[2][RAWCAP_BUFF_LEN];
+	uint8_t rc_len[2]; // how much is in each of the buffers
+	uint8_t rc_lost[2]; // edges lost just before each of the buffers
+	uint8_t _rc_active; // internal usage, buffer the ISR is filling
+	uint8_t _rc_taken; // internal usage, buffer the main loop is sending, RAWCAP_NONE if none
+	uint8_t _rc_lost; // internal usage, edges lost since the last swap
+	uint16_t _rc_last; // internal usage, Timer1 value of the previous edge (or of the previous poll)
+	uint32_t _rc_pending; // internal usage, ticks folded by rawcap_poll() since the previous edge
+
+	uint32_t rc_edges; // statistics, rolls over
+	uint32_t rc_lost_total;
+};
+
+void rawcap_init(volatile struct rawcap_ctx *, uint16_t);
+void rawcap_edge(volatile struct rawcap_ctx *, uint8_t, uint16_t);
+void rawcap_poll(volatile struct rawcap_ctx *, uint16_t);
+uint8_t rawcap_take(volatile struct rawcap_ctx *);
+void rawcap_release(volatile struct rawcap_ctx *);
+
+#endif /* RAWCAP_H_ */
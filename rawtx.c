@@ -0,0 +1,146 @@
+/*
+ * rawtx.c
+ *
+ * Created: 19. 10. 2026. 18:12:58
+ *  Author: agent
+ *
+ * No hardware dependencies, caller provides the timestamps of the edges and polls periodically.
+ * Playback is up to the transmitter in keeloq.c (kl_tx_start_sched()).
+ *
+ */
+
+#include "rawtx.h"
+
+// record the next frame into sched. sched must not be on the air meanwhile
+void rawtx_arm(volatile struct rawtx_ctx *ctx, struct keeloq_tx_sched *sched) {
+	ctx->rt_state = RAWTX_IDLE;
+	ctx->rt_sched = sched;
+	ctx->_rt_gap = 0;
+	ctx->rt_state = RAWTX_ARMED;
+}
+
+void rawtx_stop(volatile struct rawtx_ctx *ctx) {
+	ctx->rt_state = RAWTX_IDLE;
+}
+
+// rising edge after a gap, first pulse of the frame begins
+static void rawtx_begin(volatile struct rawtx_ctx *ctx) {
+	struct keeloq_tx_sched *sched = ctx->rt_sched;
+
+	memset(sched->dur, 0, sizeof(sched->dur));
+	sched->dur[KL_TX_DUR_TE] = RAWTX_LEAD_IN_TICKS;
+	sched->code[0] = KL_TX_DUR_TE;
+	sched->len = 1;
+	ctx->_rt_header = 0;
+	ctx->rt_state = RAWTX_RECORDING;
+}
+
+// frame looks complete, this LOW is the last one
+static uint8_t rawtx_complete(volatile struct rawtx_ctx *ctx) {
+	struct keeloq_tx_sched *sched = ctx->rt_sched;
+	return ctx->_rt_header && (sched->len - ctx->_rt_header) >= (RAWTX_BITS_MIN * 2);
+}
+
+// LOW of the last bit and the guard time go out as one interval
+static void rawtx_finish(volatile struct rawtx_ctx *ctx, uint16_t guard) {
+	struct keeloq_tx_sched *sched = ctx->rt_sched;
+
+	sched->dur[KL_TX_DUR_TE_GUARD] = guard;
+	sched->code[sched->len++] = KL_TX_DUR_TE_GUARD;
+	sched->bitlen = (sched->len - ctx->_rt_header) >> 1;
+	sched->timing_element = sched->dur[KL_TX_DUR_HEADER] / 20; // TH is 10 x TE, for the outside world, in microseconds
+
+	ctx->rt_state = RAWTX_DONE;
+}
+
+// call on every edge, level is the new level of the pin, now is the timer value of the edge
+void rawtx_edge(volatile struct rawtx_ctx *ctx, uint8_t level, uint16_t now) {
+	uint16_t w = now - ctx->_rt_last_edge;
+	uint8_t gap = ctx->_rt_gap;
+	ctx->_rt_last_edge = now;
+	ctx->_rt_level = level;
+	ctx->_rt_gap = 0;
+
+	struct keeloq_tx_sched *sched = ctx->rt_sched;
+
+	switch(ctx->rt_state) {
+		case RAWTX_ARMED:
+			if(level && gap) {
+				rawtx_begin(ctx);
+			}
+		break;
+
+		case RAWTX_RECORDING:
+			// header, there is only one in a frame
+			if(level && !ctx->_rt_header && w >= KL_US2TICKS(KL_HEADER_MIN_WIDTH_US) && w <= RAWTX_GAP_TICKS) {
+				ctx->_rt_header = sched->len;
+				sched->dur[KL_TX_DUR_HEADER] = w;
+				sched->code[sched->len++] = KL_TX_DUR_HEADER;
+			}
+			else if(w < RAWTX_PULSE_MIN_TICKS || w > RAWTX_PULSE_MAX_TICKS || sched->len >= (KL_TX_SCHED_LEN - 1)) {
+				ctx->rt_state = RAWTX_ARMED; // not what we want, next frame then
+			}
+			else {
+				sched->code[sched->len++] = (w + (1 << (KL_TX_RAW_SHIFT - 1))) >> KL_TX_RAW_SHIFT; // rounded
+			}
+		break;
+
+		// next frame of the burst is here
+		case RAWTX_GUARD:
+			rawtx_finish(ctx, w);
+		break;
+
+		default:
+		break;
+	}
+}
+
+// call periodically, at least every RAWTX_GAP_TICKS
+void rawtx_poll(volatile struct rawtx_ctx *ctx, uint16_t now) {
+	if(ctx->rt_state == RAWTX_IDLE || ctx->rt_state == RAWTX_DONE || ctx->_rt_level) {
+		return;
+	}
+
+	uint16_t w = now - ctx->_rt_last_edge;
+
+	if(w > RAWTX_GAP_TICKS) {
+		ctx->_rt_gap = 1;
+
+		if(ctx->rt_state == RAWTX_RECORDING) {
+			ctx->rt_state = rawtx_complete(ctx) ? RAWTX_GUARD : RAWTX_ARMED;
+		}
+	}
+
+	// that was the last frame of the burst
+	if(ctx->rt_state == RAWTX_GUARD && w > RAWTX_GUARD_MAX_TICKS) {
+		rawtx_finish(ctx, RAWTX_GUARD_MAX_TICKS);
+	}
+}
+
+// data bits of a recorded frame, LSb first the way the transmitter takes them. returns how many
+uint8_t rawtx_bits(struct keeloq_tx_sched *sched, uint8_t *buff) {
+	memset(buff, 0, KL_BUFF_LEN);
+
+	// first bit right after the header
+	uint8_t i = 0;
+	while(i < sched->len && sched->code[i] != KL_TX_DUR_HEADER) {
+		i++;
+	}
+	i++;
+	if(i + 1 >= sched->len) {
+		return 0;
+	}
+
+	// bit 1 is HIGH for 1/3 of the bit period, bit 0 for 2/3. period of the first bit tells where the middle is,
+	// LOW of the last one includes the guard time so we can't have it from there
+	uint16_t half = (kl_tx_sched_ticks(sched, i) + kl_tx_sched_ticks(sched, i + 1)) >> 1;
+
+	uint8_t bits = 0;
+	for(; i < sched->len && bits < (KL_BUFF_LEN * 8); i += 2, bits++) {
+		if(kl_tx_sched_ticks(sched, i) < half) {
+			buff[bits >> 3] |= (1 << (bits & 7));
+		}
+	}
+
+	return bits;
+}
@@ -0,0 +1,57 @@
+/*
+ * rawtx.h
+ *
+ * Created: 19. 10. 2026. 18:12:37
+ *  Author: agent
+ */
+
+#ifndef RAWTX_H_
+#define RAWTX_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include "keeloq.h"
+
+// Raw-timing frames. One received frame is recorded pulse by pulse, exactly as it came out of the RF receiver,
+// straight into a transmitter schedule (see keeloq_tx_sched), so it can be stored and played back later by the
+// Timer1 compare ISR with the original transmitter's timing instead of one regenerated from TE and TH.
+// Pulses are one byte each, in units of (1 << KL_TX_RAW_SHIFT) ticks (4us). the header and the LOW of the last bit
+// together with the guard time are too long for that and go to the dur[] table of the schedule.
+//
+// Recording starts on the first rising edge after a LOW longer than any header, and ends with the LOW after the
+// data that is just as long. the pause until the next frame (or RAWTX_GUARD_MAX_TICKS) becomes the guard time.
+
+#define RAWTX_PULSE_MIN_TICKS		(KL_TX_DUR_CNT << KL_TX_RAW_SHIFT) // 20us, shorter one is a glitch and breaks the recording
+#define RAWTX_PULSE_MAX_TICKS		(0xFF << KL_TX_RAW_SHIFT) // 1020us, longer one (other than the header) breaks the recording
+#define RAWTX_GAP_TICKS				KL_US2TICKS(KL_HEADER_MAX_WIDTH_US) // LOW longer than this is between frames
+#define RAWTX_LEAD_IN_TICKS			KL_US2TICKS(1000) // LOW before the first recorded pulse on playback
+#define RAWTX_GUARD_MAX_TICKS		KL_US2TICKS(30000) // pause after the last frame of a burst is taken as this long
+#define RAWTX_BITS_MIN				(66)
+
+enum RAWTX_STATE
+{
+	RAWTX_IDLE = 0,
+	RAWTX_ARMED = 1, // waiting for a pause between frames
+	RAWTX_RECORDING = 2,
+	RAWTX_GUARD = 3, // frame is in, measuring the pause after it
+	RAWTX_DONE = 4, // rt_sched holds the frame
+};
+
+struct rawtx_ctx {
+	enum RAWTX_STATE rt_state;
+	struct keeloq_tx_sched *rt_sched; // recording goes here
+
+	uint16_t _rt_last_edge; // internal usage, timer value of the previous edge
+	uint8_t _rt_level; // internal usage, level of the pin since the previous edge
+	uint8_t _rt_gap; // internal usage, line has been LOW for longer than RAWTX_GAP_TICKS
+	uint8_t _rt_header; // internal usage, index of the header in the schedule, 0 if not seen yet
+};
+
+void rawtx_arm(volatile struct rawtx_ctx *, struct keeloq_tx_sched *);
+void rawtx_stop(volatile struct rawtx_ctx *);
+void rawtx_edge(volatile struct rawtx_ctx *, uint8_t, uint16_t);
+void rawtx_poll(volatile struct rawtx_ctx *, uint16_t);
+uint8_t rawtx_bits(struct keeloq_tx_sched *, uint8_t *);
+
+#endif /* RAWTX_H_ */
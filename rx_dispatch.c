@@ -0,0 +1,48 @@
+/*
+ * rx_dispatch.c
+ *
+ * Created: 19. 10. 2026. 15:31:22
+ *  Author: agent
+ */
+
+#include "rx_dispatch.h"
+
+// returns 0 if there is no more room, see RX_DISPATCH_MAX
+uint8_t rx_dispatch_register(struct rx_dispatch_ctx *rd, void (*fn_edge)(volatile void *, uint8_t, uint16_t), void (*fn_poll)(volatile void *, uint16_t), volatile void *ctx) {
+	if(rd->rd_decoders_len >= RX_DISPATCH_MAX) {
+		return 0;
+	}
+
+	struct rx_decoder *d = &rd->rd_decoders[rd->rd_decoders_len];
+	d->fn_edge = fn_edge;
+	d->fn_poll = fn_poll;
+	d->ctx = ctx;
+	rd->rd_decoders_len++;
+
+	return 1;
+}
+
+// call from the pin-change ISR, with the pin-change interrupt masked
+void rx_dispatch_edge(struct rx_dispatch_ctx *rd, uint8_t level, uint16_t now) {
+	rd->rd_busy = 1;
+	struct rx_decoder *d = rd->rd_decoders;
+	for(uint8_t i = rd->rd_decoders_len; i; i--, d++) {
+		d->fn_edge(d->ctx, level, now);
+	}
+	rd->rd_busy = 0;
+}
+
+// call from the periodic timer ISR, with the pin-change interrupt masked
+void rx_dispatch_poll(struct rx_dispatch_ctx *rd, uint16_t now) {
+	if(rd->rd_busy) {
+		return;
+	}
+	rd->rd_busy = 1;
+	struct rx_decoder *d = rd->rd_decoders;
+	for(uint8_t i = rd->rd_decoders_len; i; i--, d++) {
+		if(d->fn_poll) {
+			d->fn_poll(d->ctx, now);
+		}
+	}
+	rd->rd_busy = 0;
+}
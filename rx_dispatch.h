@@ -0,0 +1,38 @@
+/*
+ * rx_dispatch.h
+ *
+ * Created: 19. 10. 2026. 15:31:08
+ *  Author: agent
+ */
+
+#ifndef RX_DISPATCH_H_
+#define RX_DISPATCH_H_
+
+#include <stdio.h>
+
+// One receiver's edge stream fans out to all protocol decoders registered on it, in a single pass
+// from the one pin-change ISR. Each decoder has its own state machine and gets every edge (new pin
+// level and the timestamp of the edge) and every periodic poll (timestamp only).
+// Decoders don't have to be re-entrant, a pass never nests into another pass of the same receiver: the caller keeps the
+// pin-change interrupt masked during both passes (a masked edge still sets its flag and gets served right after, a bit
+// late), and a poll that comes in the middle of an edge pass is skipped, the next one catches up.
+
+#define RX_DISPATCH_MAX		3	// decoders per receiver
+
+struct rx_decoder {
+	void (*fn_edge)(volatile void *ctx, uint8_t level, uint16_t now);
+	void (*fn_poll)(volatile void *ctx, uint16_t now);
+	volatile void *ctx;
+};
+
+struct rx_dispatch_ctx {
+	struct rx_decoder rd_decoders[RX_DISPATCH_MAX];
+	uint8_t rd_decoders_len;
+	uint8_t rd_busy; // a pass is running
+};
+
+uint8_t rx_dispatch_register(struct rx_dispatch_ctx *, void (*)(volatile void *, uint8_t, uint16_t), void (*)(volatile void *, uint16_t), volatile void *);
+void rx_dispatch_edge(struct rx_dispatch_ctx *, uint8_t, uint16_t);
+void rx_dispatch_poll(struct rx_dispatch_ctx *, uint16_t);
+
+#endif /* RX_DISPATCH_H_ */
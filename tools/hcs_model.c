@@ -0,0 +1,293 @@
+/*
+ * hcs_model.c
+ *
+ * Created: 19. 10. 2026. 21:14:05
+ *  Author: agent
+ *
+ * Programming mode, as the datasheets draw it:
+ *	S2 (clock) goes high, PWM (data) follows after TPS and stays high for TPH1, goes low, and TPH2
+ *	later S2 goes low. The chip bulk erases for TPBW, then takes the words: 16 bits each, LSb first,
+ *	every bit latched on the falling clock edge. After the 16th bit it writes the word for TWC.
+ *	Once the last word is written the chip drives PWM itself and clocks them all out again, one bit
+ *	after every rising clock edge.
+ * Clock edges while the chip is erasing or writing are ignored, the bit they carried is lost and
+ * everything after it comes in shifted. That is what a too short TPBW or TWC does to a real chip.
+ */
+
+#include <string.h>
+
+#include "hcs_model.h"
+
+static uint32_t hcs_model_rnd(struct hcs_model *m) {
+	// xorshift64*
+	m->rnd_state ^= m->rnd_state >> 12;
+	m->rnd_state ^= m->rnd_state << 25;
+	m->rnd_state ^= m->rnd_state >> 27;
+	return (uint32_t)((m->rnd_state * 2685821657736338717ULL) >> 32);
+}
+
+static void hcs_model_violation(struct hcs_model *m, const char *what) {
+	m->violations++;
+	m->last_violation = what;
+}
+
+static void hcs_model_state(struct hcs_model *m, enum HCS_MODEL_STATE state, uint64_t now_us) {
+	m->state = state;
+	m->state_at = now_us;
+}
+
+// timing was off, the bit comes out as whatever
+static uint8_t hcs_model_garbage(struct hcs_model *m) {
+	return hcs_model_rnd(m) & 1;
+}
+
+// datasheet minimums, the same for all of them
+void hcs_model_datasheet(struct hcs_model_timing *timing) {
+	timing->ps_min = 3500;
+	timing->ps_max = 4500;
+	timing->ph1 = 3500;
+	timing->ph2 = 50;
+	timing->pbw = 4000;
+	timing->clkh = 50;
+	timing->clkl = 50;
+	timing->ds = 0;
+	timing->dh = 18;
+	timing->wc = 50000;
+	timing->dv = 30;
+}
+
+// erased chip, pins low. timing is the datasheet one if none given
+void hcs_model_init(struct hcs_model *m, struct hcs_model_timing *timing) {
+	uint64_t rnd_state = m->rnd_state ? m->rnd_state : 1;
+	double ber = m->ber;
+
+	memset(m, 0, sizeof(*m));
+	if(timing) {
+		m->timing = *timing;
+	}
+	else {
+		hcs_model_datasheet(&m->timing);
+	}
+	m->ber = ber;
+	m->rnd_state = rnd_state;
+	m->latched_word = HCS_MODEL_WORDS;
+}
+
+// programmer lets go of the pins, they are pulled low. what was written stays written
+void hcs_model_release(struct hcs_model *m) {
+	m->clk = 0;
+	m->data = 0;
+	m->ignore_fall = 0;
+	m->clkl_short = 0;
+	m->latched_word = HCS_MODEL_WORDS;
+	m->state = HCS_MODEL_IDLE;
+}
+
+// falling clock edge in the write mode, latches the data pin
+static void hcs_model_latch(struct hcs_model *m, uint64_t high_us, uint64_t now_us) {
+	uint8_t bit = m->data;
+
+	if(high_us < m->timing.clkh) {
+		hcs_model_violation(m, "TCLKH");
+		bit = hcs_model_garbage(m);
+	}
+	if(m->clkl_short) {
+		bit = hcs_model_garbage(m);
+	}
+	if(now_us - m->data_at < m->timing.ds) {
+		hcs_model_violation(m, "TDS");
+		bit = hcs_model_garbage(m);
+	}
+	if(m->ber > 0 && hcs_model_rnd(m) < m->ber * 4294967296.0) {
+		bit ^= 1;
+	}
+
+	m->word |= (uint16_t)bit << m->bits;
+	m->latched_at = now_us;
+	m->latched_word = m->words;
+	m->latched_bit = m->bits;
+	m->bits++;
+
+	if(m->bits == 16) {
+		m->mem[m->words++] = m->word;
+		m->word = 0;
+		m->bits = 0;
+		m->busy_until = now_us + m->timing.wc;
+
+		if(m->words == HCS_MODEL_WORDS) {
+			m->vbit = 0;
+			m->out = 0;
+			m->out_prev = 0;
+			m->out_valid_at = 0;
+			hcs_model_state(m, HCS_MODEL_VERIFY, now_us);
+		}
+	}
+}
+
+void hcs_model_clk(struct hcs_model *m, uint8_t level, uint64_t now_us) {
+	level = !!level;
+	if(level == m->clk) {
+		return;
+	}
+	uint64_t since_us = now_us - m->clk_at; // how long the previous level lasted
+	m->clk = level;
+	m->clk_at = now_us;
+
+	switch(m->state) {
+		case HCS_MODEL_IDLE:
+			if(level) {
+				hcs_model_state(m, HCS_MODEL_PS, now_us);
+			}
+		break;
+
+		// S2 released before PWM came, that was a button press
+		case HCS_MODEL_PS:
+			hcs_model_state(m, HCS_MODEL_IDLE, now_us);
+		break;
+
+		case HCS_MODEL_PH1:
+			hcs_model_violation(m, "TPH1");
+			hcs_model_state(m, HCS_MODEL_FAILED, now_us);
+		break;
+
+		case HCS_MODEL_PH2:
+			if(level || now_us - m->data_at < m->timing.ph2) {
+				hcs_model_violation(m, "TPH2");
+				hcs_model_state(m, HCS_MODEL_FAILED, now_us);
+			}
+			else {
+				// bulk erase
+				memset(m->mem, 0, sizeof(m->mem));
+				m->words = 0;
+				m->word = 0;
+				m->bits = 0;
+				m->latched_word = HCS_MODEL_WORDS;
+				m->busy_until = now_us + m->timing.pbw;
+				hcs_model_state(m, HCS_MODEL_WRITE, now_us);
+			}
+		break;
+
+		case HCS_MODEL_WRITE:
+		case HCS_MODEL_VERIFY:
+			if(level) {
+				m->ignore_fall = 0;
+				m->clkl_short = 0;
+				if(now_us < m->busy_until) {
+					hcs_model_violation(m, (m->words || m->state == HCS_MODEL_VERIFY) ? "TWC" : "TPBW");
+					m->ignore_fall = 1;
+					break;
+				}
+				if(since_us < m->timing.clkl && (m->bits || m->words)) {
+					hcs_model_violation(m, "TCLKL");
+					m->clkl_short = 1;
+				}
+
+				// next bit out, it takes TDV to get there
+				if(m->state == HCS_MODEL_VERIFY) {
+					m->out_prev = (now_us >= m->out_valid_at) ? m->out : m->out_prev;
+					m->out = (m->mem[m->vbit >> 4] >> (m->vbit & 0x0F)) & 1;
+					if(m->clkl_short) {
+						m->out = hcs_model_garbage(m);
+					}
+					m->out_valid_at = now_us + m->timing.dv;
+				}
+			}
+			else {
+				if(m->ignore_fall) {
+					m->ignore_fall = 0;
+				}
+				else if(m->state == HCS_MODEL_WRITE) {
+					hcs_model_latch(m, since_us, now_us);
+				}
+				else {
+					if(since_us < m->timing.clkh) {
+						hcs_model_violation(m, "TCLKH");
+					}
+					if(++m->vbit == HCS_MODEL_WORDS * 16) {
+						hcs_model_state(m, HCS_MODEL_DONE, now_us);
+					}
+				}
+			}
+		break;
+
+		// waits for the programmer to let go
+		case HCS_MODEL_DONE:
+		case HCS_MODEL_FAILED:
+		break;
+	}
+}
+
+void hcs_model_data(struct hcs_model *m, uint8_t level, uint64_t now_us) {
+	level = !!level;
+	if(level == m->data) {
+		return;
+	}
+	m->data = level;
+	m->data_at = now_us;
+
+	switch(m->state) {
+		case HCS_MODEL_IDLE:
+		break;
+
+		case HCS_MODEL_PS:
+			if(now_us - m->state_at < m->timing.ps_min || now_us - m->state_at > m->timing.ps_max) {
+				hcs_model_violation(m, "TPS");
+				hcs_model_state(m, HCS_MODEL_FAILED, now_us);
+			}
+			else {
+				hcs_model_state(m, HCS_MODEL_PH1, now_us);
+			}
+		break;
+
+		case HCS_MODEL_PH1:
+			if(now_us - m->state_at < m->timing.ph1) {
+				hcs_model_violation(m, "TPH1");
+				hcs_model_state(m, HCS_MODEL_FAILED, now_us);
+			}
+			else {
+				hcs_model_state(m, HCS_MODEL_PH2, now_us);
+			}
+		break;
+
+		case HCS_MODEL_PH2:
+			hcs_model_violation(m, "TPH2");
+			hcs_model_state(m, HCS_MODEL_FAILED, now_us);
+		break;
+
+		// changed too soon after the falling edge, the latch saw the new level
+		case HCS_MODEL_WRITE:
+			if(m->latched_word < HCS_MODEL_WORDS && now_us - m->latched_at < m->timing.dh) {
+				hcs_model_violation(m, "TDH");
+				uint16_t mask = (uint16_t)1 << m->latched_bit;
+				if(m->latched_word == m->words) {
+					m->word ^= mask;
+				}
+				else {
+					m->mem[m->latched_word] ^= mask;
+				}
+				m->latched_word = HCS_MODEL_WORDS;
+			}
+		break;
+
+		// both of them driving the pin
+		case HCS_MODEL_VERIFY:
+			hcs_model_violation(m, "BUS");
+		break;
+
+		case HCS_MODEL_DONE:
+		case HCS_MODEL_FAILED:
+		break;
+	}
+}
+
+// data pin as the programmer sees it, pulled low unless the chip drives it
+uint8_t hcs_model_read(struct hcs_model *m, uint64_t now_us) {
+	if(m->state != HCS_MODEL_VERIFY && m->state != HCS_MODEL_DONE) {
+		return 0;
+	}
+	if(now_us < m->out_valid_at) {
+		hcs_model_violation(m, "TDV");
+		return m->out_prev;
+	}
+	return m->out;
+}
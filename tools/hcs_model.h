@@ -0,0 +1,85 @@
+/*
+ * hcs_model.h
+ *
+ * Created: 19. 10. 2026. 21:12:40
+ *  Author: agent
+ *
+ * Model of the programming interface of an HCS2xx/3xx encoder, as seen on its S2 (clock) and
+ * PWM (data) pins: entering the programming mode, bulk erase, 16bit words clocked in LSb first
+ * and written for TWC each, then the verify readback. Every pin change comes with the simulated
+ * time in microseconds, timing the chip needs and does not get breaks it the way the chip would:
+ * bits get lost or latched wrong, or the chip never enters the programming mode.
+ */
+
+#ifndef HCS_MODEL_H_
+#define HCS_MODEL_H_
+
+#define HCS_MODEL_WORDS			12
+
+// what the chip needs, in microseconds
+struct hcs_model_timing {
+	uint32_t ps_min; // TPS, S2 high before PWM goes high
+	uint32_t ps_max;
+	uint32_t ph1; // TPH1, PWM high
+	uint32_t ph2; // TPH2, PWM low before S2 goes low
+	uint32_t pbw; // bulk erase, clock is ignored meanwhile
+	uint32_t clkh; // TCLKH
+	uint32_t clkl; // TCLKL
+	uint32_t ds; // TDS, data setup before the falling clock edge that latches it
+	uint32_t dh; // TDH, data hold after it
+	uint32_t wc; // word write, clock is ignored meanwhile
+	uint32_t dv; // TDV, data out is valid this long after the rising clock edge in verify
+};
+
+enum HCS_MODEL_STATE
+{
+	HCS_MODEL_IDLE = 0,
+	HCS_MODEL_PS,		// S2 high, waiting for PWM to go high
+	HCS_MODEL_PH1,		// PWM high
+	HCS_MODEL_PH2,		// PWM low again, waiting for S2 to go low
+	HCS_MODEL_WRITE,	// erasing, then taking words
+	HCS_MODEL_VERIFY,	// all words written, clocking them out
+	HCS_MODEL_DONE,		// all of them read back
+	HCS_MODEL_FAILED,	// did not enter the programming mode
+};
+
+struct hcs_model {
+	struct hcs_model_timing timing;
+	double ber; // marginal chip: probability of a bit being written wrong, even with the right timing
+	uint64_t rnd_state; // for ber and for bits latched with the wrong timing, never 0
+
+	enum HCS_MODEL_STATE state;
+	uint16_t mem[HCS_MODEL_WORDS];
+	uint8_t words; // written so far
+	uint16_t word; // being clocked in
+	uint8_t bits; // of it
+	uint8_t vbit; // verify: bit being clocked out
+
+	uint8_t clk;
+	uint8_t data; // driven by the programmer
+	uint8_t out; // driven by the chip in verify
+	uint8_t out_prev; // before out_valid_at
+	uint64_t out_valid_at;
+	uint64_t state_at; // when the state was entered
+	uint64_t clk_at; // last clock edge
+	uint64_t data_at; // last data change
+	uint64_t busy_until; // erase or word write
+	uint8_t ignore_fall; // rising edge was ignored, so is the falling one
+	uint8_t clkl_short; // clock was not low long enough before this bit
+	uint64_t latched_at; // falling clock edge that latched the last bit
+	uint8_t latched_word; // its word, HCS_MODEL_WORDS if none
+	uint8_t latched_bit; // and its index in the word
+
+	// what went wrong, for the statistics
+	uint32_t violations;
+	const char *last_violation;
+};
+
+void hcs_model_init(struct hcs_model *, struct hcs_model_timing *);
+void hcs_model_datasheet(struct hcs_model_timing *);
+void hcs_model_release(struct hcs_model *);
+void hcs_model_clk(struct hcs_model *, uint8_t, uint64_t);
+void hcs_model_data(struct hcs_model *, uint8_t, uint64_t);
+uint8_t hcs_model_read(struct hcs_model *, uint64_t);
+
+#endif /* HCS_MODEL_H_ */
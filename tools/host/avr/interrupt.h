@@ -0,0 +1,16 @@
+/*
+ * avr/interrupt.h (host)
+ *
+ * Created: 19. 10. 2026. 17:05:44
+ *  Author: agent
+ *
+ * There is nothing to interrupt a simulation, the tool calls the "ISRs" itself.
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#define cli()
+#define sei()
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,59 @@
+/*
+ * avr/io.h (host)
+ *
+ * Created: 19. 10. 2026. 11:40:05
+ *  Author: agent
+ *
+ * Stand-in for avr-libc's avr/io.h, so firmware modules compile on a PC for the tools in tools/.
+ * Only what those modules touch is here. Registers are plain variables (see avr_regs.c),
+ * the tool decides what TCNT1 reads.
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit)	(1 << (bit))
+
+// status register, only saved and restored around cli()
+extern volatile uint8_t SREG;
+
+// Timer1
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t ICR1;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TCCR1C;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+
+// TCCR1A
+#define WGM10	0
+#define WGM11	1
+#define COM1B0	4
+#define COM1B1	5
+#define COM1A0	6
+#define COM1A1	7
+// TCCR1B
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define WGM13	4
+// TCCR1C
+#define FOC1B	6
+#define FOC1A	7
+// TIMSK1 & TIFR1
+#define TOIE1	0
+#define OCIE1A	1
+#define OCIE1B	2
+#define ICIE1	5
+#define TOV1	0
+#define OCF1A	1
+#define OCF1B	2
+#define ICF1	5
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,22 @@
+/*
+ * avr_regs.c (host)
+ *
+ * Created: 19. 10. 2026. 11:41:12
+ *  Author: agent
+ *
+ * AVR registers that firmware modules touch, as plain variables.
+ */
+
+#include <avr/io.h>
+
+volatile uint8_t SREG;
+
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint16_t ICR1;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TCCR1C;
+volatile uint8_t TIMSK1;
+volatile uint8_t TIFR1;
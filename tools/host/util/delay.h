@@ -0,0 +1,16 @@
+/*
+ * util/delay.h (host)
+ *
+ * Created: 19. 10. 2026. 11:40:31
+ *  Author: agent
+ *
+ * Busy-wait delays make no sense in a simulation, they take no time at all here.
+ */
+
+#ifndef HOST_UTIL_DELAY_H_
+#define HOST_UTIL_DELAY_H_
+
+#define _delay_us(us)	((void)(us))
+#define _delay_ms(ms)	((void)(ms))
+
+#endif /* HOST_UTIL_DELAY_H_ */
@@ -0,0 +1,517 @@
+/*
+ * kl_bench.c
+ *
+ * Created: 19. 10. 2026. 14:20:45
+ *  Author: agent
+ *
+ * Synthetic trace generator and decode-rate benchmark for the receiver.
+ *
+ * Frames are made by keeloq_encode() for random serials/counters/buttons and rendered as the
+ * encoder would send them: preamble, header, PWM data bits, guard time. Then the impairments are
+ * applied, the trace is replayed through the firmware receiver (see replay.h) and every received
+ * frame is checked against what was sent. Same seed, same trace, so receiver changes can be
+ * compared against each other.
+ *
+ * Impairments (all relative to TE):
+ *	jitter		every edge moves by up to +/- jitter/2, so pulse widths vary by up to +/- jitter
+ *	stretch		HIGH pulses longer and LOW pulses shorter by this much, as cheap receivers do
+ *	drop		probability of a HIGH pulse going missing (both of its edges are lost)
+ *	glitch		average number of spurious 5-60us pulses (or gaps) per frame
+ *	cochannel	probability of another transmitter's frame overlapping this one (ASK, so levels are OR-ed)
+ *
+ * With -x the transmitter is measured instead: how long building the precomputed schedule of a frame
+ * takes, and how long each kl_tx_process() (the OCR1A compare ISR) takes, with Timer1 simulated.
+ *
+ * Build (from the repository root):
+ *	gcc -O2 -std=gnu99 -include stdint.h -Itools/host -Itools -I. -o kl_bench \
+ *		tools/kl_bench.c tools/replay.c tools/trace.c tools/host/avr_regs.c keeloq.c keeloq_decode.c keeloq_crypt.c -lm
+ *
+ * Usage:
+ *	kl_bench [-E encoder] [-T te] [-n frames] [-s seed] [-j %] [-S %] [-d %] [-g n] [-c %] [-w param] [-e] [-o trace] [-x]
+ *		-E encoder	101, 200, 300, 360, 362 or all (default, frames cycle through all of them)
+ *		-T te		TE in microseconds, default 400
+ *		-n frames	frames per measurement, default 1000
+ *		-s seed		random seed, default 1
+ *		-j -S -d	jitter, stretch and drop in percent
+ *		-g			glitches per frame
+ *		-c			co-channel overlap probability in percent
+ *		-w param	sweep one of jitter, stretch, drop, glitch, cochannel over its range, others stay as set
+ *		-e			poll timeouts at the device cadence (see kl_replay)
+ *		-o trace	only generate, write the trace (text, or binary for .bin/.raw) and exit
+ *		-x			measure the transmitter instead (uses -E, -T, -n and -s only)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "keeloq.h"
+#include "keeloq_decode.h"
+#include "trace.h"
+#include "replay.h"
+
+#define BENCH_PREAMBLE_TE		23		// 50% duty cycle, in TEs
+#define BENCH_HEADER_TE			10
+#define BENCH_GUARD_TE			39
+#define BENCH_FRAME_GAP_US		50000	// silence between the frames, so that each one is a transmission of its own
+#define BENCH_KEY				0x0123456789ABCDEFULL
+#define BENCH_MAX_EDGES			1024	// HIGH intervals per frame, including the impairments
+
+struct bench_params {
+	double te;
+	double jitter;
+	double stretch;
+	double drop;
+	double glitch;
+	double cochannel;
+};
+
+// sent frames, to check the received ones against
+struct bench_frame {
+	uint64_t start; // in ticks
+	uint8_t bits;
+	uint8_t buff[KL_BUFF_LEN];
+	uint8_t received;
+};
+
+struct bench_check {
+	struct bench_frame *frames;
+	uint32_t len;
+	uint32_t ok;
+	uint32_t wrong;
+};
+
+// HIGH intervals of a frame, in microseconds from the start of the frame
+struct interval {
+	double start;
+	double end;
+};
+
+static uint64_t rnd_state;
+
+static uint32_t rnd() {
+	// xorshift64*
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return (uint32_t)((rnd_state * 2685821657736338717ULL) >> 32);
+}
+
+static double rnd_uniform(double lo, double hi) {
+	return lo + (hi - lo) * (rnd() / 4294967296.0);
+}
+
+static const uint8_t encoders_all[] = { ENCODER_HCS101, ENCODER_HCS200, ENCODER_HCS300, ENCODER_HCS360, ENCODER_HCS362 };
+
+static uint8_t encoder_bits(uint8_t encoder) {
+	if(encoder == ENCODER_HCS362) return 69;
+	if(encoder == ENCODER_HCS360 || encoder == ENCODER_HCS361) return 67;
+	return 66;
+}
+
+// random frame of the given encoder
+static uint8_t make_frame(uint8_t encoder, uint8_t *buff) {
+	struct KEELOQ_DECODE_PLAIN plain;
+	memset(&plain, 0, sizeof(plain));
+	plain.serial = rnd() & 0x0FFFFFFF;
+	plain.serial3 = rnd() & 0x03FF;
+	plain.buttons = 1 + rnd() % 15;
+	plain.counter = rnd();
+	plain.discrimination = rnd() & 0x03FF;
+	plain.vlow = rnd() & 1;
+	plain.repeat = rnd() & 1;
+	plain.que = rnd() & 3;
+
+	memset(buff, 0, KL_BUFF_LEN);
+	keeloq_encode(encoder, &plain, (encoder == ENCODER_HCS101) ? 0 : BENCH_KEY, buff);
+
+	return encoder_bits(encoder);
+}
+
+// frame as the encoder sends it, returns the number of intervals and the length of the frame in *len
+static uint32_t render_frame(uint8_t *buff, uint8_t bits, double te, struct interval *iv, double *len) {
+	uint32_t n = 0;
+	double t = 0;
+
+	for(uint8_t i = 0; i < (BENCH_PREAMBLE_TE + 1) / 2; i++) {
+		iv[n].start = t;
+		iv[n].end = t + te;
+		n++;
+		t += 2 * te;
+	}
+	t += (BENCH_HEADER_TE - 1) * te; // last LOW of the preamble is part of the header already
+
+	// LSb first, 1 is 1 x TE HIGH and 2 x TE LOW, 0 is the opposite
+	for(uint8_t i = 0; i < bits; i++) {
+		uint8_t bit = buff[i / 8] & (1 << (i % 8));
+		iv[n].start = t;
+		iv[n].end = t + (bit ? te : 2 * te);
+		n++;
+		t += 3 * te;
+	}
+
+	*len = t + BENCH_GUARD_TE * te;
+	return n;
+}
+
+static int interval_cmp(const void *a, const void *b) {
+	const struct interval *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+// apply impairments to the intervals of one frame, returns the new number of intervals
+static uint32_t impair(struct interval *iv, uint32_t n, double len, struct bench_params *p) {
+	double te = p->te;
+
+	// co-channel, another transmitter somewhere within this frame
+	if(p->cochannel > 0 && rnd_uniform(0, 1) < p->cochannel) {
+		uint8_t other_buff[KL_BUFF_LEN];
+		uint8_t other_bits = make_frame(encoders_all[rnd() % sizeof(encoders_all)], other_buff);
+		double other_te = te * rnd_uniform(0.8, 1.2);
+		struct interval other[BENCH_MAX_EDGES / 2];
+		double other_len;
+		uint32_t m = render_frame(other_buff, other_bits, other_te, other, &other_len);
+		double offset = rnd_uniform(-other_len, len);
+		for(uint32_t i = 0; i < m && n < BENCH_MAX_EDGES; i++) {
+			iv[n].start = other[i].start + offset;
+			iv[n].end = other[i].end + offset;
+			n++;
+		}
+	}
+
+	// dropped pulses
+	if(p->drop > 0) {
+		uint32_t k = 0;
+		for(uint32_t i = 0; i < n; i++) {
+			if(rnd_uniform(0, 1) >= p->drop) {
+				iv[k++] = iv[i];
+			}
+		}
+		n = k;
+	}
+
+	// stretch and jitter
+	for(uint32_t i = 0; i < n; i++) {
+		iv[i].start += rnd_uniform(-0.5, 0.5) * p->jitter * te - 0.5 * p->stretch * te;
+		iv[i].end += rnd_uniform(-0.5, 0.5) * p->jitter * te + 0.5 * p->stretch * te;
+	}
+
+	// glitches, a short pulse in the LOW or a short gap in the HIGH, whichever it lands in
+	if(p->glitch > 0) {
+		double expected = p->glitch;
+		while(expected > 0 && n < BENCH_MAX_EDGES - 1) {
+			if(expected < 1 && rnd_uniform(0, 1) >= expected) {
+				break;
+			}
+			expected -= 1;
+
+			double at = rnd_uniform(0, len);
+			double width = rnd_uniform(5, 60);
+			uint32_t i;
+			for(i = 0; i < n; i++) {
+				if(at >= iv[i].start && at < iv[i].end) {
+					break;
+				}
+			}
+			if(i < n) {
+				iv[n].start = at + width;
+				iv[n].end = iv[i].end;
+				iv[i].end = at;
+				n++;
+			}
+			else {
+				iv[n].start = at;
+				iv[n].end = at + width;
+				n++;
+			}
+		}
+	}
+
+	// sort, merge overlapping (ASK: HIGH is HIGH), clip to the frame
+	qsort(iv, n, sizeof(struct interval), &interval_cmp);
+	uint32_t k = 0;
+	for(uint32_t i = 0; i < n; i++) {
+		double s = (iv[i].start < 0) ? 0 : iv[i].start;
+		double e = (iv[i].end > len) ? len : iv[i].end;
+		if(e - s < 1) {
+			continue;
+		}
+		if(k && s <= iv[k - 1].end) {
+			if(e > iv[k - 1].end) {
+				iv[k - 1].end = e;
+			}
+			continue;
+		}
+		iv[k].start = s;
+		iv[k].end = e;
+		k++;
+	}
+
+	return k;
+}
+
+static uint32_t us2ticks(double us) {
+	return (uint32_t)lround(us * 2);
+}
+
+// whole trace for one measurement
+static void generate(struct trace *t, struct bench_check *chk, const uint8_t *encoders, uint8_t encoders_len, uint32_t frames, struct bench_params *p) {
+	memset(t, 0, sizeof(struct trace));
+	chk->frames = calloc(frames, sizeof(struct bench_frame));
+	chk->len = frames;
+	chk->ok = 0;
+	chk->wrong = 0;
+
+	struct interval iv[BENCH_MAX_EDGES];
+	uint64_t now = 0;
+
+	for(uint32_t f = 0; f < frames; f++) {
+		struct bench_frame *bf = &chk->frames[f];
+		bf->bits = make_frame(encoders[f % encoders_len], bf->buff);
+
+		double len;
+		uint32_t n = render_frame(bf->buff, bf->bits, p->te, iv, &len);
+		n = impair(iv, n, len, p);
+
+		// silence before the frame, then the frame
+		double t_us = -BENCH_FRAME_GAP_US;
+		bf->start = now + us2ticks(BENCH_FRAME_GAP_US);
+		for(uint32_t i = 0; i < n; i++) {
+			uint32_t lo = us2ticks(iv[i].start - t_us);
+			uint32_t hi = us2ticks(iv[i].end - iv[i].start);
+			trace_append(t, 0, lo, 0);
+			trace_append(t, 1, hi, 0);
+			now += lo + hi;
+			t_us = iv[i].end;
+		}
+		uint32_t lo = us2ticks(len - t_us);
+		trace_append(t, 0, lo, 0);
+		now += lo;
+	}
+}
+
+// received frame belongs to the last frame that started before it
+static void check_frame(volatile struct keeloq_ctx *ctx, uint64_t now, void *user) {
+	struct bench_check *chk = user;
+
+	uint32_t lo = 0, hi = chk->len;
+	while(hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		if(chk->frames[mid].start <= now) lo = mid;
+		else hi = mid;
+	}
+
+	struct bench_frame *bf = &chk->frames[lo];
+	if(!bf->received && bf->start <= now && ctx->kl_rx_buff_bit_index == bf->bits && !memcmp((uint8_t *)ctx->kl_rx_buff, bf->buff, KL_BUFF_LEN)) {
+		bf->received = 1;
+		chk->ok++;
+	}
+	else {
+		chk->wrong++;
+	}
+}
+
+// transmitter hardware is simulated, there is nothing to init
+static void tx_hw_nop() {
+}
+
+static void tx_pin_nop(uint8_t pin_state) {
+	(void)pin_state;
+}
+
+static double elapsed_s(struct timespec *ts0, struct timespec *ts1) {
+	return (ts1->tv_sec - ts0->tv_sec) + (ts1->tv_nsec - ts0->tv_nsec) / 1e9;
+}
+
+// every compare match is served right when it happens, the way the ISR would be
+static void bench_tx(uint8_t *encoders, uint8_t encoders_len, uint32_t frames, double te) {
+	static struct keeloq_tx_sched sched;
+	static volatile struct keeloq_ctx ctx;
+	memset((void *)&ctx, 0, sizeof(ctx));
+	ctx.fn_tx_init_hw = &tx_hw_nop;
+	ctx.fn_tx_deinit_hw = &tx_hw_nop;
+	ctx.fn_tx_pin_hw = &tx_pin_nop;
+	ctx.kl_tx_sched_buff = &sched;
+	kl_init_ctx(&ctx);
+
+	double build_s = 0, isr_s = 0;
+	uint64_t isrs = 0;
+	uint64_t ticks = 0;
+	struct timespec ts0, ts1, ts2;
+
+	for(uint32_t f = 0; f < frames; f++) {
+		uint8_t buff[KL_BUFF_LEN];
+		uint8_t bits = make_frame(encoders[f % encoders_len], buff);
+
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts0);
+		if(!kl_tx_start(&ctx, buff, bits, (uint16_t)te, BENCH_PREAMBLE_TE, (uint16_t)(BENCH_HEADER_TE * te), (uint16_t)(BENCH_GUARD_TE * te))) {
+			fprintf(stderr, "kl_tx_start() failed, TE=%.0fus does not fit the transmitter\n", te);
+			exit(1);
+		}
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts1);
+
+		while(ctx.kl_tx_state == KL_TX_BUSY) {
+			ticks += (uint16_t)(OCR1A - TCNT1);
+			TCNT1 = OCR1A;
+			kl_tx_process(&ctx);
+			isrs++;
+		}
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts2);
+
+		build_s += elapsed_s(&ts0, &ts1);
+		isr_s += elapsed_s(&ts1, &ts2);
+	}
+
+	printf("TX: TE=%.0fus FRAMES=%u, %.3f s on the air\n", te, frames, ticks / 2000000.0);
+	printf("SCHEDULE BUILD: %.1f ns per frame\n", frames ? build_s * 1e9 / frames : 0);
+	printf("ISR: %llu calls, %.1f ns per call\n", (unsigned long long)isrs, isrs ? isr_s * 1e9 / isrs : 0);
+}
+
+static double *sweep_param(struct bench_params *p, const char *name, const double **values, uint8_t *len) {
+	static const double pct_jitter[] = { 0, 0.05, 0.10, 0.15, 0.20, 0.25, 0.30, 0.35, 0.40, 0.50 };
+	static const double pct_stretch[] = { 0, 0.10, 0.20, 0.30, 0.40, 0.50, 0.60, 0.70 };
+	static const double pct_drop[] = { 0, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05 };
+	static const double cnt_glitch[] = { 0, 0.5, 1, 2, 3, 5, 10 };
+	static const double pct_cochannel[] = { 0, 0.05, 0.10, 0.20, 0.50, 1.0 };
+
+	if(!strcmp(name, "jitter")) { *values = pct_jitter; *len = sizeof(pct_jitter) / sizeof(double); return &p->jitter; }
+	if(!strcmp(name, "stretch")) { *values = pct_stretch; *len = sizeof(pct_stretch) / sizeof(double); return &p->stretch; }
+	if(!strcmp(name, "drop")) { *values = pct_drop; *len = sizeof(pct_drop) / sizeof(double); return &p->drop; }
+	if(!strcmp(name, "glitch")) { *values = cnt_glitch; *len = sizeof(cnt_glitch) / sizeof(double); return &p->glitch; }
+	if(!strcmp(name, "cochannel")) { *values = pct_cochannel; *len = sizeof(pct_cochannel) / sizeof(double); return &p->cochannel; }
+	return 0;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: kl_bench [-E encoder] [-T te] [-n frames] [-s seed] [-j %%] [-S %%] [-d %%] [-g n] [-c %%] [-w param] [-e] [-o trace] [-x]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	struct bench_params p = { 400, 0, 0, 0, 0, 0 };
+	struct replay_opts opts = { 0, REPLAY_POLL_STRIDE, &check_frame, 0 };
+	uint8_t encoders[sizeof(encoders_all)];
+	uint8_t encoders_len = sizeof(encoders_all);
+	memcpy(encoders, encoders_all, sizeof(encoders_all));
+	uint32_t frames = 1000;
+	uint64_t seed = 1;
+	const char *sweep = 0;
+	const char *out = 0;
+	uint8_t tx = 0;
+	int c;
+
+	while((c = getopt(argc, argv, "E:T:n:s:j:S:d:g:c:w:eo:x")) != -1) {
+		switch(c) {
+			case 'E':
+				if(strcmp(optarg, "all")) {
+					uint16_t hcs = atoi(optarg);
+					encoders_len = 1;
+					if(hcs == 101) encoders[0] = ENCODER_HCS101;
+					else if(hcs == 200) encoders[0] = ENCODER_HCS200;
+					else if(hcs == 300) encoders[0] = ENCODER_HCS300;
+					else if(hcs == 360) encoders[0] = ENCODER_HCS360;
+					else if(hcs == 362) encoders[0] = ENCODER_HCS362;
+					else usage();
+				}
+			break;
+			case 'T': p.te = atof(optarg); break;
+			case 'n': frames = strtoul(optarg, 0, 10); break;
+			case 's': seed = strtoull(optarg, 0, 10); break;
+			case 'j': p.jitter = atof(optarg) / 100; break;
+			case 'S': p.stretch = atof(optarg) / 100; break;
+			case 'd': p.drop = atof(optarg) / 100; break;
+			case 'g': p.glitch = atof(optarg); break;
+			case 'c': p.cochannel = atof(optarg) / 100; break;
+			case 'w': sweep = optarg; break;
+			case 'e': opts.poll_stride = KL_RX_POLL_TICKS; break;
+			case 'o': out = optarg; break;
+			case 'x': tx = 1; break;
+			default: usage();
+		}
+	}
+	if(optind != argc || !frames || p.te <= 0) {
+		usage();
+	}
+
+	// transmitter only
+	if(tx) {
+		rnd_state = seed ? seed : 1;
+		bench_tx(encoders, encoders_len, frames, p.te);
+		return 0;
+	}
+
+	const double *values = 0;
+	uint8_t values_len = 1;
+	double *swept = 0;
+	if(sweep) {
+		swept = sweep_param(&p, sweep, &values, &values_len);
+		if(!swept) {
+			usage();
+		}
+	}
+
+	// generator only
+	if(out) {
+		struct trace t;
+		struct bench_check chk;
+		rnd_state = seed ? seed : 1;
+		generate(&t, &chk, encoders, encoders_len, frames, &p);
+
+		const char *ext = strrchr(out, '.');
+		uint8_t bin = ext && (!strcmp(ext, ".bin") || !strcmp(ext, ".raw"));
+		FILE *f = fopen(out, bin ? "wb" : "w");
+		if(!f || !(bin ? trace_write_bin(f, &t) : trace_write_text(f, &t))) {
+			perror(out);
+			return 1;
+		}
+		fclose(f);
+
+		free(chk.frames);
+		trace_free(&t);
+		return 0;
+	}
+
+	printf("TE=%.0fus JITTER=%.0f%% STRETCH=%.0f%% DROP=%.1f%% GLITCH=%.1f COCHANNEL=%.0f%% FRAMES=%u SEED=%llu\n",
+		p.te, p.jitter * 100, p.stretch * 100, p.drop * 100, p.glitch, p.cochannel * 100, frames, (unsigned long long)seed);
+	if(sweep) {
+		printf("%10s %8s %8s %8s %8s\n", sweep, "SENT", "OK", "RATE%", "WRONG");
+	}
+
+	struct replay_result total;
+	memset(&total, 0, sizeof(total));
+
+	for(uint8_t v = 0; v < values_len; v++) {
+		if(swept) {
+			*swept = values[v];
+		}
+
+		// same seed for every point, so the only difference is the impairment
+		struct trace t;
+		struct bench_check chk;
+		rnd_state = seed ? seed : 1;
+		generate(&t, &chk, encoders, encoders_len, frames, &p);
+
+		opts.user = &chk;
+		replay_run(&t, &opts, &total);
+
+		double rate = 100.0 * chk.ok / chk.len;
+		if(sweep) {
+			printf("%10g %8u %8u %8.2f %8u\n", (swept == &p.glitch) ? values[v] : values[v] * 100, chk.len, chk.ok, rate, chk.wrong);
+		}
+		else {
+			printf("SENT: %u, OK: %u (%.2f%%), WRONG: %u\n", chk.len, chk.ok, rate, chk.wrong);
+		}
+
+		free(chk.frames);
+		trace_free(&t);
+	}
+
+	double sim_s = total.ticks / 2000000.0;
+	printf("THROUGHPUT: %u edges, %.3f s simulated in %.3f s CPU (%.0f x real time), %.1f ns per edge\n",
+		total.edges, sim_s, total.cpu_s, total.cpu_s ? sim_s / total.cpu_s : 0, total.edges ? total.cpu_s * 1e9 / total.edges : 0);
+
+	return 0;
+}
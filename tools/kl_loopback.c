@@ -0,0 +1,519 @@
+/*
+ * kl_loopback.c
+ *
+ * Created: 19. 10. 2026. 19:05:14
+ *  Author: agent
+ *
+ * Host loopback of the whole radio path: keeloq_encode() -> kl_tx_process() -> virtual OC1A pin ->
+ * kl_rx_process() -> keeloq_decode(). Nothing in between is modelled but the pin and Timer1, so this
+ * is the firmware transmitter and receiver talking to each other. Every frame must come back bit-exact
+ * and decode to the very same fields it was encoded from, otherwise the exit code is 1.
+ *
+ * Timer1 is a free-running 16bit counter of 0.5us ticks again, shared by both directions: the OCR1A
+ * compare (transmitter) and the receiver polls every KL_RX_POLL_TICKS (OCR1B) are served in the order
+ * they come, as the ISRs would. The pin toggles on the compare match while COM1A is in toggle mode,
+ * FOC1A forces it low, and without COM1A bits it is the port, which is low.
+ *
+ * Build (from the repository root):
+ *	gcc -O2 -std=gnu99 -include stdint.h -Itools/host -I. -o kl_loopback \
+ *		tools/kl_loopback.c tools/host/avr_regs.c keeloq.c keeloq_decode.c keeloq_crypt.c
+ *
+ * Usage:
+ *	kl_loopback [-E encoder] [-T te] [-n frames] [-s seed] [-v] [-m | -q] [-L us]
+ *		-E encoder	101, 200, 201, 300, 301, 320, 360, 361, 362 or all (default, frames cycle through all of them)
+ *		-T te		TE in microseconds, default 400
+ *		-n frames	frames per encoder, default 1000
+ *		-s seed		random seed, default 1
+ *		-v			print every frame that did not make it
+ *		-m			measure every pulse on the pin against what was requested (TE, 2 x TE, header, guard time),
+ *					print the deviations of each transmission, and the summary of all of them
+ *		-L us		the compare ISR runs up to this late (random), as if other ISRs were holding it up. pulses stay exact
+ *					as long as the ISR moves OCR1A before TCNT1 gets there, a compare it sets too late is missed
+ *		-q			one transmission of all frames: kl_tx_enqueue() keeps the transmit queue full, so frames of
+ *					different encoders (and bit lengths) follow each other back to back
+ *
+ * Each frame is a transmission of its own, the next one starts right after the guard time of the previous one,
+ * which is where the receiver has to finish it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "keeloq.h"
+#include "keeloq_decode.h"
+
+#define LOOP_PREAMBLE			12		// pairs of TE LOW + TE HIGH, as the transmitter emulator sends
+#define LOOP_HEADER_TE			10
+#define LOOP_GUARD_TE			39
+#define LOOP_KEY				0x0123456789ABCDEFULL
+
+static const uint8_t encoders_all[] = {
+	ENCODER_HCS101, ENCODER_HCS200, ENCODER_HCS201, ENCODER_HCS300, ENCODER_HCS301,
+	ENCODER_HCS320, ENCODER_HCS360, ENCODER_HCS361, ENCODER_HCS362
+};
+static const uint16_t encoder_names[] = { 101, 200, 201, 300, 301, 320, 360, 361, 362 };
+
+// what went on the air, to check the received frame against
+struct loop_frame {
+	uint8_t encoder;
+	uint8_t bits;
+	uint8_t buff[KL_BUFF_LEN];
+	struct KEELOQ_DECODE_PLAIN plain;
+	uint8_t received;
+};
+
+struct loop_stats {
+	uint32_t sent;
+	uint32_t ok;
+};
+
+// pulse widths on the pin, against the requested ones
+enum MEAS_KIND {
+	MEAS_PREAMBLE = 0,
+	MEAS_HEADER,
+	MEAS_TE,	// data bits
+	MEAS_2TE,
+	MEAS_GUARD,	// LOW of the last bit + guard time
+	MEAS_KINDS
+};
+
+static const char *meas_names[MEAS_KINDS] = { "PREAMBLE", "HEADER", "TE", "2TE", "GUARD" };
+
+struct meas_stats {
+	uint32_t n;
+	double dev_sum; // microseconds, measured - requested
+	double dev_max; // largest absolute one
+	uint32_t missing; // pulses that were requested, but did not come out (or vice versa)
+};
+
+#define MEAS_EDGES_MAX			((LOOP_PREAMBLE * 2) + (KL_BUFF_LEN * 8 * 2) + 4)
+
+static volatile struct keeloq_ctx tx_ctx;
+static volatile struct keeloq_ctx rx_ctx;
+static struct keeloq_tx_sched tx_sched;
+static struct keeloq_tx_queue tx_queue;
+
+static uint64_t sim_now;
+static uint64_t tx_isr_at; // when the last compare ISR read TCNT1, it may run late (-L)
+static uint8_t pin;
+static uint8_t verbose;
+
+static uint8_t measure;
+static uint64_t meas_edges[MEAS_EDGES_MAX]; // of the transmission on the air
+static uint16_t meas_edges_len;
+
+static uint64_t rnd_state;
+
+static uint32_t rnd() {
+	// xorshift64*
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return (uint32_t)((rnd_state * 2685821657736338717ULL) >> 32);
+}
+
+// hardware is simulated, there is nothing to init
+static void hw_nop() {
+}
+
+static void tx_pin_nop(uint8_t pin_state) {
+	(void)pin_state;
+}
+
+static uint8_t encoder_bits(uint8_t encoder) {
+	if(encoder == ENCODER_HCS362) return 69;
+	if(encoder == ENCODER_HCS360 || encoder == ENCODER_HCS361) return 67;
+	return 66;
+}
+
+static void make_frame(uint8_t encoder, struct loop_frame *lf) {
+	memset(lf, 0, sizeof(struct loop_frame));
+	lf->encoder = encoder;
+	lf->plain.serial = rnd() & 0x0FFFFFFF;
+	lf->plain.serial3 = rnd() & 0x03FF;
+	lf->plain.buttons = 1 + rnd() % 15;
+	lf->plain.counter = rnd();
+	lf->plain.discrimination = rnd() & 0x0FFF;
+	lf->plain.vlow = rnd() & 1;
+	lf->plain.repeat = rnd() & 1;
+	lf->plain.que = rnd() & 3;
+
+	keeloq_encode(encoder, &lf->plain, (encoder == ENCODER_HCS101) ? 0 : LOOP_KEY, lf->buff);
+	lf->bits = encoder_bits(encoder);
+}
+
+// received frame must be the sent one, and decode to what it was encoded from
+static uint8_t check_frame(struct loop_frame *lf) {
+	if(rx_ctx.kl_rx_buff_bit_index != lf->bits || memcmp((uint8_t *)rx_ctx.kl_rx_buff, lf->buff, KL_BUFF_LEN)) {
+		return 0;
+	}
+
+	uint64_t key = (lf->encoder == ENCODER_HCS101) ? 0 : LOOP_KEY;
+	struct KEELOQ_DECODE_PLAIN d;
+	memset(&d, 0, sizeof(d));
+	if(!keeloq_decode((uint8_t *)rx_ctx.kl_rx_buff, rx_ctx.kl_rx_buff_bit_index, key, &d)) {
+		return 0;
+	}
+
+	struct KEELOQ_DECODE_PLAIN *p = &lf->plain;
+	if(d.serial != p->serial || d.buttons != p->buttons || d.vlow != p->vlow || d.counter != p->counter || d.buttons_enc != p->buttons) {
+		return 0;
+	}
+	if(key) {
+		// HCS360/361 put the lower 12 bits of the serial in place of the discrimination
+		uint16_t disc = (lf->encoder == ENCODER_HCS360 || lf->encoder == ENCODER_HCS361) ? (p->serial & 0x0FFF) : p->discrimination;
+		if(d.discrimination != disc) {
+			return 0;
+		}
+	}
+	else if(d.serial3 != p->serial3) {
+		return 0;
+	}
+	if(lf->bits == 66 && lf->encoder != ENCODER_HCS101 && !d.repeat != !p->repeat) {
+		return 0;
+	}
+	if(lf->bits == 69 && d.que != p->que) {
+		return 0;
+	}
+
+	return 1;
+}
+
+// receiver polls (OCR1B ISR) up to "until", and what the main loop would do after each of them.
+// received frame is one of the lf_len frames that can be on the air
+static void loop_poll(uint64_t until, uint64_t *next_poll, struct loop_frame *lf, uint32_t lf_len) {
+	while(*next_poll <= until) {
+		sim_now = *next_poll;
+		TCNT1 = (uint16_t)sim_now;
+		kl_rx_poll(&rx_ctx, (uint16_t)sim_now);
+		if(rx_ctx.kl_rx_buff_state == KL_BUFF_FULL) {
+			for(uint32_t i = 0; i < lf_len; i++) {
+				if(!lf[i].received && check_frame(&lf[i])) {
+					lf[i].received = 1;
+					break;
+				}
+			}
+			kl_rx_flush(&rx_ctx);
+		}
+		*next_poll += KL_RX_POLL_TICKS;
+	}
+}
+
+static void set_pin(uint8_t level) {
+	if(level == pin) {
+		return;
+	}
+	pin = level;
+	if(measure && meas_edges_len < MEAS_EDGES_MAX) {
+		meas_edges[meas_edges_len++] = sim_now;
+	}
+	TCNT1 = (uint16_t)sim_now;
+	kl_rx_process(&rx_ctx, level, (uint16_t)sim_now);
+}
+
+// when the next compare matches. OCR1A is only 16 bits: if the ISR that moved it ran so late that TCNT1 was already at
+// or past the new value, that compare is missed and matches only after Timer1 wraps around, 32.768ms later
+static uint64_t tx_due() {
+	uint64_t at = sim_now + (uint16_t)(OCR1A - (uint16_t)sim_now);
+	if(at <= tx_isr_at) {
+		at += 0x10000;
+	}
+	return at;
+}
+
+// compare match, hardware toggles the pin first, then the ISR runs
+static void loop_compare(uint16_t latency, uint64_t *edges) {
+	if((TCCR1A & (_BV(COM1A1) | _BV(COM1A0))) == _BV(COM1A0)) {
+		set_pin(!pin);
+		(*edges)++;
+	}
+	tx_isr_at = sim_now + (latency ? rnd() % (latency + 1) : 0);
+	TCNT1 = (uint16_t)tx_isr_at;
+	kl_tx_process(&tx_ctx);
+	if(TCCR1C & _BV(FOC1A)) {
+		TCCR1C = 0;
+		set_pin(0);
+	}
+	if(!(TCCR1A & (_BV(COM1A1) | _BV(COM1A0)))) {
+		set_pin(0); // back to the port
+	}
+}
+
+static void meas_add(struct meas_stats *ms, double dev) {
+	ms->n++;
+	ms->dev_sum += dev;
+	if(fabs(dev) > ms->dev_max) {
+		ms->dev_max = fabs(dev);
+	}
+}
+
+// transmission that started at "start" and ended at "end" (the guard time is over) against the waveform it should be,
+// rendered here independently of the transmitter: preamble (TE LOW, TE HIGH pairs), header LOW, then the bits LSb first,
+// 1 is TE HIGH + 2 x TE LOW, 0 is the opposite, and the LOW of the last bit goes on with the guard time
+static void meas_frame(struct loop_frame *lf, uint16_t te, uint64_t start, uint64_t end, struct meas_stats *ms) {
+	double req[MEAS_EDGES_MAX];
+	uint8_t kind[MEAS_EDGES_MAX];
+	uint16_t n = 0;
+
+	for(uint8_t i = 0; i < LOOP_PREAMBLE; i++) {
+		kind[n] = MEAS_PREAMBLE; req[n++] = te;
+		kind[n] = MEAS_PREAMBLE; req[n++] = te;
+	}
+	kind[n] = MEAS_HEADER; req[n++] = (double)LOOP_HEADER_TE * te;
+	for(uint8_t i = 0; i < lf->bits; i++) {
+		uint8_t bit = lf->buff[i / 8] & (1 << (i % 8));
+		kind[n] = bit ? MEAS_TE : MEAS_2TE; req[n++] = bit ? te : 2 * te;
+		kind[n] = bit ? MEAS_2TE : MEAS_TE; req[n++] = bit ? 2 * te : te;
+	}
+	kind[n - 1] = MEAS_GUARD;
+	req[n - 1] += (double)LOOP_GUARD_TE * te;
+
+	// pulses are between the edges, the first one begins with the transmission and the last one ends with it
+	uint16_t m = meas_edges_len + 1;
+	for(uint16_t i = 0; i < n && i < m; i++) {
+		uint64_t from = i ? meas_edges[i - 1] : start;
+		uint64_t to = (i < meas_edges_len) ? meas_edges[i] : end;
+		meas_add(&ms[kind[i]], (to - from) / 2.0 - req[i]);
+	}
+	for(uint16_t i = m; i < n; i++) {
+		ms[kind[i]].missing++;
+	}
+	for(uint16_t i = n; i < m; i++) {
+		ms[MEAS_GUARD].missing++;
+	}
+}
+
+static void meas_print(struct meas_stats *ms) {
+	for(uint8_t k = 0; k < MEAS_KINDS; k++) {
+		printf("  %s %+.2f/%.1f", meas_names[k], ms[k].n ? ms[k].dev_sum / ms[k].n : 0, ms[k].dev_max);
+		if(ms[k].missing) {
+			printf(" (%u MISSING)", ms[k].missing);
+		}
+	}
+	printf("\n");
+}
+
+// frames, all of them queued up as they fit and sent as one transmission, cycling through the encoders.
+// the next frame is queued long before the receiver reports the previous one, so any of the frames
+// still in the queue (or on the air) can be the one it reports
+static void loop_queue(uint8_t *encoders, uint8_t encoders_len, uint32_t total, uint16_t te, uint16_t latency, uint64_t *next_poll, uint64_t *edges, struct loop_stats *stats) {
+	struct loop_frame *lf = calloc(total, sizeof(struct loop_frame));
+	if(!lf) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	uint32_t queued = 0;
+
+	do {
+		// main loop keeps the queue full
+		while(queued < total && tx_queue.cnt < KL_TX_QUEUE_LEN) {
+			make_frame(encoders[queued % encoders_len], &lf[queued]);
+			uint8_t idle = (tx_ctx.kl_tx_state == KL_TX_IDLE);
+			TCNT1 = (uint16_t)sim_now;
+			if(idle) {
+				tx_isr_at = sim_now;
+			}
+			if(!kl_tx_enqueue(&tx_ctx, lf[queued].buff, lf[queued].bits, te, LOOP_PREAMBLE, LOOP_HEADER_TE * te, LOOP_GUARD_TE * te, 1)) {
+				fprintf(stderr, "kl_tx_enqueue() failed\n");
+				exit(1);
+			}
+			queued++;
+			// transmission starts with the pin forced low
+			if(idle) {
+				TCCR1C = 0;
+				set_pin(0);
+			}
+		}
+
+		uint64_t tx_at = tx_due();
+		uint32_t from = (queued > KL_TX_QUEUE_LEN + 2) ? (queued - KL_TX_QUEUE_LEN - 2) : 0;
+		loop_poll(tx_at, next_poll, &lf[from], queued - from);
+		sim_now = tx_at;
+		loop_compare(latency, edges);
+	} while(tx_ctx.kl_tx_state == KL_TX_BUSY);
+
+	if(queued != total) {
+		printf("TRANSMISSION ENDED WITH %u OF %u FRAMES QUEUED\n", queued, total);
+	}
+
+	for(uint32_t f = 0; f < total; f++) {
+		uint8_t e = f % encoders_len;
+		stats[e].sent++;
+		if(lf[f].received) {
+			stats[e].ok++;
+		}
+		else if(verbose) {
+			printf("LOST: FRAME %u, HCS%u bits=%u\n", f + 1, encoder_names[encoders[e] - ENCODER_HCS101], lf[f].bits);
+		}
+	}
+	free(lf);
+}
+
+static double elapsed_s(struct timespec *ts0, struct timespec *ts1) {
+	return (ts1->tv_sec - ts0->tv_sec) + (ts1->tv_nsec - ts0->tv_nsec) / 1e9;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: kl_loopback [-E encoder] [-T te] [-n frames] [-s seed] [-v] [-m | -q] [-L us]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	uint8_t encoders[sizeof(encoders_all)];
+	uint8_t encoders_len = sizeof(encoders_all);
+	memcpy(encoders, encoders_all, sizeof(encoders_all));
+	uint32_t frames = 1000;
+	uint64_t seed = 1;
+	uint16_t te = 400;
+	uint16_t latency = 0;
+	uint8_t queue = 0;
+	int c;
+
+	while((c = getopt(argc, argv, "E:T:n:s:vmqL:")) != -1) {
+		switch(c) {
+			case 'E':
+				if(strcmp(optarg, "all")) {
+					uint16_t hcs = atoi(optarg);
+					uint8_t i;
+					for(i = 0; i < sizeof(encoders_all); i++) {
+						if(encoder_names[i] == hcs) break;
+					}
+					if(i == sizeof(encoders_all)) {
+						usage();
+					}
+					encoders[0] = encoders_all[i];
+					encoders_len = 1;
+				}
+			break;
+			case 'T': te = atoi(optarg); break;
+			case 'n': frames = strtoul(optarg, 0, 10); break;
+			case 's': seed = strtoull(optarg, 0, 10); break;
+			case 'v': verbose = 1; break;
+			case 'm': measure = 1; break;
+			case 'q': queue = 1; break;
+			case 'L': latency = KL_US2TICKS(atoi(optarg)); break;
+			default: usage();
+		}
+	}
+	if(optind != argc || !frames || !te || (measure && queue)) {
+		usage();
+	}
+	rnd_state = seed ? seed : 1;
+
+	memset((void *)&tx_ctx, 0, sizeof(tx_ctx));
+	tx_ctx.fn_tx_init_hw = &hw_nop;
+	tx_ctx.fn_tx_deinit_hw = &hw_nop;
+	tx_ctx.fn_tx_pin_hw = &tx_pin_nop;
+	tx_ctx.kl_tx_sched_buff = &tx_sched;
+	tx_ctx.kl_tx_queue = &tx_queue;
+	kl_init_ctx(&tx_ctx);
+
+	memset((void *)&rx_ctx, 0, sizeof(rx_ctx));
+	rx_ctx.fn_rx_init_hw = &hw_nop;
+	rx_ctx.fn_rx_deinit_hw = &hw_nop;
+	kl_init_ctx(&rx_ctx);
+
+	sim_now = 0;
+	TCNT1 = 0;
+	pin = 0;
+	kl_rx_start(&rx_ctx);
+
+	struct loop_stats stats[sizeof(encoders_all)];
+	memset(stats, 0, sizeof(stats));
+	uint32_t total = frames * encoders_len;
+	uint64_t next_poll = KL_RX_POLL_TICKS;
+	uint64_t edges = 0;
+	struct meas_stats meas_all[MEAS_KINDS];
+	memset(meas_all, 0, sizeof(meas_all));
+
+	struct timespec ts0, ts1;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts0);
+
+	if(queue) {
+		loop_queue(encoders, encoders_len, total, te, latency, &next_poll, &edges, stats);
+	}
+	for(uint32_t f = 0; !queue && f < total; f++) {
+		uint8_t e = f % encoders_len;
+		struct loop_frame lf;
+		make_frame(encoders[e], &lf);
+		stats[e].sent++;
+
+		TCNT1 = (uint16_t)sim_now;
+		tx_isr_at = sim_now;
+		if(!kl_tx_start(&tx_ctx, lf.buff, lf.bits, te, LOOP_PREAMBLE, LOOP_HEADER_TE * te, LOOP_GUARD_TE * te)) {
+			fprintf(stderr, "kl_tx_start() failed\n");
+			return 1;
+		}
+		// frame starts with the pin forced low
+		TCCR1C = 0;
+		set_pin(0);
+		uint64_t tx_start = sim_now;
+		meas_edges_len = 0;
+
+		// the frame, and the receiver finishing it in the guard time
+		while(tx_ctx.kl_tx_state == KL_TX_BUSY) {
+			uint64_t tx_at = tx_due();
+
+			// receiver polls that come first
+			loop_poll(tx_at, &next_poll, &lf, 1);
+
+			sim_now = tx_at;
+			loop_compare(latency, &edges);
+		}
+
+		if(measure) {
+			struct meas_stats meas[MEAS_KINDS];
+			memset(meas, 0, sizeof(meas));
+			meas_frame(&lf, te, tx_start, sim_now, meas);
+			printf("TX %u HCS%u, DEVIATION MEAN/MAX us:", f + 1, encoder_names[encoders[e] - ENCODER_HCS101]);
+			meas_print(meas);
+
+			for(uint8_t k = 0; k < MEAS_KINDS; k++) {
+				meas_all[k].n += meas[k].n;
+				meas_all[k].dev_sum += meas[k].dev_sum;
+				meas_all[k].missing += meas[k].missing;
+				if(meas[k].dev_max > meas_all[k].dev_max) {
+					meas_all[k].dev_max = meas[k].dev_max;
+				}
+			}
+		}
+
+		if(lf.received) {
+			stats[e].ok++;
+		}
+		else if(verbose) {
+			printf("LOST: HCS%u bits=%u data=", encoder_names[encoders[e] - ENCODER_HCS101], lf.bits);
+			for(int8_t i = KL_BUFF_LEN - 1; i >= 0; i--) {
+				printf("%02X", lf.buff[i]);
+			}
+			printf("\n");
+		}
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts1);
+	double cpu_s = elapsed_s(&ts0, &ts1);
+
+	kl_rx_stop(&rx_ctx);
+
+	uint32_t ok = 0;
+	for(uint8_t e = 0; e < encoders_len; e++) {
+		printf("HCS%u: SENT %u, OK %u\n", encoder_names[encoders[e] - ENCODER_HCS101], stats[e].sent, stats[e].ok);
+		ok += stats[e].ok;
+	}
+
+	double sim_s = sim_now / 2000000.0;
+	printf("TE: %uus, FRAMES: %u, OK: %u, FAILED: %u\n", te, total, ok, total - ok);
+	printf("EDGES: %llu, REJ BITCNT: %u, HEADERS BAD: %u\n", (unsigned long long)edges, rx_ctx.kl_rx_stats.rej_bit_count, rx_ctx.kl_rx_stats.headers_bad);
+	if(measure) {
+		printf("TX DEVIATION MEAN/MAX us:");
+		meas_print(meas_all);
+	}
+	printf("SIMULATED: %.3f s, CPU: %.3f s, %.0f x real time\n", sim_s, cpu_s, cpu_s ? sim_s / cpu_s : 0);
+	printf("END TO END: %.0f frames/s, %.3f us per frame\n", cpu_s ? total / cpu_s : 0, total ? cpu_s * 1e6 / total : 0);
+
+	return (ok == total) ? 0 : 1;
+}
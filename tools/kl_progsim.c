@@ -0,0 +1,432 @@
+/*
+ * kl_progsim.c
+ *
+ * Created: 19. 10. 2026. 21:31:47
+ *  Author: agent
+ *
+ * Host run of the encoder programmer: kl_prog_start() / kl_prog_process() from keeloq_prog.c talking
+ * to the model of the chip in hcs_model.c over the clock and data pins, programming and verifying
+ * random profiles built by keeloq_decode_build_prog_stream(). The timer callback does not wait, it only
+ * says when the next step is due, and the simulated time jumps there. A chip that takes about a second
+ * on the programmer is done in microseconds here.
+ *
+ * What ended up in the chip is checked word by word against the memory map of its encoder, written out
+ * here independently of the stream builder. Every chip must program, verify and match its map, otherwise
+ * the exit code is 1. With -S or -e the chip is made worse on purpose, then failures are expected and
+ * only a wrong memory map (or a verify that passed on a chip holding something else) is an error.
+ *
+ * Build (from the repository root):
+ *	gcc -O2 -std=gnu99 -include stdint.h -Itools/host -I. -o kl_progsim \
+ *		tools/kl_progsim.c tools/hcs_model.c keeloq_prog.c keeloq_decode.c keeloq_crypt.c
+ *
+ * Usage:
+ *	kl_progsim [-E encoder] [-n chips] [-l level | -d] [-r retries] [-S pct] [-e ber] [-s seed] [-v] [-c]
+ *		-E encoder	200, 201, 300, 301, 320, 360, 361 or all (default)
+ *		-n chips	chips per encoder, default 100
+ *		-l level	timing profile level, 0 (datasheet minimum) to 16, default KL_PROG_LEVEL_DEFAULT
+ *		-d			conservative timing, kl_prog_timing_default()
+ *		-r retries	reprogramming attempts after a failed verify, default KL_PROG_RETRIES_DEFAULT
+ *		-S pct		erase, write and clock timing the chip needs, in % of the datasheet one. default 100
+ *		-e ber		probability of a bit being written wrong, default 0
+ *		-s seed		random seed, default 1
+ *		-v			print the failed words of every chip that did not make it, and the timing it broke
+ *		-c			calibrate as the firmware does: from KL_PROG_LEVEL_DEFAULT down to 0, no retries,
+ *					print the fastest level every chip of the encoder passed on
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "keeloq_decode.h"
+#include "keeloq_prog.h"
+#include "hcs_model.h"
+
+#define SIM_STREAM_LEN			24		// 192 bits
+#define SIM_CANARY				0xA5	// after the stream, the builder must not touch it
+#define SIM_CANARY_LEN			8
+#define SIM_BITS				(SIM_STREAM_LEN * 8)
+
+static const uint8_t encoders_all[] = {
+	ENCODER_HCS200, ENCODER_HCS201, ENCODER_HCS300, ENCODER_HCS301,
+	ENCODER_HCS320, ENCODER_HCS360, ENCODER_HCS361
+};
+static const uint16_t encoder_names[] = { 200, 201, 300, 301, 320, 360, 361 };
+
+struct sim_stats {
+	uint32_t chips;
+	uint32_t passed; // programmed, verified and matching the map
+	uint32_t retried; // passed, but not on the first attempt
+	uint32_t failed; // programmer gave up
+	uint32_t bad_map; // verified, but not what the encoder should hold
+	uint32_t overflow; // stream builder wrote past the stream
+	uint32_t violations; // of the chip timing
+	uint64_t sim_us; // programming time of all of them
+};
+
+static volatile struct keeloq_prog_ctx prog_ctx;
+static struct hcs_model chip;
+
+static uint64_t sim_now; // microseconds
+static uint64_t timer_due;
+static uint8_t timer_armed;
+static uint8_t prog_mode; // 0 programming, 1 verify: data pin is an input
+static uint32_t bus_conflicts; // programmer drove the data pin in verify
+static uint8_t verbose;
+
+static uint64_t rnd_state;
+
+static uint32_t rnd() {
+	// xorshift64*
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return (uint32_t)((rnd_state * 2685821657736338717ULL) >> 32);
+}
+
+static const char *encoder_name(uint8_t encoder) {
+	static char name[12];
+	for(uint8_t i = 0; i < sizeof(encoders_all); i++) {
+		if(encoders_all[i] == encoder) {
+			sprintf(name, "HCS%u", encoder_names[i]);
+			return name;
+		}
+	}
+	return "HCS???";
+}
+
+// hardware callbacks, all of them end up on the model
+static void prog_init_hw(uint8_t prog0_verify1) {
+	prog_mode = prog0_verify1;
+}
+
+static void prog_deinit_hw() {
+	prog_mode = 0;
+	hcs_model_release(&chip);
+}
+
+static void set_clk_pin(uint8_t pin_state) {
+	hcs_model_clk(&chip, pin_state, sim_now);
+}
+
+static void set_data_pin(uint8_t pin_state) {
+	if(prog_mode) {
+		bus_conflicts++;
+		return;
+	}
+	hcs_model_data(&chip, pin_state, sim_now);
+}
+
+static uint8_t get_data_pin() {
+	return hcs_model_read(&chip, sim_now);
+}
+
+static void prog_timer(uint32_t us) {
+	timer_armed = (us != 0);
+	timer_due = sim_now + us;
+}
+
+static void random_profile(uint8_t encoder, struct KEELOQ_DECODE_PROG_PROFILE *profile) {
+	memset(profile, 0, sizeof(*profile));
+	profile->encoder = encoder;
+	profile->crypt_key = ((uint64_t)rnd() << 32) | rnd();
+	profile->counter = rnd();
+	profile->serial = rnd() & 0x0FFFFFFF;
+	profile->seed = rnd();
+	profile->seed2 = rnd();
+	profile->config = rnd();
+	profile->discrimination = rnd() & 0x03FF;
+}
+
+// what the encoder holds, word by word, from its datasheet
+static void profile_map(struct KEELOQ_DECODE_PROG_PROFILE *profile, uint16_t *map) {
+	for(uint8_t i = 0; i < 4; i++) {
+		map[i] = profile->crypt_key >> (i * 16);
+	}
+	map[4] = profile->counter;
+
+	if(profile->encoder == ENCODER_HCS360 || profile->encoder == ENCODER_HCS361) {
+		map[5] = profile->seed2;
+		map[6] = 0;
+		map[7] = profile->seed;
+		map[8] = profile->seed >> 16;
+		map[9] = profile->serial;
+		map[10] = profile->serial >> 16;
+	}
+	else {
+		map[5] = 0;
+		map[6] = profile->serial;
+		map[7] = profile->serial >> 16;
+		map[8] = profile->seed;
+		map[9] = profile->seed >> 16;
+		map[10] = (profile->encoder == ENCODER_HCS201) ? profile->discrimination : 0;
+	}
+	map[11] = profile->config;
+}
+
+// programs one chip, returns the programmer result
+static uint8_t program_chip(struct keeloq_prog_timing *timing, uint8_t retries, unsigned char *stream, uint64_t *took_us) {
+	uint64_t start = sim_now;
+
+	prog_ctx.kl_prog_timing = *timing;
+	prog_ctx.kl_prog_retries = retries;
+	if(!kl_prog_start(&prog_ctx, stream, SIM_BITS, 1)) {
+		fprintf(stderr, "kl_prog_start() failed\n");
+		exit(1);
+	}
+	while(prog_ctx.kl_prog_state == KL_PROG_BUSY && timer_armed) {
+		sim_now = timer_due;
+		timer_armed = 0;
+		kl_prog_process(&prog_ctx);
+	}
+	if(prog_ctx.kl_prog_state != KL_PROG_DONE) {
+		fprintf(stderr, "programmer stopped without finishing\n");
+		exit(1);
+	}
+
+	*took_us = sim_now - start;
+	return prog_ctx.kl_prog_result;
+}
+
+static void print_failed(uint8_t encoder, uint32_t n) {
+	printf("%s CHIP %u: FAILED, ATTEMPTS %u, WORDS 0x%03X", encoder_name(encoder), n, prog_ctx.kl_prog_attempt, prog_ctx.kl_prog_failed_words);
+	for(uint8_t i = 0; i < prog_ctx.kl_prog_errors_len && i < KL_PROG_ERRORS_LEN; i++) {
+		volatile struct keeloq_prog_word_error *err = &prog_ctx.kl_prog_errors[i];
+		printf(" [%u %04X!=%04X]", err->word, err->expected, err->actual);
+	}
+	printf(", CHIP STATE %u, VIOLATIONS %u (%s)\n", chip.state, chip.violations, chip.last_violation ? chip.last_violation : "none");
+}
+
+// one chip of the encoder, from a random profile to checking its memory
+static void run_chip(uint8_t encoder, struct hcs_model_timing *chip_timing, double ber, struct keeloq_prog_timing *timing, uint8_t retries, struct sim_stats *st) {
+	struct KEELOQ_DECODE_PROG_PROFILE profile;
+	unsigned char stream[SIM_STREAM_LEN + SIM_CANARY_LEN];
+	uint16_t map[HCS_MODEL_WORDS];
+	uint64_t took_us;
+
+	random_profile(encoder, &profile);
+	memset(stream, SIM_CANARY, sizeof(stream));
+	keeloq_decode_build_prog_stream(stream, &profile);
+	profile_map(&profile, map);
+
+	st->chips++;
+	for(uint8_t i = SIM_STREAM_LEN; i < sizeof(stream); i++) {
+		if(stream[i] != SIM_CANARY) {
+			st->overflow++;
+			if(verbose) {
+				printf("%s CHIP %u: STREAM OVERFLOW\n", encoder_name(encoder), st->chips);
+			}
+			break;
+		}
+	}
+
+	chip.ber = ber;
+	hcs_model_init(&chip, chip_timing);
+	uint8_t res = program_chip(timing, retries, stream, &took_us);
+	st->sim_us += took_us;
+	st->violations += chip.violations;
+
+	if(!res) {
+		st->failed++;
+		if(verbose) {
+			print_failed(encoder, st->chips);
+		}
+		return;
+	}
+
+	// verify passed, so the chip holds the stream. and the stream must be what the encoder expects
+	if(memcmp(chip.mem, map, sizeof(map)) || chip.state != HCS_MODEL_IDLE) {
+		st->bad_map++;
+		if(verbose) {
+			printf("%s CHIP %u: WRONG MEMORY MAP", encoder_name(encoder), st->chips);
+			for(uint8_t i = 0; i < HCS_MODEL_WORDS; i++) {
+				if(chip.mem[i] != map[i]) {
+					printf(" [%u %04X!=%04X]", i, map[i], chip.mem[i]);
+				}
+			}
+			printf("\n");
+		}
+		return;
+	}
+
+	st->passed++;
+	if(prog_ctx.kl_prog_attempt > 1) {
+		st->retried++;
+	}
+}
+
+static void chip_timing_scaled(struct hcs_model_timing *t, uint32_t pct) {
+	hcs_model_datasheet(t);
+	t->pbw = t->pbw * pct / 100;
+	t->clkh = t->clkh * pct / 100;
+	t->clkl = t->clkl * pct / 100;
+	t->dh = t->dh * pct / 100;
+	t->wc = t->wc * pct / 100;
+	t->dv = t->dv * pct / 100;
+}
+
+static double elapsed_s(struct timespec *t0, struct timespec *t1) {
+	return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: kl_progsim [-E encoder] [-n chips] [-l level | -d] [-r retries] [-S pct] [-e ber] [-s seed] [-v] [-c]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	uint8_t encoders[sizeof(encoders_all)];
+	uint8_t encoders_len = sizeof(encoders_all);
+	memcpy(encoders, encoders_all, sizeof(encoders_all));
+	uint32_t chips = 100;
+	uint8_t level = KL_PROG_LEVEL_DEFAULT;
+	uint8_t conservative = 0;
+	uint8_t retries = KL_PROG_RETRIES_DEFAULT;
+	uint32_t scale = 100;
+	double ber = 0;
+	uint64_t seed = 1;
+	uint8_t calibrate = 0;
+	int c;
+
+	while((c = getopt(argc, argv, "E:n:l:dr:S:e:s:vc")) != -1) {
+		switch(c) {
+			case 'E':
+				if(strcmp(optarg, "all")) {
+					uint16_t hcs = atoi(optarg);
+					uint8_t i;
+					for(i = 0; i < sizeof(encoders_all); i++) {
+						if(encoder_names[i] == hcs) break;
+					}
+					if(i == sizeof(encoders_all)) {
+						usage();
+					}
+					encoders[0] = encoders_all[i];
+					encoders_len = 1;
+				}
+			break;
+			case 'n': chips = strtoul(optarg, 0, 10); break;
+			case 'l': level = atoi(optarg); break;
+			case 'd': conservative = 1; break;
+			case 'r': retries = atoi(optarg); break;
+			case 'S': scale = strtoul(optarg, 0, 10); break;
+			case 'e': ber = atof(optarg); break;
+			case 's': seed = strtoull(optarg, 0, 10); break;
+			case 'v': verbose = 1; break;
+			case 'c': calibrate = 1; break;
+			default: usage();
+		}
+	}
+	if(optind != argc || !chips || !scale || level > KL_PROG_LEVEL_MAX || ber < 0 || ber > 1) {
+		usage();
+	}
+	rnd_state = seed ? seed : 1;
+	chip.rnd_state = rnd_state ^ 0x9E3779B97F4A7C15ULL;
+
+	memset((void *)&prog_ctx, 0, sizeof(prog_ctx));
+	prog_ctx.fn_prog_init_hw = &prog_init_hw;
+	prog_ctx.fn_prog_deinit_hw = &prog_deinit_hw;
+	prog_ctx.fn_set_clk_pin_hw = &set_clk_pin;
+	prog_ctx.fn_set_data_pin_hw = &set_data_pin;
+	prog_ctx.fn_get_data_pin_hw = &get_data_pin;
+	prog_ctx.fn_prog_timer_hw = &prog_timer;
+	kl_prog_init_ctx(&prog_ctx);
+
+	struct hcs_model_timing chip_timing;
+	chip_timing_scaled(&chip_timing, scale);
+	uint8_t faulty = (scale > 100 || ber > 0);
+
+	struct sim_stats stats[sizeof(encoders_all)];
+	memset(stats, 0, sizeof(stats));
+	uint8_t calibrated[sizeof(encoders_all)];
+	uint8_t errors = 0;
+
+	struct timespec ts0, ts1;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts0);
+
+	for(uint8_t e = 0; e < encoders_len; e++) {
+		struct keeloq_prog_timing timing;
+
+		// fastest level every chip passes on, no retries. fall back to the conservative timing if none
+		if(calibrate) {
+			calibrated[e] = 0xFF;
+			for(int8_t l = KL_PROG_LEVEL_DEFAULT; l >= 0; l--) {
+				struct sim_stats st;
+				memset(&st, 0, sizeof(st));
+				kl_prog_timing_profile(encoders[e], l, &timing);
+				for(uint32_t n = 0; n < chips; n++) {
+					run_chip(encoders[e], &chip_timing, ber, &timing, 0, &st);
+				}
+				stats[e].bad_map += st.bad_map;
+				stats[e].overflow += st.overflow;
+				if(st.passed != st.chips) {
+					break;
+				}
+				calibrated[e] = l;
+			}
+		}
+
+		if(conservative) {
+			kl_prog_timing_default(&timing);
+		}
+		else if(calibrate) {
+			if(calibrated[e] == 0xFF) {
+				kl_prog_timing_default(&timing);
+			}
+			else {
+				kl_prog_timing_profile(encoders[e], calibrated[e], &timing);
+			}
+		}
+		else if(!kl_prog_timing_profile(encoders[e], level, &timing)) {
+			fprintf(stderr, "no timing profile for %s\n", encoder_name(encoders[e]));
+			return 1;
+		}
+
+		for(uint32_t n = 0; n < chips; n++) {
+			run_chip(encoders[e], &chip_timing, ber, &timing, retries, &stats[e]);
+		}
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts1);
+	double cpu_s = elapsed_s(&ts0, &ts1);
+
+	uint32_t total = 0, passed = 0;
+	uint64_t sim_us = 0;
+	for(uint8_t e = 0; e < encoders_len; e++) {
+		struct sim_stats *st = &stats[e];
+		printf("%s: CHIPS %u, PASSED %u, RETRIED %u, FAILED %u, VIOLATIONS %u, %.1f ms PER CHIP",
+			encoder_name(encoders[e]), st->chips, st->passed, st->retried, st->failed, st->violations,
+			st->chips ? st->sim_us / 1000.0 / st->chips : 0);
+		if(calibrate) {
+			if(calibrated[e] == 0xFF) {
+				printf(", CALIBRATED: NONE");
+			}
+			else {
+				printf(", CALIBRATED: LEVEL %u", calibrated[e]);
+			}
+		}
+		printf("\n");
+		if(st->bad_map || st->overflow) {
+			printf("%s: WRONG MEMORY MAP %u, STREAM OVERFLOW %u\n", encoder_name(encoders[e]), st->bad_map, st->overflow);
+			errors = 1;
+		}
+		if(!faulty && st->passed != st->chips) {
+			errors = 1;
+		}
+		total += st->chips;
+		passed += st->passed;
+		sim_us += st->sim_us;
+	}
+	if(bus_conflicts) {
+		printf("DATA PIN DRIVEN IN VERIFY: %u times\n", bus_conflicts);
+		errors = 1;
+	}
+
+	double sim_s = sim_us / 1e6;
+	printf("CHIPS: %u, PASSED: %u, FAILED: %u\n", total, passed, total - passed);
+	printf("SIMULATED: %.3f s (%.0f chips/h), CPU: %.3f s, %.0f x real time\n",
+		sim_s, sim_s ? total * 3600.0 / sim_s : 0, cpu_s, cpu_s ? sim_s / cpu_s : 0);
+
+	return errors;
+}
@@ -0,0 +1,130 @@
+/*
+ * kl_replay.c
+ *
+ * Created: 19. 10. 2026. 12:10:18
+ *  Author: agent
+ *
+ * Host replay harness. Loads a pulse trace (see trace.h) and feeds it through the very same
+ * kl_rx_process()/kl_rx_poll() the firmware runs, with Timer1 simulated as a free-running 16bit
+ * counter of 0.5us ticks. Prints the received frames, optionally the receiver state transitions,
+ * and how fast all of that went.
+ *
+ * Build (from the repository root):
+ *	gcc -O2 -std=gnu99 -include stdint.h -Itools/host -Itools -I. -o kl_replay \
+ *		tools/kl_replay.c tools/replay.c tools/trace.c tools/host/avr_regs.c keeloq.c keeloq_decode.c keeloq_crypt.c
+ *
+ * Usage:
+ *	kl_replay [-t|-b] [-v] [-q] [-e] [-k key] [-r repeats] trace
+ *		-t, -b		trace is text/binary, default is by file extension (.bin/.raw are binary)
+ *		-v			print receiver state transitions and RF activity as well
+ *		-q			don't print the frames, only the summary (use this for timing)
+ *		-e			poll timeouts every KL_RX_POLL_TICKS like the device does. by default the receiver
+ *					is polled only as often as needed for the 16bit timer not to wrap, which gives
+ *					the same frames much faster, only the end of RF activity is reported later
+ *		-k key		64bit crypt key in hex, to decrypt the frames
+ *		-r repeats	replay the whole trace this many times, for more stable timing
+ *
+ * "-" as the trace reads it from stdin.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "keeloq.h"
+#include "keeloq_decode.h"
+#include "trace.h"
+#include "replay.h"
+
+struct print_opts {
+	uint8_t quiet;
+	uint64_t key;
+};
+
+static void print_frame(volatile struct keeloq_ctx *ctx, uint64_t now, void *user) {
+	struct print_opts *popts = user;
+	if(popts->quiet) {
+		return;
+	}
+
+	struct KEELOQ_DECODE_PLAIN decoded;
+	memset(&decoded, 0, sizeof(decoded));
+	uint8_t ok = keeloq_decode((uint8_t *)ctx->kl_rx_buff, ctx->kl_rx_buff_bit_index, popts->key, &decoded);
+
+	printf("%12.6f  FRAME bits=%u te=%u th=%u q=%u data=", now / 2000000.0, ctx->kl_rx_buff_bit_index, ctx->kl_rx_timing_element, ctx->kl_rx_header_length, ctx->kl_rx_quality);
+	for(int8_t i = KL_BUFF_LEN - 1; i >= 0; i--) {
+		printf("%02X", ctx->kl_rx_buff[i]);
+	}
+	printf(" serial=%07X btn=%X", (unsigned)decoded.serial, decoded.buttons);
+	if(popts->key) {
+		printf(" btn_enc=%X disc=%03X cnt=%u", decoded.buttons_enc, decoded.discrimination, decoded.counter);
+	}
+	printf("%s\n", ok ? "" : " CRC-ERROR");
+}
+
+static void print_stats() {
+	struct keeloq_rx_stats *s = (struct keeloq_rx_stats *)&replay_ctx.kl_rx_stats;
+	printf("EDGES: %u\n", (unsigned)s->edges);
+	printf("HEADERS OK: %u, BAD: %u\n", s->headers_ok, s->headers_bad);
+	printf("FRAMES 66: %u, 67: %u, 69: %u\n", s->frames_66, s->frames_67, s->frames_69);
+	printf("REJ SHORT: %u, LONG: %u, OVERFLOW: %u\n", s->rej_bit_short, s->rej_bit_long, s->rej_overflow);
+	printf("REJ BITCNT: %u, BUFFBUSY: %u, NESTED: %u\n", s->rej_bit_count, s->rej_buff_busy, s->rej_nested);
+}
+
+static void usage() {
+	fprintf(stderr, "usage: kl_replay [-t|-b] [-v] [-q] [-e] [-k key] [-r repeats] trace\n");
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	struct print_opts popts = { 0, 0 };
+	struct replay_opts opts = { 0, REPLAY_POLL_STRIDE, &print_frame, &popts };
+	uint8_t fmt = TRACE_FMT_AUTO;
+	uint32_t repeats = 1;
+	int c;
+
+	while((c = getopt(argc, argv, "tbvqek:r:")) != -1) {
+		switch(c) {
+			case 't': fmt = TRACE_FMT_TEXT; break;
+			case 'b': fmt = TRACE_FMT_BIN; break;
+			case 'v': opts.verbose = 1; break;
+			case 'q': popts.quiet = 1; break;
+			case 'e': opts.poll_stride = KL_RX_POLL_TICKS; break;
+			case 'k': popts.key = strtoull(optarg, 0, 16); break;
+			case 'r': repeats = strtoul(optarg, 0, 10); break;
+			default: usage();
+		}
+	}
+	if(optind != argc - 1 || !repeats) {
+		usage();
+	}
+
+	struct trace t;
+	if(!trace_load(&t, argv[optind], fmt)) {
+		return 1;
+	}
+	if(t.blocks_bad) {
+		fprintf(stderr, "%u broken blocks skipped\n", t.blocks_bad);
+	}
+
+	struct replay_result res;
+	memset(&res, 0, sizeof(res));
+	for(uint32_t r = 0; r < repeats; r++) {
+		replay_run(&t, &opts, &res);
+	}
+
+	print_stats();
+
+	double sim_s = res.ticks / 2000000.0;
+	printf("PULSES: %u, LOST EDGES: %u\n", t.len, t.lost_total);
+	printf("SIMULATED: %.3f s, CPU: %.3f s, %.0f x real time\n", sim_s, res.cpu_s, res.cpu_s ? sim_s / res.cpu_s : 0);
+	printf("FRAMES: %u, %.0f frames/s\n", res.frames, res.cpu_s ? res.frames / res.cpu_s : 0);
+	if(res.frames) {
+		printf("CPU PER FRAME: %.3f us, PER EDGE: %.1f ns\n", res.cpu_s * 1e6 / res.frames, res.edges ? res.cpu_s * 1e9 / res.edges : 0);
+	}
+
+	trace_free(&t);
+
+	return 0;
+}
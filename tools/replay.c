@@ -0,0 +1,104 @@
+/*
+ * replay.c
+ *
+ * Created: 19. 10. 2026. 14:03:20
+ *  Author: agent
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+
+volatile struct keeloq_ctx replay_ctx;
+
+static uint64_t sim_now;
+static enum KL_RX_STATE prev_state;
+static enum KL_RF_ACT prev_rf_act;
+
+static const char *state_names[] = { "STOP", "SYNCING", "HEADERCHECK", "RXING" };
+
+// receiver hardware is simulated, there is nothing to init
+static void replay_rx_init_hw() {
+}
+
+static void replay_rx_deinit_hw() {
+}
+
+// what the main loop of the firmware would do after each ISR
+static void replay_check(struct replay_opts *opts, struct replay_result *res) {
+	if(opts->verbose) {
+		if(replay_ctx.kl_rx_state != prev_state) {
+			printf("%12.6f  %s -> %s\n", sim_now / 2000000.0, state_names[prev_state & 3], state_names[replay_ctx.kl_rx_state & 3]);
+		}
+		if(replay_ctx.kl_rx_rf_act != prev_rf_act) {
+			printf("%12.6f  RF %s\n", sim_now / 2000000.0, (replay_ctx.kl_rx_rf_act == KL_RF_ACT_BUSY) ? "BUSY" : "IDLE");
+		}
+	}
+	prev_state = replay_ctx.kl_rx_state;
+	prev_rf_act = replay_ctx.kl_rx_rf_act;
+
+	if(replay_ctx.kl_rx_buff_state != KL_BUFF_FULL) {
+		return;
+	}
+
+	res->frames++;
+	if(opts->fn_frame) {
+		opts->fn_frame(&replay_ctx, sim_now, opts->user);
+	}
+
+	kl_rx_flush(&replay_ctx);
+}
+
+// let time pass until "until", polling the timeouts as the OCR1B ISR would
+static void replay_advance(uint64_t until, uint64_t *next_poll, struct replay_opts *opts, struct replay_result *res) {
+	while(*next_poll <= until) {
+		sim_now = *next_poll;
+		TCNT1 = (uint16_t)sim_now;
+		kl_rx_poll(&replay_ctx, (uint16_t)sim_now);
+		replay_check(opts, res);
+		*next_poll += opts->poll_stride;
+	}
+	sim_now = until;
+}
+
+void replay_run(struct trace *t, struct replay_opts *opts, struct replay_result *res) {
+	sim_now = 0;
+	TCNT1 = 0;
+
+	memset((void *)&replay_ctx, 0, sizeof(replay_ctx));
+	replay_ctx.fn_rx_init_hw = &replay_rx_init_hw;
+	replay_ctx.fn_rx_deinit_hw = &replay_rx_deinit_hw;
+	kl_init_ctx(&replay_ctx);
+	kl_rx_start(&replay_ctx);
+	prev_state = replay_ctx.kl_rx_state;
+	prev_rf_act = replay_ctx.kl_rx_rf_act;
+
+	uint64_t next_poll = opts->poll_stride;
+
+	struct timespec ts0, ts1;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts0);
+
+	for(uint32_t i = 0; i < t->len; i++) {
+		if(t->pulses[i].lost && opts->verbose) {
+			printf("%12.6f  %u EDGES LOST\n", sim_now / 2000000.0, t->pulses[i].lost);
+		}
+
+		// the pulse lasts, then the edge to the opposite level comes
+		uint64_t edge = sim_now + t->pulses[i].ticks;
+		replay_advance(edge, &next_poll, opts, res);
+
+		TCNT1 = (uint16_t)edge;
+		kl_rx_process(&replay_ctx, !t->pulses[i].level, (uint16_t)edge);
+		replay_check(opts, res);
+		res->edges++;
+	}
+	replay_advance(sim_now + REPLAY_TAIL_TICKS, &next_poll, opts, res);
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts1);
+	res->cpu_s += (ts1.tv_sec - ts0.tv_sec) + (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+	res->ticks += sim_now;
+
+	kl_rx_stop(&replay_ctx);
+}
@@ -0,0 +1,38 @@
+/*
+ * replay.h
+ *
+ * Created: 19. 10. 2026. 14:02:51
+ *  Author: agent
+ *
+ * Runs a pulse trace through the firmware receiver (keeloq.c) with a simulated Timer1,
+ * as the OCR1B and pin-change ISRs and the main loop of the device would.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include "keeloq.h"
+#include "trace.h"
+
+#define REPLAY_POLL_STRIDE		0x4000	// must stay below half of the 16bit timer period
+#define REPLAY_TAIL_TICKS		KL_US2TICKS(1000000UL) // silence after the trace, so the last frame and RF activity can end
+
+struct replay_opts {
+	uint8_t verbose; // print receiver state transitions and RF activity
+	uint32_t poll_stride; // KL_RX_POLL_TICKS for the device cadence, REPLAY_POLL_STRIDE for speed
+	void (*fn_frame)(volatile struct keeloq_ctx *, uint64_t, void *); // called for every frame in kl_rx_buff, with the simulated time
+	void *user;
+};
+
+struct replay_result {
+	uint32_t frames;
+	uint32_t edges;
+	uint64_t ticks; // simulated time
+	double cpu_s; // time spent in the receiver, including the frame callbacks
+};
+
+extern volatile struct keeloq_ctx replay_ctx;
+
+void replay_run(struct trace *, struct replay_opts *, struct replay_result *);
+
+#endif /* REPLAY_H_ */
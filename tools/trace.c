@@ -0,0 +1,212 @@
+/*
+ * trace.c
+ *
+ * Created: 19. 10. 2026. 11:53:02
+ *  Author: agent
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "rawcap.h"
+
+int trace_append(struct trace *t, uint8_t level, uint32_t ticks, uint8_t lost) {
+	if(t->len == t->cap) {
+		uint32_t cap = t->cap ? t->cap * 2 : 4096;
+		struct trace_pulse *p = realloc(t->pulses, cap * sizeof(struct trace_pulse));
+		if(!p) {
+			return 0;
+		}
+		t->pulses = p;
+		t->cap = cap;
+	}
+
+	t->pulses[t->len].ticks = ticks;
+	t->pulses[t->len].level = level;
+	t->pulses[t->len].lost = lost;
+	t->len++;
+	t->ticks_total += ticks;
+	t->lost_total += lost;
+
+	return 1;
+}
+
+static int trace_load_text(struct trace *t, FILE *f) {
+	char line[128];
+	uint32_t line_no = 0;
+
+	while(fgets(line, sizeof(line), f)) {
+		line_no++;
+
+		char *c = strchr(line, '#');
+		if(c) {
+			*c = 0;
+		}
+
+		unsigned level;
+		unsigned long us;
+		char extra;
+		int n = sscanf(line, "%u %lu %c", &level, &us, &extra);
+		if(n <= 0) {
+			continue; // empty line
+		}
+		if(n != 2 || level > 1) {
+			fprintf(stderr, "line %u: expected \"<level 0/1> <microseconds>\"\n", line_no);
+			return 0;
+		}
+
+		if(!trace_append(t, level, (uint32_t)us * 2, 0)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// decode one block payload, returns 0 if it does not make sense (then nothing is appended)
+static int trace_load_block(struct trace *t, uint8_t *payload, uint8_t len, uint8_t lost) {
+	// first pass only checks, so that a broken block does not leave half of itself behind
+	uint8_t shift = 0;
+	for(uint8_t i = 0; i < len; i++) {
+		if(shift == 28 && (payload[i] & 0xE0)) {
+			return 0; // 5th byte carries the last 5 of 33 bits and can not continue
+		}
+		shift = (payload[i] & 0x80) ? shift + 7 : 0;
+	}
+	if(shift) {
+		return 0; // varint not finished
+	}
+
+	uint64_t v = 0;
+	shift = 0;
+	for(uint8_t i = 0; i < len; i++) {
+		v |= (uint64_t)(payload[i] & 0x7F) << shift;
+		if(payload[i] & 0x80) {
+			shift += 7;
+			continue;
+		}
+
+		if(!trace_append(t, v & 1, (uint32_t)(v >> 1), lost)) {
+			return 0;
+		}
+		lost = 0;
+		v = 0;
+		shift = 0;
+	}
+
+	return 1;
+}
+
+static int trace_load_bin(struct trace *t, FILE *f) {
+	int c;
+
+	while((c = fgetc(f)) != EOF) {
+		if(c != RAWCAP_BLOCK_SYNC) {
+			continue; // not in sync, or text in between the blocks
+		}
+
+		int len = fgetc(f);
+		int lost = fgetc(f);
+		if(len == EOF || lost == EOF) {
+			break;
+		}
+		if(len == 0 || len > RAWCAP_BUFF_LEN) {
+			t->blocks_bad++;
+			continue;
+		}
+
+		uint8_t payload[RAWCAP_BUFF_LEN];
+		if(fread(payload, 1, len, f) != (size_t)len) {
+			t->blocks_bad++;
+			break;
+		}
+
+		if(!trace_load_block(t, payload, len, lost)) {
+			t->blocks_bad++;
+		}
+	}
+
+	return 1;
+}
+
+int trace_load(struct trace *t, const char *path, uint8_t fmt) {
+	memset(t, 0, sizeof(struct trace));
+
+	if(fmt == TRACE_FMT_AUTO) {
+		const char *ext = strrchr(path, '.');
+		fmt = (ext && (!strcmp(ext, ".bin") || !strcmp(ext, ".raw"))) ? TRACE_FMT_BIN : TRACE_FMT_TEXT;
+	}
+
+	FILE *f = strcmp(path, "-") ? fopen(path, (fmt == TRACE_FMT_BIN) ? "rb" : "r") : stdin;
+	if(!f) {
+		perror(path);
+		return 0;
+	}
+
+	int ok = (fmt == TRACE_FMT_BIN) ? trace_load_bin(t, f) : trace_load_text(t, f);
+
+	if(f != stdin) {
+		fclose(f);
+	}
+
+	return ok;
+}
+
+int trace_write_text(FILE *f, struct trace *t) {
+	for(uint32_t i = 0; i < t->len; i++) {
+		if(t->pulses[i].lost) {
+			fprintf(f, "# %u edges lost\n", t->pulses[i].lost);
+		}
+		// ticks are 0.5us, odd ones lose half a microsecond here
+		if(fprintf(f, "%u %lu\n", t->pulses[i].level, (unsigned long)(t->pulses[i].ticks >> 1)) < 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// same blocks as the device sends in raw capture mode
+int trace_write_bin(FILE *f, struct trace *t) {
+	uint8_t payload[RAWCAP_BUFF_LEN];
+	uint8_t len = 0;
+	uint8_t lost = 0;
+
+	for(uint32_t i = 0; i <= t->len; i++) {
+		// flush when full, when the next pulse has lost edges in front of it, and at the end
+		if(len && (i == t->len || len > (RAWCAP_BUFF_LEN - RAWCAP_VARINT_MAX) || t->pulses[i].lost)) {
+			uint8_t hdr[3] = { RAWCAP_BLOCK_SYNC, len, lost };
+			if(fwrite(hdr, 1, 3, f) != 3 || fwrite(payload, 1, len, f) != len) {
+				return 0;
+			}
+			len = 0;
+			lost = 0;
+		}
+		if(i == t->len) {
+			break;
+		}
+
+		if(!len) {
+			lost = t->pulses[i].lost;
+		}
+
+		uint32_t ticks = t->pulses[i].ticks;
+		if(ticks > RAWCAP_TICKS_MAX) {
+			ticks = RAWCAP_TICKS_MAX;
+		}
+		uint64_t v = ((uint64_t)ticks << 1) | (t->pulses[i].level & 1);
+		while(v > 0x7F) {
+			payload[len++] = (uint8_t)v | 0x80;
+			v >>= 7;
+		}
+		payload[len++] = (uint8_t)v;
+	}
+
+	return 1;
+}
+
+void trace_free(struct trace *t) {
+	free(t->pulses);
+	memset(t, 0, sizeof(struct trace));
+}
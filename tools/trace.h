@@ -0,0 +1,47 @@
+/*
+ * trace.h
+ *
+ * Created: 19. 10. 2026. 11:52:40
+ *  Author: agent
+ *
+ * Pulse traces for the host tools. A trace is a sequence of pulses, each one is a level and its length.
+ *
+ * Text format, one pulse per line, '#' starts a comment:
+ *	<level 0/1> <length in microseconds>
+ *
+ * Binary format is exactly what the device streams in raw capture mode (option 5), see rawcap.h.
+ * Anything in between the blocks (e.g. the boot messages) is skipped.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_FMT_AUTO		0	// by file extension: .bin and .raw are binary, everything else is text
+#define TRACE_FMT_TEXT		1
+#define TRACE_FMT_BIN		2
+
+struct trace_pulse {
+	uint32_t ticks; // Timer1 ticks, 0.5us
+	uint8_t level;
+	uint8_t lost; // edges the device lost just before this pulse (binary traces only), 255 means 255 or more
+};
+
+struct trace {
+	struct trace_pulse *pulses;
+	uint32_t len;
+	uint32_t cap;
+	uint64_t ticks_total;
+	uint32_t lost_total;
+	uint32_t blocks_bad; // binary blocks skipped because they did not make sense
+};
+
+int trace_load(struct trace *, const char *, uint8_t);
+int trace_append(struct trace *, uint8_t, uint32_t, uint8_t);
+int trace_write_text(FILE *, struct trace *);
+int trace_write_bin(FILE *, struct trace *);
+void trace_free(struct trace *);
+
+#endif /* TRACE_H_ */